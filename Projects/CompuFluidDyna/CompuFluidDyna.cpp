@@ -21,6 +21,10 @@ CompuFluidDyna::CompuFluidDyna() {
   isActivProj= false;
   isAllocated= false;
   isRefreshed= false;
+  isCubeBatchValid= false;
+  isHomogeneousBC= false;
+  isSpectralValid= false;
+  historyFrame= -1;
 }
 
 
@@ -34,22 +38,36 @@ void CompuFluidDyna::SetActiveProject() {
     D.UI.push_back(ParamUI("ResolutionY_", 200));    // Eulerian mesh resolution
     D.UI.push_back(ParamUI("ResolutionZ_", 200));    // Eulerian mesh resolution
     D.UI.push_back(ParamUI("VoxelSize___", 1e-2));   // Element size
+    D.UI.push_back(ParamUI("SparseStore_", 0));      // Flag to only store the field columns containing fluid or fluid-solid interface
+    D.UI.push_back(ParamUI("NbSubDomain_", 1));      // Number of slab subdomains swept in parallel by the solver kernels
     D.UI.push_back(ParamUI("TimeStep____", 0.02));   // Simulation time step
+    D.UI.push_back(ParamUI("TimeStepCFL_", 0.0));    // Target CFL number for the adaptive time step capped by TimeStep____, 0= fixed time step
+    D.UI.push_back(ParamUI("AdvecSubMax_", 1));      // Max number of advection substeps per time step to keep the advection CFL number below one
+    D.UI.push_back(ParamUI("SolvEngine__", 0));      // Fluid engine, 0= stable fluids with implicit solves, 1= lattice Boltzmann D2Q9/D3Q19
+    D.UI.push_back(ParamUI("SteadyRelax_", 0.0));    // Under-relaxation of velocity and pressure in the pseudo transient steady state mode, 0= transient simulation
     D.UI.push_back(ParamUI("SolvMaxIter_", 32));     // Max number of solver iterations
-    D.UI.push_back(ParamUI("SolvType____", 2));      // Flag to use Gauss Seidel (=0), Gradient Descent (=1) or Conjugate Gradient (=2)
+    D.UI.push_back(ParamUI("SolvType____", 2));      // Flag to use Gauss Seidel (=0), Gradient Descent (=1), Conjugate Gradient (=2) or DCT/DST pressure solve on box domains with CG fallback (=3)
     D.UI.push_back(ParamUI("SolvSOR_____", 1.8));    // Overrelaxation coefficient in Gauss Seidel solver
     D.UI.push_back(ParamUI("SolvTolRhs__", 0.0));    // Solver tolerance relative to RHS norm
     D.UI.push_back(ParamUI("SolvTolRel__", 1.e-3));  // Solver tolerance relative to initial guess
     D.UI.push_back(ParamUI("SolvTolAbs__", 0.0));    // Solver tolerance relative absolute value of residual magnitude
+    D.UI.push_back(ParamUI("TileSizeX___", 0));      // Tile size of the cache blocked stencil sweeps, 0= whole dimension
+    D.UI.push_back(ParamUI("TileSizeY___", 0));      // Tile size of the cache blocked stencil sweeps, 0= whole dimension
+    D.UI.push_back(ParamUI("TileSizeZ___", 0));      // Tile size of the cache blocked stencil sweeps, 0= whole dimension
+    D.UI.push_back(ParamUI("TileSweeps__", 1));      // Number of Gauss Seidel relaxations of a tile before moving to the next one
     D.UI.push_back(ParamUI("FlagOptim___", 1.0));    // Flag to activate the shape optimizer
-    D.UI.push_back(ParamUI("FieldOptimE_", 1));      // Field and mode to use for the voxel sorting for erosion (1 == StrRate DESC, 2 == VelMag DESC, 3 == Vorticity DESC, 4 == StrRate ASC, 5 == VelMag ASC, 6 == Vorticity ASC)
+    D.UI.push_back(ParamUI("FieldOptimE_", 1));      // Field and mode to use for the voxel sorting for erosion (1 == StrRate DESC, 2 == VelMag DESC, 3 == Vorticity DESC, 4 == StrRate ASC, 5 == VelMag ASC, 6 == Vorticity ASC, 7 == Adjoint MFR sensitivity DESC)
     D.UI.push_back(ParamUI("FieldOptimS_", 4));      // Field and mode to use for the voxel sorting for sedimentation (1 == StrRate DESC, 2 == VelMag DESC, 3 == Vorticity DESC, 4 == StrRate ASC, 5 == VelMag ASC, 6 == Vorticity ASC)
     D.UI.push_back(ParamUI("OptimMFRTol_", 1.e-9));  // Shape optimizer tolerance relative to the mass flow rate
     D.UI.push_back(ParamUI("FlushTol____", 0.1));    // Tolerance relative to the minimum fluid density from which we consider that the fluid flushed  
     D.UI.push_back(ParamUI("KEDTol______", 1.e-0));  // Tolerance relative to Kinetic Energy delta to consider the flow stable
+    D.UI.push_back(ParamUI("CoarseGrid__", 0));      // Coarsening factor of the grid solved to steady state to initialize the flow, 0= start from rest
+    D.UI.push_back(ParamUI("CoarseSteps_", 2000));   // Max number of time steps on the coarse grid
     D.UI.push_back(ParamUI("OptiIterWin_", 1000));   // Max number of iterations without a change of maxMFR before ending the optimization
     D.UI.push_back(ParamUI("SafeZoneRad_", 10));     // Radius of the zone of non optimization around the base case voxels
     D.UI.push_back(ParamUI("FracErosion_", 0.05));   // Fraction of eroded voxels at each optimization step
+    D.UI.push_back(ParamUI("OptimEnsemb_", 1));      // Number of erosion variants simulated concurrently at each optimization step, the best mass flow rate is kept
+    D.UI.push_back(ParamUI("AdjointIter_", 20));     // Number of pseudo time steps of the adjoint solve for the sensitivity erosion criterion, warm started from the previous solve
     D.UI.push_back(ParamUI("CoeffFluTime", 0.1));    // Coefficient applied to the flush time, time window between optimization iterations to reach flow stability
     D.UI.push_back(ParamUI("CoeffGravi__", 0.0));    // Magnitude of gravity in Z- direction
     D.UI.push_back(ParamUI("CoeffAdvec__", 5.0));    // 0= no advection, 1= linear advection, >1 MacCormack correction iterations
@@ -76,6 +94,17 @@ void CompuFluidDyna::SetActiveProject() {
     D.UI.push_back(ParamUI("SlicePlotX__", 0.5));    // Positions for the slices
     D.UI.push_back(ParamUI("SlicePlotY__", 0.5));    // Positions for the slices
     D.UI.push_back(ParamUI("SlicePlotZ__", 0.5));    // Positions for the slices
+    D.UI.push_back(ParamUI("TracerCount_", 0));      // Number of tracer particles advected in the flow for display, 0= no tracers
+    D.UI.push_back(ParamUI("TracerOrder_", 2));      // Runge Kutta order of the tracer advection, 2= midpoint or 4= classic
+    D.UI.push_back(ParamUI("TracerLife__", 0.0));    // Simulated time after which a tracer is released again, 0= only when leaving the fluid
+    D.UI.push_back(ParamUI("ExportVTI___", 0));      // Number of time steps between exports of the fields to FileOutput/CFD_*.vti, 0= no export
+    D.UI.push_back(ParamUI("ExportField_", 7));      // Bit mask of the exported fields, 1= Smok, 2= Pres, 4= Vel, 8= Dive, 16= Vort, 32= Solid
+    D.UI.push_back(ParamUI("TimelineRec_", 0));      // Number of time steps between frames recorded in the compressed history, 0= no recording
+    D.UI.push_back(ParamUI("TimelineMem_", 256));    // Memory budget of the history in MB, older frames are spilled to FileOutput/CFD_timeline.bin
+    D.UI.push_back(ParamUI("TimelineSeek", -1));     // Position of the displayed frame in the recorded history from 0 to 1, negative= live simulation
+    D.UI.push_back(ParamUI("BenchSteps__", 0));      // Max number of time steps per configuration of the cavity time-to-accuracy benchmark run at refresh, 0= no benchmark
+    D.UI.push_back(ParamUI("BenchCheck__", 50));     // Number of time steps between measures of the benchmark profile errors
+    D.UI.push_back(ParamUI("BenchErrTol_", 0.05));   // Target RMS error of the centerline velocity profiles in the benchmark
     D.UI.push_back(ParamUI("VerboseSolv_", -0.5));   // Verbose mode for linear solvers
     D.UI.push_back(ParamUI("VerboseTime_", -0.5));   // Verbose mode for linear solvers
     D.UI.push_back(ParamUI("Verbose_____", 0.0));    // Verbose mode
@@ -102,6 +131,8 @@ bool CompuFluidDyna::CheckAlloc() {
   if (D.UI[ResolutionY_].hasChanged()) isAllocated= false;
   if (D.UI[ResolutionZ_].hasChanged()) isAllocated= false;
   if (D.UI[VoxelSize___].hasChanged()) isAllocated= false;
+  if (D.UI[SparseStore_].hasChanged()) isAllocated= false;
+  if (D.UI[NbSubDomain_].hasChanged()) isAllocated= false;
   return isAllocated;
 }
 
@@ -118,6 +149,9 @@ bool CompuFluidDyna::CheckRefresh() {
   if (D.UI[ObjectPosZ__].hasChanged()) isRefreshed= false;
   if (D.UI[ObjectSize0_].hasChanged()) isRefreshed= false;
   if (D.UI[ObjectSize1_].hasChanged()) isRefreshed= false;
+  if (D.UI[SolvEngine__].hasChanged()) isRefreshed= false;
+  if (D.UI[CoarseGrid__].hasChanged()) isRefreshed= false;
+  if (D.UI[BenchSteps__].hasChanged()) isRefreshed= false;
   return isRefreshed;
 }
 
@@ -128,7 +162,7 @@ void CompuFluidDyna::CheckFlushed() {
   for (int x= 0; x < nX; x++) {
     for (int y= 0; y < nY; y++) {
       for (int z= 0; z < nZ; z++) {
-        if (PreBC[x][y][z] && Pres[x][y][z] <= 0.0f) { // If it is an outlet voxel 
+        if (Scen->IsPreBC(x, y, z) && Pres[x][y][z] <= 0.0f) { // If it is an outlet voxel 
           sumSmo += Smok[x][y][z];
           nbSmo++;
         }
@@ -156,38 +190,64 @@ void CompuFluidDyna::Allocate() {
 
   fluidDensity= 1.0f;
 
-  // Allocate data
+  AllocateFields();
+}
+
+
+// Allocate the fields for the current dimensions
+void CompuFluidDyna::AllocateFields() {
+  AllocateScenario();
+
+  FluidSpans= Field::AllocField2D(nX, nY, std::vector<std::array<int, 2>>());
+  IfacSpans= Field::AllocField2D(nX, nY, std::vector<std::array<int, 2>>());
+  FreeSpans= Field::AllocField3D(5, nX, nY, std::vector<std::array<int, 2>>());
+  FixedSpans= Field::AllocField3D(5, nX, nY, std::vector<std::array<int, 2>>());
+  nbFluidVox= nbIfacVox= 0;
+
+  // Decompose the domain before allocating so each subdomain first touches its own columns
+  BuildSubDomains();
+
+  // Columns of the run fields are stored lazily in sparse mode and compacted once the scenario is known
+  sparseStore= D.UI[SparseStore_].GetB();
+  StoredCols= Field::AllocField2D(nX, nY, !sparseStore);
+  ZeroCol= std::vector<float>(nZ, 0.0f);
+  FaceFlags= Field::AllocField2D(nX, nY, std::vector<uint16_t>(sparseStore ? 0 : nZ, 0));
+  OptimAvoid= Field::AllocField2D(nX, nY, std::vector<bool>(sparseStore ? 0 : nZ, false));
+
+  Pres= AllocRunField(0.0f);
+  Dive= AllocRunField(0.0f);
+  Smok= AllocRunField(0.0f);
+  VelX= AllocRunField(0.0f);
+  VelY= AllocRunField(0.0f);
+  VelZ= AllocRunField(0.0f);
+
+  // Diagnostic fields are allocated by their first consumer
+  for (std::vector<std::vector<std::vector<diag_float>>>* field : DiagFields())
+    field->clear();
+  AdjVelX.clear();
+  AdjVelY.clear();
+  AdjVelZ.clear();
+  OldStepVelX.clear();
+  OldStepVelY.clear();
+  OldStepVelZ.clear();
+  OldStepPres.clear();
+}
+
+
+// Allocate the solid flags and a new set of boundary conditions over the whole domain for the scenario setup
+// The setup writes them in any voxel, sparse mode compacts them once the scenario is built
+void CompuFluidDyna::AllocateScenario() {
   Solid= Field::AllocField3D(nX, nY, nZ, false);
-  VelBC= Field::AllocField3D(nX, nY, nZ, false);
-  PreBC= Field::AllocField3D(nX, nY, nZ, false);
-  SmoBC= Field::AllocField3D(nX, nY, nZ, false);
-  VelXForced= Field::AllocField3D(nX, nY, nZ, 0.0f);
-  VelYForced= Field::AllocField3D(nX, nY, nZ, 0.0f);
-  VelZForced= Field::AllocField3D(nX, nY, nZ, 0.0f);
-  PresForced= Field::AllocField3D(nX, nY, nZ, 0.0f);
-  SmokForced= Field::AllocField3D(nX, nY, nZ, 0.0f);
-
-  Dum0= Field::AllocField3D(nX, nY, nZ, 0.0f);
-  Dum1= Field::AllocField3D(nX, nY, nZ, 0.0f);
-  Dum2= Field::AllocField3D(nX, nY, nZ, 0.0f);
-  Dum3= Field::AllocField3D(nX, nY, nZ, 0.0f);
-  Dum4= Field::AllocField3D(nX, nY, nZ, 0.0f);
-  Vort= Field::AllocField3D(nX, nY, nZ, 0.0f);
-  Vmag= Field::AllocField3D(nX, nY, nZ, 0.0f);
-  Pres= Field::AllocField3D(nX, nY, nZ, 0.0f);
-  Dive= Field::AllocField3D(nX, nY, nZ, 0.0f);
-  Smok= Field::AllocField3D(nX, nY, nZ, 0.0f);
-  VelX= Field::AllocField3D(nX, nY, nZ, 0.0f);
-  VelY= Field::AllocField3D(nX, nY, nZ, 0.0f);
-  VelZ= Field::AllocField3D(nX, nY, nZ, 0.0f);
-  CurX= Field::AllocField3D(nX, nY, nZ, 0.0f);
-  CurY= Field::AllocField3D(nX, nY, nZ, 0.0f);
-  CurZ= Field::AllocField3D(nX, nY, nZ, 0.0f);
-  AdvX= Field::AllocField3D(nX, nY, nZ, 0.0f);
-  AdvY= Field::AllocField3D(nX, nY, nZ, 0.0f);
-  AdvZ= Field::AllocField3D(nX, nY, nZ, 0.0f);
-
-  StrRate= Field::AllocField3D(nX, nY, nZ, 0.0f);
+  Scen= std::make_shared<ScenarioBC>();
+  Scen->VelBC= Field::AllocField3D(nX, nY, nZ, false);
+  Scen->PreBC= Field::AllocField3D(nX, nY, nZ, false);
+  Scen->SmoBC= Field::AllocField3D(nX, nY, nZ, false);
+  Scen->VelXForced= Field::AllocField3D(nX, nY, nZ, 0.0f);
+  Scen->VelYForced= Field::AllocField3D(nX, nY, nZ, 0.0f);
+  Scen->VelZForced= Field::AllocField3D(nX, nY, nZ, 0.0f);
+  Scen->PresForced= Field::AllocField3D(nX, nY, nZ, 0.0f);
+  Scen->SmokForced= Field::AllocField3D(nX, nY, nZ, 0.0f);
+  Scen->SafeZone= Field::AllocField2D(nX, nY, std::vector<bool>());
 }
 
 
@@ -195,41 +255,42 @@ void CompuFluidDyna::Allocate() {
 void CompuFluidDyna::Refresh() {
   if (!isActivProj) return;
   if (!CheckAlloc()) Allocate();
-  if (CheckRefresh()) return;
+  if (CheckRefresh()) {
+    ScrubTimeline();
+    return;
+  }
   isRefreshed= true;
 
   // Initialize scenario values
   simTime= 0;
-  for (int x= 0; x < nX; x++) {
-    for (int y= 0; y < nY; y++) {
-      for (int z= 0; z < nZ; z++) {
-        Solid[x][y][z]= VelBC[x][y][z]= PreBC[x][y][z]= SmoBC[x][y][z]= false;
-        VelXForced[x][y][z]= VelYForced[x][y][z]= VelZForced[x][y][z]= PresForced[x][y][z]= SmokForced[x][y][z]= 0.0f;
-      }
-    }
-  }  
-
-  CompuFluidDyna::InitializeScenario();
-
-  // Enforce scenario validity
-  for (int x= 0; x < nX; x++) {
-    for (int y= 0; y < nY; y++) {
-      for (int z= 0; z < nZ; z++) {
-        if (Solid[x][y][z]) {
-          VelBC[x][y][z]= PreBC[x][y][z]= SmoBC[x][y][z]= false;
-          VelXForced[x][y][z]= VelYForced[x][y][z]= VelZForced[x][y][z]= PresForced[x][y][z]= SmokForced[x][y][z]= 0.0f;
-        }
-      }
-    }
-  }
-
-  // Apply BC on fields
-  ApplyBC(FieldID::IDSmok, Smok);
-  ApplyBC(FieldID::IDVelX, VelX);
-  ApplyBC(FieldID::IDVelY, VelY);
-  ApplyBC(FieldID::IDVelZ, VelZ);
-  ApplyBC(FieldID::IDPres, Dive);
-  ApplyBC(FieldID::IDPres, Pres);
+  simStep= 0;
+  History.reset();
+  historyFrame= -1;
+  LiveFrame.clear();
+  SteadyResVel.clear();
+  SteadyResDiv.clear();
+  diagStep.fill(-1);
+  isWireBatchValid= false;
+  isCubeBatchValid= false;
+  simTimeStep= D.UI[TimeStep____].GetF();
+  maxVelMag= 0.0f;
+  AllocateScenario();
+
+  BuildScenario();
+
+  // Release the tracers from the inlets of the scenario
+  InitTracers();
+
+  // Start from the steady flow of a coarser grid
+  if (D.UI[CoarseGrid__].GetI() > 1 && D.UI[SolvEngine__].GetI() != 1) CoarseContinuation(D.UI[CoarseGrid__].GetI());
+
+  // Measure the initial max velocity for the adaptive time step
+  ComputeMaxVelocity();
+
+  // Build the lattice and reference velocity of the lattice Boltzmann engine
+  LbmDist.clear();
+  LbmDistNew.clear();
+  if (D.UI[SolvEngine__].GetI() == 1) LatticeBoltzmannInit();
 
   // Initialize optimization variables
   // RPD = 1.0f;
@@ -255,6 +316,9 @@ void CompuFluidDyna::Refresh() {
   ComputeGeometrySurfaceArea();
   d0 = VolOOS / SurfArea;
   // printf("d0 : %f\n", d0);
+
+  // Compare the solver configurations on the lid driven cavity benchmark
+  if (D.UI[Scenario____].GetI() == 3 && D.UI[BenchSteps__].GetI() > 0) CavityBenchmark();
   
 }
 
@@ -273,116 +337,56 @@ void CompuFluidDyna::Animate() {
   if (!CheckAlloc()) Allocate();
   if (!CheckRefresh()) Refresh();
 
-  // Get simulation parameters
-  const int maxIter= std::max(D.UI[SolvMaxIter_].GetI(), 0);
-  const float timestep= D.UI[TimeStep____].GetF();
-  const float coeffDiffu= std::max(D.UI[CoeffDiffuS_].GetF(), 0.0f);
-  const float coeffVisco= std::max(D.UI[CoeffDiffuV_].GetF(), 0.0f);
-  const float coeffVorti= D.UI[CoeffVorti__].GetF();
-  simTime+= D.UI[TimeStep____].GetF();
-
-  // Update periodic smoke in inlet
-  if (D.UI[VerboseTime_].GetB()) Timer::PushTimer();
-  ApplyBC(FieldID::IDSmok, Smok);
-  if (D.UI[VerboseTime_].GetB()) printf("%f T ApplyBC\n", Timer::PopTimer());
-
-  // Incompressible Navier Stokes
-  // ∂vel/∂t = - (vel · ∇) vel + visco ∇²vel − 1/ρ ∇press + f
-  // ∇ · vel = 0
+  // The simulation is paused while a recorded frame is shown
+  ScrubTimeline();
+  if (historyFrame >= 0) return;
 
-  // Advection steps
-  if (D.UI[VerboseTime_].GetB()) Timer::PushTimer();
-  if (D.UI[CoeffAdvec__].GetB()) {
-    AdvectField(FieldID::IDSmok, timestep, VelX, VelY, VelZ, Smok);
+  // Advection source vectors are only stored while they are displayed
+  if (D.displayMode4 && AdvX.empty()) {
+    AdvX= AllocDiagField(0.0f);
+    AdvY= AllocDiagField(0.0f);
+    AdvZ= AllocDiagField(0.0f);
   }
-  if (D.UI[CoeffAdvec__].GetB()) {
-    std::vector<std::vector<std::vector<float>>> oldVelX= VelX;
-    std::vector<std::vector<std::vector<float>>> oldVelY= VelY;
-    std::vector<std::vector<std::vector<float>>> oldVelZ= VelZ;
-    if (nX > 1) AdvectField(FieldID::IDVelX, timestep, oldVelX, oldVelY, oldVelZ, VelX);
-    if (nY > 1) AdvectField(FieldID::IDVelY, timestep, oldVelX, oldVelY, oldVelZ, VelY);
-    if (nZ > 1) AdvectField(FieldID::IDVelZ, timestep, oldVelX, oldVelY, oldVelZ, VelZ);
+  else if (!D.displayMode4 && !AdvX.empty()) {
+    AdvX.clear();
+    AdvY.clear();
+    AdvZ.clear();
   }
-  if (D.UI[VerboseTime_].GetB()) printf("%f T AdvectField\n", Timer::PopTimer());
 
-  // Diffusion steps
-  if (D.UI[VerboseTime_].GetB()) Timer::PushTimer();
-  if (D.UI[CoeffDiffuS_].GetB()) {
-    // (Id - diffu Δt ∇²) smo = smo
-    std::vector<std::vector<std::vector<float>>> oldSmoke= Smok;
-    if (D.UI[SolvType____].GetI() == 0) {
-      GaussSeidelSolve(FieldID::IDSmok, maxIter, timestep, true, coeffDiffu, oldSmoke, Smok);
-    }
-    else if (D.UI[SolvType____].GetI() == 1) {
-      GradientDescentSolve(FieldID::IDSmok, maxIter, timestep, true, coeffDiffu, oldSmoke, Smok);
-    }
-    else {
-      ConjugateGradientSolve(FieldID::IDSmok, maxIter, timestep, true, coeffDiffu, oldSmoke, Smok);
-    }
-  }
-  if (D.UI[CoeffDiffuV_].GetB()) {
-    // (Id - visco Δt ∇²) vel = vel
-    std::vector<std::vector<std::vector<float>>> oldVelX= VelX;
-    std::vector<std::vector<std::vector<float>>> oldVelY= VelY;
-    std::vector<std::vector<std::vector<float>>> oldVelZ= VelZ;
-    if (D.UI[SolvType____].GetI() == 0) {
-      if (nX > 1) GaussSeidelSolve(FieldID::IDVelX, maxIter, timestep, true, coeffVisco, oldVelX, VelX);
-      if (nY > 1) GaussSeidelSolve(FieldID::IDVelY, maxIter, timestep, true, coeffVisco, oldVelY, VelY);
-      if (nZ > 1) GaussSeidelSolve(FieldID::IDVelZ, maxIter, timestep, true, coeffVisco, oldVelZ, VelZ);
-    }
-    else if (D.UI[SolvType____].GetI() == 1) {
-      if (nX > 1) GradientDescentSolve(FieldID::IDVelX, maxIter, timestep, true, coeffVisco, oldVelX, VelX);
-      if (nY > 1) GradientDescentSolve(FieldID::IDVelY, maxIter, timestep, true, coeffVisco, oldVelY, VelY);
-      if (nZ > 1) GradientDescentSolve(FieldID::IDVelZ, maxIter, timestep, true, coeffVisco, oldVelZ, VelZ);
-    }
-    else {
-      if (nX > 1) ConjugateGradientSolve(FieldID::IDVelX, maxIter, timestep, true, coeffVisco, oldVelX, VelX);
-      if (nY > 1) ConjugateGradientSolve(FieldID::IDVelY, maxIter, timestep, true, coeffVisco, oldVelY, VelY);
-      if (nZ > 1) ConjugateGradientSolve(FieldID::IDVelZ, maxIter, timestep, true, coeffVisco, oldVelZ, VelZ);
-    }
-  }
-  if (D.UI[VerboseTime_].GetB()) printf("%f T Diffusion\n", Timer::PopTimer());
+  // Advance the fluid by one time step
+  StepSimulation();
 
-  // Vorticity step
+  // Carry the tracers in the updated flow
   if (D.UI[VerboseTime_].GetB()) Timer::PushTimer();
-  if (D.UI[CoeffVorti__].GetB()) {
-    VorticityConfinement(timestep, coeffVorti, VelX, VelY, VelZ);
-  }
-  if (D.UI[VerboseTime_].GetB()) printf("%f T VorticityConfinement\n", Timer::PopTimer());
+  if ((int)TracerPosX.size() != std::max(D.UI[TracerCount_].GetI(), 0)) InitTracers();
+  if (!TracerPosX.empty()) AdvectTracers(simTimeStep);
+  if (D.UI[VerboseTime_].GetB()) printf("%f T AdvectTracers\n", Timer::PopTimer());
 
-  // External forces
+  // Display data on 2D graphs
   if (D.UI[VerboseTime_].GetB()) Timer::PushTimer();
-  if (D.UI[CoeffGravi__].GetB()) {
-    ExternalForces();
-  }
-  if (D.UI[VerboseTime_].GetB()) printf("%f T ExternalForces\n", Timer::PopTimer());
+  CompuFluidDyna::SetUpUIData();
+  if (D.UI[VerboseTime_].GetB()) printf("%f T SetUpUIData\n", Timer::PopTimer());
 
-  // Projection step
+  // Export the fields for post processing
   if (D.UI[VerboseTime_].GetB()) Timer::PushTimer();
-  if (D.UI[CoeffProj___].GetB()) {
-    ProjectField(maxIter, timestep, VelX, VelY, VelZ);
+  if (D.UI[ExportVTI___].GetI() > 0 && simStep % D.UI[ExportVTI___].GetI() == 0) {
+    ExportFields();
   }
-  if (D.UI[VerboseTime_].GetB()) printf("%f T ProjectField\n", Timer::PopTimer());
-
-  // Compute field data for display
-  if (D.UI[VerboseTime_].GetB()) Timer::PushTimer();
-  ComputeVelocityDivergence();
-  if (D.UI[VerboseTime_].GetB()) printf("%f T Divergence\n", Timer::PopTimer());
-  if (D.UI[VerboseTime_].GetB()) Timer::PushTimer();
-  ComputeVelocityCurlVorticity();
-  if (D.UI[VerboseTime_].GetB()) printf("%f T CurlVorticity\n", Timer::PopTimer());
+  if (D.UI[VerboseTime_].GetB()) printf("%f T ExportFields\n", Timer::PopTimer());
 
-  // Display data on 2D graphs
+  // Record the fields in the history
   if (D.UI[VerboseTime_].GetB()) Timer::PushTimer();
-  CompuFluidDyna::SetUpUIData();
-  if (D.UI[VerboseTime_].GetB()) printf("%f T SetUpUIData\n", Timer::PopTimer());
+  if (D.UI[TimelineRec_].GetI() > 0 && simStep % D.UI[TimelineRec_].GetI() == 0) {
+    RecordTimeline();
+  }
+  if (D.UI[VerboseTime_].GetB()) printf("%f T RecordTimeline\n", Timer::PopTimer());
 
   // TODO Compute fluid density to check if constant as it should be in incompressible case
 
   // Test heuristic optimization criterion method
   // https://open-research-europe.ec.europa.eu/articles/3-156  
   if (D.UI[FlagOptim___].GetB()) {
-    TimeSinceLastIter += timestep;
+    TimeSinceLastIter += simTimeStep;
     // Determine flush time through the geometry
     if (!flushed)
       CheckFlushed();
@@ -429,6 +433,7 @@ void CompuFluidDyna::Animate() {
             nbIterSinceMaxMFRChange++;
           }
         }
+        TimeSinceLastIter = 0.0f;
         if (nbIterSinceMaxMFRChange > D.UI[OptiIterWin_].GetI()
         || (OptimStarted && MFRD < std::max(D.UI[OptimMFRTol_].GetF(), 0.0f))) { // Optimization ends
           OptimEnded = true;
@@ -437,10 +442,12 @@ void CompuFluidDyna::Animate() {
           OptimStarted = true;
           // printf("MFR before next opti : %f\n", MFR[0]);
           MFRtmp = MFR[0];
-          HeuristicOptimizationStep();
+          if (D.UI[OptimEnsemb_].GetI() > 1)
+            EnsembleOptimizationStep();
+          else
+            HeuristicOptimizationStep(D.UI[FieldOptimE_].GetI(), D.UI[FracErosion_].GetF());
           // printf("Opti\n");
         }
-        TimeSinceLastIter = 0.0f;
       }
     }
   }
@@ -452,6 +459,130 @@ void CompuFluidDyna::Animate() {
 }
 
 
+// Advance the fluid state by one time step without touching the shared display data
+void CompuFluidDyna::StepSimulation() {
+  // Get simulation parameters
+  const int maxIter= std::max(D.UI[SolvMaxIter_].GetI(), 0);
+  const float coeffDiffu= std::max(D.UI[CoeffDiffuS_].GetF(), 0.0f);
+  const float coeffVisco= std::max(D.UI[CoeffDiffuV_].GetF(), 0.0f);
+  const float coeffVorti= D.UI[CoeffVorti__].GetF();
+  const bool lbmEngine= (D.UI[SolvEngine__].GetI() == 1);
+  const bool steadyMode= (D.UI[SteadyRelax_].GetF() > 0.0f && !lbmEngine);
+
+  // Adaptive time step from the target CFL number and the max velocity measured at the end of the previous iteration
+  float timestep= D.UI[TimeStep____].GetF();
+  if (D.UI[TimeStepCFL_].GetF() > 0.0f && maxVelMag > 0.0f)
+    timestep= std::min(timestep, D.UI[TimeStepCFL_].GetF() * voxSize / maxVelMag);
+  simTimeStep= timestep;
+  simTime+= timestep;
+  simStep++;
+  // Split advection in substeps when the CFL number of the step exceeds one
+  const int nbAdvecSub= std::min(std::max((int)std::ceil(timestep * maxVelMag / voxSize), 1), std::max(D.UI[AdvecSubMax_].GetI(), 1));
+  if (D.UI[Verbose_____].GetB()) printf("TimeStep %f CFL %f AdvecSub %d\n", timestep, timestep * maxVelMag / voxSize, nbAdvecSub);
+
+  // Keep the previous pseudo time iterate to under-relax the step in steady state mode
+  if (steadyMode) SteadyStateStore();
+
+  // Update periodic smoke in inlet
+  if (D.UI[VerboseTime_].GetB()) Timer::PushTimer();
+  ApplyBC(FieldID::IDSmok, Smok);
+  if (D.UI[VerboseTime_].GetB()) printf("%f T ApplyBC\n", Timer::PopTimer());
+
+  // Incompressible Navier Stokes
+  // ∂vel/∂t = - (vel · ∇) vel + visco ∇²vel − 1/ρ ∇press + f
+  // ∇ · vel = 0
+
+  // Advection steps
+  if (D.UI[VerboseTime_].GetB()) Timer::PushTimer();
+  if (D.UI[CoeffAdvec__].GetB()) {
+    // The lattice Boltzmann engine transports the velocity itself and only leaves the smoke to advect
+    std::vector<int> advecFieldIDs= {FieldID::IDSmok};
+    if (nX > 1 && !lbmEngine) advecFieldIDs.push_back(FieldID::IDVelX);
+    if (nY > 1 && !lbmEngine) advecFieldIDs.push_back(FieldID::IDVelY);
+    if (nZ > 1 && !lbmEngine) advecFieldIDs.push_back(FieldID::IDVelZ);
+    for (int k= 0; k < nbAdvecSub; k++)
+      AdvectFields(advecFieldIDs, timestep / (float)nbAdvecSub);
+  }
+  if (D.UI[VerboseTime_].GetB()) printf("%f T AdvectFields\n", Timer::PopTimer());
+
+  // Diffusion steps
+  if (D.UI[VerboseTime_].GetB()) Timer::PushTimer();
+  if (D.UI[CoeffDiffuS_].GetB()) {
+    // (Id - diffu Δt ∇²) smo = smo
+    std::vector<std::vector<std::vector<float>>> oldSmoke= Smok;
+    if (D.UI[SolvType____].GetI() == 0) {
+      GaussSeidelSolve(FieldID::IDSmok, maxIter, timestep, true, coeffDiffu, oldSmoke, Smok);
+    }
+    else if (D.UI[SolvType____].GetI() == 1) {
+      GradientDescentSolve(FieldID::IDSmok, maxIter, timestep, true, coeffDiffu, oldSmoke, Smok);
+    }
+    else {
+      ConjugateGradientSolve(FieldID::IDSmok, maxIter, timestep, true, coeffDiffu, oldSmoke, Smok);
+    }
+  }
+  if (D.UI[CoeffDiffuV_].GetB() && !lbmEngine) {
+    // (Id - visco Δt ∇²) vel = vel
+    std::vector<std::vector<std::vector<float>>> oldVelX= VelX;
+    std::vector<std::vector<std::vector<float>>> oldVelY= VelY;
+    std::vector<std::vector<std::vector<float>>> oldVelZ= VelZ;
+    if (D.UI[SolvType____].GetI() == 0) {
+      if (nX > 1) GaussSeidelSolve(FieldID::IDVelX, maxIter, timestep, true, coeffVisco, oldVelX, VelX);
+      if (nY > 1) GaussSeidelSolve(FieldID::IDVelY, maxIter, timestep, true, coeffVisco, oldVelY, VelY);
+      if (nZ > 1) GaussSeidelSolve(FieldID::IDVelZ, maxIter, timestep, true, coeffVisco, oldVelZ, VelZ);
+    }
+    else if (D.UI[SolvType____].GetI() == 1) {
+      if (nX > 1) GradientDescentSolve(FieldID::IDVelX, maxIter, timestep, true, coeffVisco, oldVelX, VelX);
+      if (nY > 1) GradientDescentSolve(FieldID::IDVelY, maxIter, timestep, true, coeffVisco, oldVelY, VelY);
+      if (nZ > 1) GradientDescentSolve(FieldID::IDVelZ, maxIter, timestep, true, coeffVisco, oldVelZ, VelZ);
+    }
+    else {
+      BlockConjugateGradientSolve(maxIter, timestep, coeffVisco, {&oldVelX, &oldVelY, &oldVelZ}, {&VelX, &VelY, &VelZ});
+    }
+  }
+  if (D.UI[VerboseTime_].GetB()) printf("%f T Diffusion\n", Timer::PopTimer());
+
+  // Vorticity step
+  if (D.UI[VerboseTime_].GetB()) Timer::PushTimer();
+  if (D.UI[CoeffVorti__].GetB() && !lbmEngine) {
+    VorticityConfinement(timestep, coeffVorti, VelX, VelY, VelZ);
+  }
+  if (D.UI[VerboseTime_].GetB()) printf("%f T VorticityConfinement\n", Timer::PopTimer());
+
+  // External forces
+  if (D.UI[VerboseTime_].GetB()) Timer::PushTimer();
+  if (D.UI[CoeffGravi__].GetB() && !lbmEngine) {
+    ExternalForces();
+  }
+  if (D.UI[VerboseTime_].GetB()) printf("%f T ExternalForces\n", Timer::PopTimer());
+
+  // Projection step
+  if (D.UI[VerboseTime_].GetB()) Timer::PushTimer();
+  if (D.UI[CoeffProj___].GetB() && !lbmEngine) {
+    ProjectField(maxIter, timestep, VelX, VelY, VelZ);
+  }
+  if (D.UI[VerboseTime_].GetB()) printf("%f T ProjectField\n", Timer::PopTimer());
+
+  // Lattice Boltzmann step replacing the velocity diffusion, vorticity, forces and projection steps
+  if (D.UI[VerboseTime_].GetB()) Timer::PushTimer();
+  if (lbmEngine) {
+    LatticeBoltzmannStep(timestep);
+  }
+  if (D.UI[VerboseTime_].GetB()) printf("%f T LatticeBoltzmannStep\n", Timer::PopTimer());
+
+  // Under-relax the pseudo time step towards the steady state and record the residuals
+  if (D.UI[VerboseTime_].GetB()) Timer::PushTimer();
+  if (steadyMode) {
+    SteadyStateRelaxation(timestep);
+  }
+  if (D.UI[VerboseTime_].GetB()) printf("%f T SteadyStateRelaxation\n", Timer::PopTimer());
+
+  // Measure the max velocity for the next adaptive time step, display fields are computed on demand
+  if (D.UI[VerboseTime_].GetB()) Timer::PushTimer();
+  ComputeMaxVelocity();
+  if (D.UI[VerboseTime_].GetB()) printf("%f T MaxVelocity\n", Timer::PopTimer());
+}
+
+
 // Draw the project
 void CompuFluidDyna::Draw() {
   if (!isActivProj) return;
@@ -460,35 +591,37 @@ void CompuFluidDyna::Draw() {
 
   // Draw the voxels
   if (D.displayMode1) {
+    // Rebuild the cached wireframe only when the geometry or the slice changed
+    const std::array<float, 4> sliceParam= {D.UI[SliceDim____].GetF(), D.UI[SlicePlotX__].GetF(), D.UI[SlicePlotY__].GetF(), D.UI[SlicePlotZ__].GetF()};
+    if (!isWireBatchValid || wireBatchSlice != sliceParam) {
+      isWireBatchValid= true;
+      wireBatchSlice= sliceParam;
+      WireBatch.Clear();
+      for (int x= 0; x < nX; x++) {
+        for (int y= 0; y < nY; y++) {
+          for (int z= 0; z < nZ; z++) {
+            if (D.UI[SliceDim____].GetI() == 1 && x != (int)std::round(D.UI[SlicePlotX__].GetF() * nX)) continue;
+            if (D.UI[SliceDim____].GetI() == 2 && y != (int)std::round(D.UI[SlicePlotY__].GetF() * nY)) continue;
+            if (D.UI[SliceDim____].GetI() == 3 && z != (int)std::round(D.UI[SlicePlotZ__].GetF() * nZ)) continue;
+            if (!IsSolid(x, y, z) && !Scen->IsPreBC(x, y, z) && !Scen->IsVelBC(x, y, z) && !Scen->IsSmoBC(x, y, z)) continue;
+            // Set the voxel color components
+            float r= 0.4f, g= 0.4f, b= 0.4f;
+            if (Scen->IsPreBC(x, y, z)) r= 0.7f;
+            if (Scen->IsVelBC(x, y, z)) g= 0.7f;
+            if (Scen->IsSmoBC(x, y, z)) b= 0.7f;
+            for (int face= 0; face < 6; face++)
+              WireBatch.AddCubeFace((float)x, (float)y, (float)z, face, true, r, g, b);
+          }
+        }
+      }
+    }
     glEnable(GL_LIGHTING);
     glLineWidth(2.0f);
     // Set the scene transformation
     glPushMatrix();
     glTranslatef(D.boxMin[0] + 0.5f * voxSize, D.boxMin[1] + 0.5f * voxSize, D.boxMin[2] + 0.5f * voxSize);
     glScalef(voxSize, voxSize, voxSize);
-    // Sweep the field
-    for (int x= 0; x < nX; x++) {
-      for (int y= 0; y < nY; y++) {
-        for (int z= 0; z < nZ; z++) {
-          if (D.UI[SliceDim____].GetI() == 1 && x != (int)std::round(D.UI[SlicePlotX__].GetF() * nX)) continue;
-          if (D.UI[SliceDim____].GetI() == 2 && y != (int)std::round(D.UI[SlicePlotY__].GetF() * nY)) continue;
-          if (D.UI[SliceDim____].GetI() == 3 && z != (int)std::round(D.UI[SlicePlotZ__].GetF() * nZ)) continue;
-          // Set the voxel color components
-          float r= 0.4f, g= 0.4f, b= 0.4f;
-          if (PreBC[x][y][z]) r= 0.7f;
-          if (VelBC[x][y][z]) g= 0.7f;
-          if (SmoBC[x][y][z]) b= 0.7f;
-          // Draw the cube
-          if (Solid[x][y][z] || PreBC[x][y][z] || VelBC[x][y][z] || SmoBC[x][y][z]) {
-            glColor3f(r, g, b);
-            glPushMatrix();
-            glTranslatef((float)x, (float)y, (float)z);
-            glutWireCube(1.0);
-            glPopMatrix();
-          }
-        }
-      }
-    }
+    WireBatch.DrawBatch(GL_LINES);
     glPopMatrix();
     glLineWidth(1.0f);
     glDisable(GL_LIGHTING);
@@ -496,6 +629,118 @@ void CompuFluidDyna::Draw() {
 
   // Draw the scalar fields
   if (D.displayMode2) {
+    // Rebuild the cached colored voxels only when the time step, the color mode or the slice changed
+    const std::array<float, 7> cubeParam= {D.UI[ColorMode___].GetF(), D.UI[ColorThresh_].GetF(), D.UI[ColorFactor_].GetF(),
+                                           D.UI[SliceDim____].GetF(), D.UI[SlicePlotX__].GetF(), D.UI[SlicePlotY__].GetF(), D.UI[SlicePlotZ__].GetF()};
+    if (!isCubeBatchValid || cubeBatchStep != simStep || cubeBatchParam != cubeParam) {
+      isCubeBatchValid= true;
+      cubeBatchStep= simStep;
+      cubeBatchParam= cubeParam;
+      // Compute the derived field of the color mode if the state changed since it was last drawn
+      if (D.UI[ColorMode___].GetI() == 4) UpdateDiagnostic(DiagID::DiagDive);
+      if (D.UI[ColorMode___].GetI() == 5) UpdateDiagnostic(DiagID::DiagVort);
+      // Sweep the field to color the shown voxels, only the columns with a shown voxel are allocated
+      CubeShown= Field::AllocField2D(nX, nY, std::vector<bool>());
+      CubeColor= Field::AllocField2D(nX, nY, std::vector<float>());
+      for (int x= 0; x < nX; x++) {
+        for (int y= 0; y < nY; y++) {
+          for (int z= 0; z < nZ; z++) {
+            if (D.UI[SliceDim____].GetI() == 1 && x != (int)std::round(D.UI[SlicePlotX__].GetF() * nX)) continue;
+            if (D.UI[SliceDim____].GetI() == 2 && y != (int)std::round(D.UI[SlicePlotY__].GetF() * nY)) continue;
+            if (D.UI[SliceDim____].GetI() == 3 && z != (int)std::round(D.UI[SlicePlotZ__].GetF() * nZ)) continue;
+            if (!StoredCols[x][y]) continue;
+            if (Solid[x][y][z] && D.UI[ColorThresh_].GetF() == 0.0) continue;
+            float r= 0.0f, g= 0.0f, b= 0.0f;
+            // Color by smoke
+            if (D.UI[ColorMode___].GetI() == 1) {
+              if (std::abs(Smok[x][y][z]) < D.UI[ColorThresh_].GetF()) continue;
+              Colormap::RatioToPlasma(0.5f + 0.5f * Smok[x][y][z] * D.UI[ColorFactor_].GetF(), r, g, b);
+            }
+            // Color by velocity magnitude
+            if (D.UI[ColorMode___].GetI() == 2) {
+              Vec::Vec3<float> vec(VelX[x][y][z], VelY[x][y][z], VelZ[x][y][z]);
+              if (vec.norm() < D.UI[ColorThresh_].GetF()) continue;
+              Colormap::RatioToJetBrightSmooth(vec.norm() * D.UI[ColorFactor_].GetF(), r, g, b);
+            }
+            // Color by pressure
+            if (D.UI[ColorMode___].GetI() == 3) {
+              if (std::abs(Pres[x][y][z]) < D.UI[ColorThresh_].GetF()) continue;
+              Colormap::RatioToBlueToRed(0.5f + 0.5f * Pres[x][y][z] * D.UI[ColorFactor_].GetF(), r, g, b);
+            }
+            // Color by divergence
+            if (D.UI[ColorMode___].GetI() == 4) {
+              if (std::abs(Dive[x][y][z]) < D.UI[ColorThresh_].GetF()) continue;
+              Colormap::RatioToGreenToRed(0.5f + 0.5f * Dive[x][y][z] * D.UI[ColorFactor_].GetF(), r, g, b);
+            }
+            // Color by vorticity
+            if (D.UI[ColorMode___].GetI() == 5) {
+              if (std::abs(Vort[x][y][z]) < D.UI[ColorThresh_].GetF()) continue;
+              Colormap::RatioToJetBrightSmooth(Vort[x][y][z] * D.UI[ColorFactor_].GetF(), r, g, b);
+            }
+            // Color by vel in X
+            if (D.UI[ColorMode___].GetI() == 6) {
+              if (std::abs(VelX[x][y][z]) < D.UI[ColorThresh_].GetF()) continue;
+              Colormap::RatioToJetBrightSmooth(0.5f + 0.5f * VelX[x][y][z] * D.UI[ColorFactor_].GetF(), r, g, b);
+            }
+            // Color by vel in Y
+            if (D.UI[ColorMode___].GetI() == 7) {
+              if (std::abs(VelY[x][y][z]) < D.UI[ColorThresh_].GetF()) continue;
+              Colormap::RatioToJetBrightSmooth(0.5f + 0.5f * VelY[x][y][z] * D.UI[ColorFactor_].GetF(), r, g, b);
+            }
+            // Color by vel in Z
+            if (D.UI[ColorMode___].GetI() == 8) {
+              if (std::abs(VelZ[x][y][z]) < D.UI[ColorThresh_].GetF()) continue;
+              Colormap::RatioToJetBrightSmooth(0.5f + 0.5f * VelZ[x][y][z] * D.UI[ColorFactor_].GetF(), r, g, b);
+            }
+            // Color by adjoint sensitivity of the last optimization step
+            if (D.UI[ColorMode___].GetI() == 9) {
+              const float val= AdjSens.empty() ? 0.0f : (float)AdjSens[x][y][z];
+              if (std::abs(val) < D.UI[ColorThresh_].GetF()) continue;
+              Colormap::RatioToBlueToRed(0.5f + 0.5f * val * D.UI[ColorFactor_].GetF(), r, g, b);
+            }
+            // Color by dummy values
+            if (D.UI[ColorMode___].GetI() >= 10 && D.UI[ColorMode___].GetI() <= 14) {
+              float val= 0.0f;
+              if (D.UI[ColorMode___].GetI() == 10 && !Dum0.empty()) val= Dum0[x][y][z];
+              if (D.UI[ColorMode___].GetI() == 11 && !Dum1.empty()) val= Dum1[x][y][z];
+              if (D.UI[ColorMode___].GetI() == 12 && !Dum2.empty()) val= Dum2[x][y][z];
+              if (D.UI[ColorMode___].GetI() == 13 && !Dum3.empty()) val= Dum3[x][y][z];
+              if (D.UI[ColorMode___].GetI() == 14 && !Dum4.empty()) val= Dum4[x][y][z];
+              if (std::abs(val) < D.UI[ColorThresh_].GetF()) continue;
+              Colormap::RatioToJetBrightSmooth(0.5f + 0.5f * val * D.UI[ColorFactor_].GetF(), r, g, b);
+            }
+            if (CubeShown[x][y].empty()) {
+              CubeShown[x][y].assign(nZ, false);
+              CubeColor[x][y].resize(3 * nZ);
+            }
+            CubeShown[x][y][z]= true;
+            CubeColor[x][y][3 * z + 0]= r;
+            CubeColor[x][y][3 * z + 1]= g;
+            CubeColor[x][y][3 * z + 2]= b;
+          }
+        }
+      }
+      // Batch the faces that are not hidden by a shown neighbor voxel
+      auto IsShown= [&](const int x, const int y, const int z) {
+        return x >= 0 && x < nX && y >= 0 && y < nY && z >= 0 && z < nZ && !CubeShown[x][y].empty() && CubeShown[x][y][z];
+      };
+      CubeBatch.Clear();
+      for (int x= 0; x < nX; x++) {
+        for (int y= 0; y < nY; y++) {
+          if (CubeShown[x][y].empty()) continue;
+          for (int z= 0; z < nZ; z++) {
+            if (!CubeShown[x][y][z]) continue;
+            const float r= CubeColor[x][y][3 * z + 0], g= CubeColor[x][y][3 * z + 1], b= CubeColor[x][y][3 * z + 2];
+            if (!IsShown(x - 1, y, z)) CubeBatch.AddCubeFace((float)x, (float)y, (float)z, 0, false, r, g, b);
+            if (!IsShown(x + 1, y, z)) CubeBatch.AddCubeFace((float)x, (float)y, (float)z, 1, false, r, g, b);
+            if (!IsShown(x, y - 1, z)) CubeBatch.AddCubeFace((float)x, (float)y, (float)z, 2, false, r, g, b);
+            if (!IsShown(x, y + 1, z)) CubeBatch.AddCubeFace((float)x, (float)y, (float)z, 3, false, r, g, b);
+            if (!IsShown(x, y, z - 1)) CubeBatch.AddCubeFace((float)x, (float)y, (float)z, 4, false, r, g, b);
+            if (!IsShown(x, y, z + 1)) CubeBatch.AddCubeFace((float)x, (float)y, (float)z, 5, false, r, g, b);
+          }
+        }
+      }
+    }
     // Set the scene transformation
     glPushMatrix();
     glTranslatef(D.boxMin[0] + 0.5f * voxSize, D.boxMin[1] + 0.5f * voxSize, D.boxMin[2] + 0.5f * voxSize);
@@ -503,75 +748,7 @@ void CompuFluidDyna::Draw() {
     if (nX == 1) glScalef(0.1f, 1.0f, 1.0f);
     if (nY == 1) glScalef(1.0f, 0.1f, 1.0f);
     if (nZ == 1) glScalef(1.0f, 1.0f, 0.1f);
-    // Sweep the field
-    for (int x= 0; x < nX; x++) {
-      for (int y= 0; y < nY; y++) {
-        for (int z= 0; z < nZ; z++) {
-          if (D.UI[SliceDim____].GetI() == 1 && x != (int)std::round(D.UI[SlicePlotX__].GetF() * nX)) continue;
-          if (D.UI[SliceDim____].GetI() == 2 && y != (int)std::round(D.UI[SlicePlotY__].GetF() * nY)) continue;
-          if (D.UI[SliceDim____].GetI() == 3 && z != (int)std::round(D.UI[SlicePlotZ__].GetF() * nZ)) continue;
-          if (Solid[x][y][z] && D.UI[ColorThresh_].GetF() == 0.0) continue;
-          float r= 0.0f, g= 0.0f, b= 0.0f;
-          // Color by smoke
-          if (D.UI[ColorMode___].GetI() == 1) {
-            if (std::abs(Smok[x][y][z]) < D.UI[ColorThresh_].GetF()) continue;
-            Colormap::RatioToPlasma(0.5f + 0.5f * Smok[x][y][z] * D.UI[ColorFactor_].GetF(), r, g, b);
-          }
-          // Color by velocity magnitude
-          if (D.UI[ColorMode___].GetI() == 2) {
-            Vec::Vec3<float> vec(VelX[x][y][z], VelY[x][y][z], VelZ[x][y][z]);
-            if (vec.norm() < D.UI[ColorThresh_].GetF()) continue;
-            Colormap::RatioToJetBrightSmooth(vec.norm() * D.UI[ColorFactor_].GetF(), r, g, b);
-          }
-          // Color by pressure
-          if (D.UI[ColorMode___].GetI() == 3) {
-            if (std::abs(Pres[x][y][z]) < D.UI[ColorThresh_].GetF()) continue;
-            Colormap::RatioToBlueToRed(0.5f + 0.5f * Pres[x][y][z] * D.UI[ColorFactor_].GetF(), r, g, b);
-          }
-          // Color by divergence
-          if (D.UI[ColorMode___].GetI() == 4) {
-            if (std::abs(Dive[x][y][z]) < D.UI[ColorThresh_].GetF()) continue;
-            Colormap::RatioToGreenToRed(0.5f + 0.5f * Dive[x][y][z] * D.UI[ColorFactor_].GetF(), r, g, b);
-          }
-          // Color by vorticity
-          if (D.UI[ColorMode___].GetI() == 5) {
-            if (std::abs(Vort[x][y][z]) < D.UI[ColorThresh_].GetF()) continue;
-            Colormap::RatioToJetBrightSmooth(Vort[x][y][z] * D.UI[ColorFactor_].GetF(), r, g, b);
-          }
-          // Color by vel in X
-          if (D.UI[ColorMode___].GetI() == 6) {
-            if (std::abs(VelX[x][y][z]) < D.UI[ColorThresh_].GetF()) continue;
-            Colormap::RatioToJetBrightSmooth(0.5f + 0.5f * VelX[x][y][z] * D.UI[ColorFactor_].GetF(), r, g, b);
-          }
-          // Color by vel in Y
-          if (D.UI[ColorMode___].GetI() == 7) {
-            if (std::abs(VelY[x][y][z]) < D.UI[ColorThresh_].GetF()) continue;
-            Colormap::RatioToJetBrightSmooth(0.5f + 0.5f * VelY[x][y][z] * D.UI[ColorFactor_].GetF(), r, g, b);
-          }
-          // Color by vel in Z
-          if (D.UI[ColorMode___].GetI() == 8) {
-            if (std::abs(VelZ[x][y][z]) < D.UI[ColorThresh_].GetF()) continue;
-            Colormap::RatioToJetBrightSmooth(0.5f + 0.5f * VelZ[x][y][z] * D.UI[ColorFactor_].GetF(), r, g, b);
-          }
-          // Color by dummy values
-          if (D.UI[ColorMode___].GetI() >= 10 && D.UI[ColorMode___].GetI() <= 14) {
-            float val= 0.0f;
-            if (D.UI[ColorMode___].GetI() == 10) val= Dum0[x][y][z];
-            if (D.UI[ColorMode___].GetI() == 11) val= Dum1[x][y][z];
-            if (D.UI[ColorMode___].GetI() == 12) val= Dum2[x][y][z];
-            if (D.UI[ColorMode___].GetI() == 13) val= Dum3[x][y][z];
-            if (D.UI[ColorMode___].GetI() == 14) val= Dum4[x][y][z];
-            if (std::abs(val) < D.UI[ColorThresh_].GetF()) continue;
-            Colormap::RatioToJetBrightSmooth(0.5f + 0.5f * val * D.UI[ColorFactor_].GetF(), r, g, b);
-          }
-          glColor3f(r, g, b);
-          glPushMatrix();
-          glTranslatef((float)x, (float)y, (float)z);
-          glutSolidCube(1.0);
-          glPopMatrix();
-        }
-      }
-    }
+    CubeBatch.DrawBatch(GL_QUADS);
     glPopMatrix();
   }
 
@@ -596,6 +773,7 @@ void CompuFluidDyna::Draw() {
             if (D.UI[SliceDim____].GetI() == 1 && x != (int)std::round(D.UI[SlicePlotX__].GetF() * nX)) continue;
             if (D.UI[SliceDim____].GetI() == 2 && y != (int)std::round(D.UI[SlicePlotY__].GetF() * nY)) continue;
             if (D.UI[SliceDim____].GetI() == 3 && z != (int)std::round(D.UI[SlicePlotZ__].GetF() * nZ)) continue;
+            if (!StoredCols[x][y]) continue;
             if (Solid[x][y][z] && D.UI[ColorThresh_].GetF() == 0.0) continue;
             // Draw the velocity field
             Vec::Vec3<float> vec(VelX[x][y][z], VelY[x][y][z], VelZ[x][y][z]);
@@ -623,7 +801,7 @@ void CompuFluidDyna::Draw() {
   }
 
   // Draw the advection source field
-  if (D.displayMode4) {
+  if (D.displayMode4 && !AdvX.empty()) {
     // Set the scene transformation
     glPushMatrix();
     if (nX == 1) glTranslatef(voxSize, 0.0f, 0.0f);
@@ -639,6 +817,7 @@ void CompuFluidDyna::Draw() {
           if (D.UI[SliceDim____].GetI() == 1 && x != (int)std::round(D.UI[SlicePlotX__].GetF() * nX)) continue;
           if (D.UI[SliceDim____].GetI() == 2 && y != (int)std::round(D.UI[SlicePlotY__].GetF() * nY)) continue;
           if (D.UI[SliceDim____].GetI() == 3 && z != (int)std::round(D.UI[SlicePlotZ__].GetF() * nZ)) continue;
+          if (!StoredCols[x][y]) continue;
           // Draw the velocity field
           Vec::Vec3<float> vec(AdvX[x][y][z], AdvY[x][y][z], AdvZ[x][y][z]);
           if (std::abs(D.UI[SliceDim____].GetI()) == 1) vec[0]= 0.0f;
@@ -659,4 +838,29 @@ void CompuFluidDyna::Draw() {
     glEnd();
     glPopMatrix();
   }
+
+  // Draw the tracer particles
+  if (D.displayMode5 && !TracerPosX.empty()) {
+    // Set the scene transformation
+    glPushMatrix();
+    glTranslatef(D.boxMin[0] + 0.5f * voxSize, D.boxMin[1] + 0.5f * voxSize, D.boxMin[2] + 0.5f * voxSize);
+    glScalef(voxSize, voxSize, voxSize);
+    // Fill the batch in parallel, the normals are unused with lighting off
+    const int nbTracer= (int)TracerPosX.size();
+    TracerBatch.Vert.resize((size_t)nbTracer * 3);
+    TracerBatch.Norm.assign((size_t)nbTracer * 3, 0.0f);
+    TracerBatch.Colr.resize((size_t)nbTracer * 3);
+    const float colorFactor= D.UI[ColorFactor_].GetF();
+#pragma omp parallel for
+    for (int k= 0; k < nbTracer; k++) {
+      TracerBatch.Vert[3 * k + 0]= TracerPosX[k];
+      TracerBatch.Vert[3 * k + 1]= TracerPosY[k];
+      TracerBatch.Vert[3 * k + 2]= TracerPosZ[k];
+      Colormap::RatioToJetBrightSmooth(TracerSpeed[k] * colorFactor, TracerBatch.Colr[3 * k + 0], TracerBatch.Colr[3 * k + 1], TracerBatch.Colr[3 * k + 2]);
+    }
+    glPointSize(2.0f);
+    TracerBatch.DrawBatch(GL_POINTS);
+    glPointSize(1.0f);
+    glPopMatrix();
+  }
 }
@@ -1,9 +1,19 @@
 #pragma once
 
 // Standard lib
+#include <array>
+#include <cstdint>
+#include <memory>
 #include <vector>
 #include <tuple>
 
+// Sandbox lib
+#include "../../Util/Draw.hpp"
+#include "../../Util/HalfFloat.hpp"
+
+class FileOutputQueue;
+class Timeline;
+
 
 // Fluid simulation code
 // - Eulerian voxel grid
@@ -15,6 +25,7 @@
 // - Uses iterative MackCormack backtracking scheme to achieve 2nd order accuracy in advection steps
 // - Reinjects dissipated vorticity at smallest scale using vorticity confinement approach
 // - Handles arbitrary boundary conditions and obstacles in the simulation domain using boolean flag fields
+// - Optional lattice Boltzmann engine (D2Q9/D3Q19 TRT) running the same scenarios without global linear solves
 // - Validated on Re < 2000 in lid-driven cavity flow, Poiseuille, Couette and venturi benchmarks
 // - Uses SI units
 //
@@ -44,12 +55,53 @@ class CompuFluidDyna
     IDPres,
   };
 
+  // Diagnostic fields allocated and computed only when a display mode, export or optimizer criterion reads them
+  enum DiagID
+  {
+    DiagDive,
+    DiagVort,
+    DiagVmag,
+    DiagStrR,
+    DiagAdjS,
+  };
+
+  // Storage type of the diagnostic fields that do not feed back into the linear solves
+  // Values are widened to float when read, HalfFloat::Float16 or float can be swapped in for more precision
+  typedef HalfFloat::BFloat16 diag_float;
+
+  // Number of voxels processed together along a column in the batched advection kernel
+  static constexpr int nbBatchVox= 16;
+
+  // Max lattice velocity, min relaxation time margin above 1/2 and Smagorinsky constant of the lattice Boltzmann engine
+  static constexpr float lbmMaxVelLat= 0.1f;
+  static constexpr float lbmMinTauGap= 0.005f;
+  static constexpr float lbmSmagoCoeff= 0.1f;
+
+  // Number of pooled frame buffers of the background VTI writer, exports are skipped while they are all in use
+  static constexpr int vtiNbBuffers= 4;
+
+  // Number of samples kept in the residual history of the steady state mode
+  static constexpr int steadyResMax= 1000;
+
+  // Max number of free pressure voxels left outside the box of the direct pressure solver, coupled to it by a dense system
+  static constexpr int spectralExtraMax= 1024;
+
   // Problem dimensions
   int nX;
   int nY;
   int nZ;
   float voxSize;
   float simTime;
+  float simTimeStep;  // Time step of the current iteration
+  float maxVelMag;    // Max velocity magnitude measured for the adaptive time step
+  int simStep;        // Number of time steps since the last refresh
+  std::array<int, 5> diagStep;  // Time step each diagnostic field was last computed at, -1= out of date
+  std::vector<float> SteadyResVel;  // Residual history of the steady state mode, RMS velocity change rate per pseudo time step
+  std::vector<float> SteadyResDiv;  // Residual history of the steady state mode, RMS velocity divergence
+  std::vector<std::vector<std::vector<float>>> OldStepVelX;  // Previous pseudo time iterate of the steady state mode, allocated on first use
+  std::vector<std::vector<std::vector<float>>> OldStepVelY;
+  std::vector<std::vector<std::vector<float>>> OldStepVelZ;
+  std::vector<std::vector<std::vector<float>>> OldStepPres;
 
   // Fields for optimization
 
@@ -74,7 +126,18 @@ class CompuFluidDyna
   float KED; // Kinetic Energy Delta
 
   // Strain rate (frobenius norm of the strain rate tensor at each voxel of the grid)
-  std::vector<std::vector<std::vector<float>>> StrRate;
+  std::vector<std::vector<std::vector<diag_float>>> StrRate;
+
+  // Adjoint sensitivity of the mass flow rate to the solid state (dot product of the velocity and adjoint velocity)
+  std::vector<std::vector<std::vector<diag_float>>> AdjSens;
+  std::vector<std::vector<std::vector<float>>> AdjVelX;  // Adjoint velocity of the last solve, warm starts the next one
+  std::vector<std::vector<std::vector<float>>> AdjVelY;
+  std::vector<std::vector<std::vector<float>>> AdjVelZ;
+  bool isHomogeneousBC;  // Boundary conditions enforce zero in place of the forced values while the adjoint is solved in the flow fields
+
+  // Voxels of the interface excluded from the optimization, the safe zone is stored with the scenario boundary conditions
+  int safeZoneRad;                                         // Radius the safe zone was built with
+  std::vector<std::vector<std::vector<bool>>> OptimAvoid;  // Voxels eroded in the current step that may not be resedimented, per stored column
 
   // Volume out of solid voxels
   float VolOOS;
@@ -100,41 +163,168 @@ class CompuFluidDyna
   float fluidDensity;
 
   // Fields for scenario setup
+  // In sparse mode the solid flags are only stored in the stored columns, the voxels of the other columns are all solid
   std::vector<std::vector<std::vector<bool>>> Solid;
-  std::vector<std::vector<std::vector<bool>>> VelBC;
-  std::vector<std::vector<std::vector<bool>>> PreBC;
-  std::vector<std::vector<std::vector<bool>>> SmoBC;
-  std::vector<std::vector<std::vector<float>>> VelXForced;
-  std::vector<std::vector<std::vector<float>>> VelYForced;
-  std::vector<std::vector<std::vector<float>>> VelZForced;
-  std::vector<std::vector<std::vector<float>>> PresForced;
-  std::vector<std::vector<std::vector<float>>> SmokForced;
+
+  // Boundary conditions of the scenario, left unchanged by the optimization
+  // They are shared by the copies of the solver state, a copy about to modify them first takes its own
+  // In sparse mode the flags and forced values of a field are only stored in the columns holding one of its boundary conditions
+  struct ScenarioBC {
+    std::vector<std::vector<std::vector<bool>>> VelBC;
+    std::vector<std::vector<std::vector<bool>>> PreBC;
+    std::vector<std::vector<std::vector<bool>>> SmoBC;
+    std::vector<std::vector<std::vector<float>>> VelXForced;
+    std::vector<std::vector<std::vector<float>>> VelYForced;
+    std::vector<std::vector<std::vector<float>>> VelZForced;
+    std::vector<std::vector<std::vector<float>>> PresForced;
+    std::vector<std::vector<std::vector<float>>> SmokForced;
+    std::vector<std::vector<std::vector<bool>>> SafeZone;  // Voxels near the boundary conditions, stored only in the columns reached
+
+    // Flags of a voxel, columns without storage read as false
+    bool IsVelBC(const int x, const int y, const int z) const { return !VelBC[x][y].empty() && VelBC[x][y][z]; }
+    bool IsPreBC(const int x, const int y, const int z) const { return !PreBC[x][y].empty() && PreBC[x][y][z]; }
+    bool IsSmoBC(const int x, const int y, const int z) const { return !SmoBC[x][y].empty() && SmoBC[x][y][z]; }
+  };
+  std::shared_ptr<ScenarioBC> Scen;
+
+  // Run-length spans [zBeg, zEnd) of active voxels along each (x,y) column
+  // Kernels sweep these spans instead of the full box so their cost scales with the fluid volume
+  std::vector<std::vector<std::vector<std::array<int, 2>>>> FluidSpans;               // Non-solid voxels
+  std::vector<std::vector<std::vector<std::array<int, 2>>>> IfacSpans;                // Solid voxels with at least one non-solid neighbor
+  std::vector<std::vector<std::vector<std::vector<std::array<int, 2>>>>> FreeSpans;  // Non-solid voxels without enforced value, per field ID
+  std::vector<std::vector<std::vector<std::vector<std::array<int, 2>>>>> FixedSpans; // Interface solid voxels and voxels with enforced value, per field ID
+  int nbFluidVox;
+  int nbIfacVox;
+
+  // Neighbor flags of each voxel, kept up to date with the spans, so the stencils apply the boundary rules without branching
+  // Bits 0-5 are set for non-solid neighbors and bits 8-13 for solid ones, in the order -X +X -Y +Y -Z +Z
+  // Neighbors outside the domain have no bit set, only the stored columns hold flags
+  std::vector<std::vector<std::vector<uint16_t>>> FaceFlags;
+
+  // Layout of the direct pressure solver, analyzed again after the spans change
+  bool isSpectralValid;                           // False when the spans changed since the layout was analyzed
+  bool isSpectralBox;                             // True when the free pressure voxels fit the direct solver
+  std::array<int, 6> spectralBox;                 // Solved box [xBeg, yBeg, zBeg, xEnd, yEnd, zEnd)
+  std::array<bool, 3> spectralDirichlet;          // Axes whose box faces border enforced pressure, transformed with DST-I instead of DCT-II
+  std::vector<std::array<int, 3>> SpectralExtra;  // Free pressure voxels outside the box, in the layers of the enforced pressure faces
+  std::vector<long long> SpectralExtraNbr;        // Index in the box of the face neighbor of each extra voxel, -1= none
+  std::vector<double> SpectralCapa;               // LU factors of the capacitance system solving the extra voxels
+  std::vector<int> SpectralPivot;                 // Row permutation of the LU factors
+
+  // Sparse column storage of the run fields
+  // When enabled, columns without fluid or interface voxel hold no data and their voxels read as zero
+  // The solid flags, face flags and optimization exclusions follow the same columns
+  bool sparseStore;
+  std::vector<std::vector<bool>> StoredCols;
+  std::vector<float> ZeroCol;  // Read in place of columns without storage
+
+  // Slab decomposition of the domain into subdomains swept by their own thread
+  int subDomAxis;                              // 0= slabs along X, 1= slabs along Y
+  std::vector<std::array<int, 2>> SubDomains;  // [beg, end) plane ranges of the slabs along the decomposition axis
+  std::vector<std::vector<float>> ColPartial;  // Per column partial results of the reductions
+
+  // Lattice Boltzmann engine
+  int lbmNbDir;                             // Number of discrete velocities of the lattice
+  float lbmTimeStep;                        // Lattice time step the distributions are expressed with
+  float lbmVelRef;                          // Reference velocity setting the number of lattice substeps
+  std::vector<std::array<int, 3>> LbmDir;  // Discrete velocities
+  std::vector<float> LbmWeight;             // Quadrature weights of the discrete velocities
+  std::vector<int> LbmOpp;                  // Index of the opposite discrete velocity
+  std::vector<float> LbmDist;               // Post collision distributions [dir][x][y][z]
+  std::vector<float> LbmDistNew;
+
+  // Display geometry
+  bool isWireBatchValid;                  // False when the solid or BC voxels changed since the wireframe was built
+  std::array<float, 4> wireBatchSlice;    // Slice parameters the wireframe was built with
+  Draw::VertexBatch WireBatch;            // Edges of the solid and BC voxels, rebuilt only on change
+  bool isCubeBatchValid;                  // False when the shown fields changed without a new time step
+  int cubeBatchStep;                      // Time step the colored voxels were built at
+  std::array<float, 7> cubeBatchParam;    // Color and slice parameters the colored voxels were built with
+  Draw::VertexBatch CubeBatch;            // Visible faces of the colored voxels, rebuilt only on change
+  std::vector<std::vector<std::vector<bool>>> CubeShown;   // Voxels colored in the last build of the batch, per column with a colored voxel
+  std::vector<std::vector<std::vector<float>>> CubeColor;  // Colors of the voxels in the last build of the batch, interleaved per column
+  Draw::VertexBatch TracerBatch;          // Tracer particles, rebuilt every frame
+
+  // Massless tracer particles for flow display, positions in voxel coordinates
+  std::vector<float> TracerPosX;
+  std::vector<float> TracerPosY;
+  std::vector<float> TracerPosZ;
+  std::vector<float> TracerSpeed;              // Velocity magnitude sampled in the last step
+  std::vector<float> TracerAge;                // Simulated time since the tracer was released
+  std::vector<std::array<int, 3>> TracerSeeds;  // Voxels the tracers are released from
+
+  // Time series export of the fields
+  std::shared_ptr<FileOutputQueue> VTIWriter;  // Background writer, shared by the copies of the solver state
+
+  // Compressed history of the run fields for scrubbing
+  static constexpr int timelineKeyPeriod= 8;
+  static constexpr int timelineQuantBits= 16;
+  std::shared_ptr<Timeline> History;           // Recorded frames, shared by the copies of the solver state
+  int historyFrame;                            // Recorded frame shown in place of the live fields, -1= live simulation
+  std::vector<std::vector<float>> LiveFrame;   // Live fields saved while scrubbing the history
 
   // Fields for scenario run
-  std::vector<std::vector<std::vector<float>>> Dum0;
-  std::vector<std::vector<std::vector<float>>> Dum1;
-  std::vector<std::vector<std::vector<float>>> Dum2;
-  std::vector<std::vector<std::vector<float>>> Dum3;
-  std::vector<std::vector<std::vector<float>>> Dum4;
-  std::vector<std::vector<std::vector<float>>> Vort;
-  std::vector<std::vector<std::vector<float>>> Vmag;
+  std::vector<std::vector<std::vector<diag_float>>> Dum0;
+  std::vector<std::vector<std::vector<diag_float>>> Dum1;
+  std::vector<std::vector<std::vector<diag_float>>> Dum2;
+  std::vector<std::vector<std::vector<diag_float>>> Dum3;
+  std::vector<std::vector<std::vector<diag_float>>> Dum4;
+  std::vector<std::vector<std::vector<diag_float>>> Vort;
+  std::vector<std::vector<std::vector<diag_float>>> Vmag;
   std::vector<std::vector<std::vector<float>>> Pres;
   std::vector<std::vector<std::vector<float>>> Dive;
   std::vector<std::vector<std::vector<float>>> Smok;
   std::vector<std::vector<std::vector<float>>> VelX;
   std::vector<std::vector<std::vector<float>>> VelY;
   std::vector<std::vector<std::vector<float>>> VelZ;
-  std::vector<std::vector<std::vector<float>>> CurX;
-  std::vector<std::vector<std::vector<float>>> CurY;
-  std::vector<std::vector<std::vector<float>>> CurZ;
-  std::vector<std::vector<std::vector<float>>> AdvX;
-  std::vector<std::vector<std::vector<float>>> AdvY;
-  std::vector<std::vector<std::vector<float>>> AdvZ;
+  std::vector<std::vector<std::vector<diag_float>>> CurX;
+  std::vector<std::vector<std::vector<diag_float>>> CurY;
+  std::vector<std::vector<std::vector<diag_float>>> CurZ;
+  std::vector<std::vector<std::vector<diag_float>>> AdvX;
+  std::vector<std::vector<std::vector<diag_float>>> AdvY;
+  std::vector<std::vector<std::vector<diag_float>>> AdvZ;
 
   // CFD solver functions
+  void AllocateFields();
+  void AllocateScenario();
   void SetUpUIData();
+  std::array<double, 4> CavityProfileErrors(const int iY, const int iZ);
+  void CavityBenchmark();
+  void ExportFields();
+  std::vector<std::vector<float>> PackRunFields();
+  void UnpackRunFields(const std::vector<std::vector<float>>& iFrame);
+  void RecordTimeline();
+  void ScrubTimeline();
   void InitializeScenario();
+  void BuildScenario();
+  void CoarseContinuation(const int iFactor);
   void ApplyBC(const int iFieldID, std::vector<std::vector<std::vector<float>>>& ioField);
+  void BuildSpans();
+  void UpdateSpans(const int x, const int y);
+  bool IsSolid(const int x, const int y, const int z) const;
+  std::array<const float*, 5> NeighborCols(const std::vector<std::vector<std::vector<float>>>& iField, const int x, const int y);
+  void SetSolidVoxel(const int x, const int y, const int z, const bool iSolid);
+  void BuildSubDomains();
+  template <typename BoxKernel>
+  void SweepSubDomains(BoxKernel&& iKernel);
+  float ReduceColPartial();
+  void GetTileSizes(int& oTileX, int& oTileY, int& oTileZ);
+  template <typename SpanKernel>
+  void SweepTiles(const std::vector<std::vector<std::vector<std::array<int, 2>>>>& iSpans, SpanKernel&& iKernel);
+  template <typename VoxelKernel>
+  void SweepColumn(const int zBeg, const int zEnd, VoxelKernel&& iKernel);
+  template <typename FieldKernel>
+  void DispatchFieldDim(const int iFieldID, FieldKernel&& iKernel);
+  static constexpr std::array<float, 3> SolidBCSigns(const int iFieldID);
+  template <int FieldIDT, bool ActiveX>
+  float StencilSum(const std::array<const float*, 5>& iCols, const uint16_t iFlags, const int z, const int zN, const int zP);
+  std::vector<std::vector<std::vector<std::vector<float>>>*> RunFields();
+  std::vector<std::vector<std::vector<std::vector<diag_float>>>*> DiagFields();
+  std::vector<std::vector<std::vector<float>>> AllocRunField(const float iVal);
+  std::vector<std::vector<std::vector<diag_float>>> AllocDiagField(const float iVal);
+  void StoreColumn(const int x, const int y);
+  void CompactRunFields();
+  void CompactScenario();
   void ImplicitFieldAdd(const std::vector<std::vector<std::vector<float>>>& iFieldA,
                         const std::vector<std::vector<std::vector<float>>>& iFieldB,
                         std::vector<std::vector<std::vector<float>>>& oField);
@@ -157,6 +347,12 @@ class CompuFluidDyna
                               const bool iDiffuMode, const float iDiffuCoeff,
                               const std::vector<std::vector<std::vector<float>>>& iField,
                               std::vector<std::vector<std::vector<float>>>& ioField);
+  void ImplicitVelLaplacianMatMult(const float iTimeStep, const float iDiffuCoeff, const std::array<bool, 3>& iActive,
+                                   const std::array<const std::vector<std::vector<std::vector<float>>>*, 3>& iFields,
+                                   const std::array<std::vector<std::vector<std::vector<float>>>*, 3>& oFields);
+  void BlockConjugateGradientSolve(const int iMaxIter, const float iTimeStep, const float iDiffuCoeff,
+                                   const std::array<const std::vector<std::vector<std::vector<float>>>*, 3>& iFields,
+                                   const std::array<std::vector<std::vector<std::vector<float>>>*, 3>& ioFields);
   void GradientDescentSolve(const int iFieldID, const int iMaxIter, const float iTimeStep,
                             const bool iDiffuMode, const float iDiffuCoeff,
                             const std::vector<std::vector<std::vector<float>>>& iField,
@@ -165,36 +361,57 @@ class CompuFluidDyna
                         const bool iDiffuMode, const float iDiffuCoeff,
                         const std::vector<std::vector<std::vector<float>>>& iField,
                         std::vector<std::vector<std::vector<float>>>& ioField);
+  void SpectralLayout();
+  void SpectralBoxSolve(std::vector<double>& ioBuf, const double iMeanGuess);
+  bool SpectralPoissonSolve(const std::vector<std::vector<std::vector<float>>>& iField,
+                            std::vector<std::vector<std::vector<float>>>& ioField);
   void ExternalForces();
+  void SteadyStateStore();
+  void SteadyStateRelaxation(const float iTimeStep);
   void ProjectField(const int iMaxIter, const float iTimeStep,
                     std::vector<std::vector<std::vector<float>>>& ioVelX,
                     std::vector<std::vector<std::vector<float>>>& ioVelY,
                     std::vector<std::vector<std::vector<float>>>& ioVelZ);
   float TrilinearInterpolation(const float iPosX, const float iPosY, const float iPosZ,
                                const std::vector<std::vector<std::vector<float>>>& iFieldRef);
-  void AdvectField(const int iFieldID, const float iTimeStep,
-                   const std::vector<std::vector<std::vector<float>>>& iVelX,
-                   const std::vector<std::vector<std::vector<float>>>& iVelY,
-                   const std::vector<std::vector<std::vector<float>>>& iVelZ,
-                   std::vector<std::vector<std::vector<float>>>& ioField);
+  void TrilinearInterpolationBatch(const int iNbPos, const float* iPosX, const float* iPosY, const float* iPosZ,
+                                   const int iNbField, const std::vector<std::vector<std::vector<float>>>* const* iFieldRef,
+                                   float* const* oVal);
+  void AdvectFields(const std::vector<int>& iFieldIDs, const float iTimeStep);
+  void InitTracers();
+  void SeedTracer(const int k);
+  void AdvectTracers(const float iTimeStep);
   void VorticityConfinement(const float iTimeStep, const float iVortiCoeff,
                             std::vector<std::vector<std::vector<float>>>& ioVelX,
                             std::vector<std::vector<std::vector<float>>>& ioVelY,
                             std::vector<std::vector<std::vector<float>>>& ioVelZ);
-  std::vector<std::tuple<int,int,int,float>> SortVoxels(const std::vector<std::vector<std::vector<float>>>& iField, 
+  void BuildSafeZone();
+  bool IsSafeZone(const int x, const int y, const int z) const;
+  std::vector<std::tuple<int,int,int,float>> SortVoxels(const std::vector<std::vector<std::vector<diag_float>>>& iField, 
                                                                       const bool iAvg,
                                                                       const bool iReverse,
-                                                                      const std::vector<std::tuple<int,int,int,float>> &coordsToAvoid = {});
+                                                                      const float iFracSorted);
+  void LatticeBoltzmannInit();
+  void LatticeBoltzmannStep(const float iTimeStep);
+  void UpdateDiagnostic(const int iDiagID);
+  void ComputeMaxVelocity();
   void ComputeVelocityDivergence();
   void ComputeVelocityCurlVorticity();
+  template <typename T>
+  void ComputeVelocityCurlVorticity(std::vector<std::vector<std::vector<T>>>& oCurX, std::vector<std::vector<std::vector<T>>>& oCurY,
+                                    std::vector<std::vector<std::vector<T>>>& oCurZ, std::vector<std::vector<std::vector<T>>>& oVort);
   void ComputeVelocityMagnitude();
   float ComputePressureDrop(const bool iMode);
+  int GetMFRSection(int& oPos);
   void ComputeMassFlowRates(bool iComputeAll);
   void ComputeKineticEnergy();
   void ComputeStrainRate();
+  void ComputeAdjointSensitivity();
   void ComputeVolumeOutOfSolid();
   void ComputeGeometrySurfaceArea();
-  void HeuristicOptimizationStep();
+  void HeuristicOptimizationStep(const int iFieldE, const float iFracErosion);
+  void EnsembleOptimizationStep();
+  void StepSimulation();
   
 
   public:
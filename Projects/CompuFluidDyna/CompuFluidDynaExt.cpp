@@ -4,8 +4,11 @@
 // Standard lib
 #include <cstdio>
 #include <cstring>
+#include <filesystem>
 #include <numbers>
 #include <tuple>
+#include <type_traits>
+#include <unordered_map>
 #include <algorithm>
 #include <cmath>
 
@@ -13,15 +16,62 @@
 #include "../../Libs/freeglut/include/GL/freeglut.h"
 
 // Sandbox lib
+#include "../../Util/FFT.hpp"
 #include "../../Util/Field.hpp"
 #include "../../Util/FileInput.hpp"
+#include "../../Util/FileOutput.hpp"
 #include "../../Util/Random.hpp"
+#include "../../Util/Timeline.hpp"
+#include "../../Util/Timer.hpp"
 #include "../../Util/Vec.hpp"
 
 // Project supplements
 #include "CompuFluidDynaParam.hpp"
 
 
+// Reference centerline velocity profiles of the lid driven cavity flow benchmark
+// Data from Ghia 1982 http://www.msaidi.ir/upload/Ghia1982.pdf
+static const std::vector<double> GhiaData0X({0.0000, +0.0625, +0.0703, +0.0781, +0.0938, +0.1563, +0.2266, +0.2344, +0.5000, +0.8047, +0.8594, +0.9063, +0.9453, +0.9531, +0.9609, +0.9688, +1.0000});  // coord on horiz slice
+static const std::vector<double> GhiaData1Y({0.0000, +0.0547, +0.0625, +0.0703, +0.1016, +0.1719, +0.2813, +0.4531, +0.5000, +0.6172, +0.7344, +0.8516, +0.9531, +0.9609, +0.9688, +0.9766, +1.0000});  // coord on verti slice
+// static const std::vector<double> GhiaData0Y({0.0000, +0.0923, +0.1009, +0.1089, +0.1232, +0.1608, +0.1751, +0.1753, +0.0545, -0.2453, -0.2245, -0.1691, -0.1031, -0.0886, -0.0739, -0.0591, +0.0000});  // Re 100   verti vel on horiz slice
+// static const std::vector<double> GhiaData1X({0.0000, -0.0372, -0.0419, -0.0478, -0.0643, -0.1015, -0.1566, -0.2109, -0.2058, -0.1364, +0.0033, +0.2315, +0.6872, +0.7372, +0.7887, +0.8412, +1.0000});  // Re 100   horiz vel on verti slice
+// static const std::vector<double> GhiaData0Y({0.0000, +0.1836, +0.1971, +0.2092, +0.2297, +0.2812, +0.3020, +0.3017, +0.0519, -0.3860, -0.4499, -0.2383, -0.2285, -0.1925, -0.1566, -0.1215, +0.0000});  // Re 400   verti vel on horiz slice
+// static const std::vector<double> GhiaData1X({0.0000, -0.0819, -0.0927, -0.1034, -0.1461, -0.2430, -0.3273, -0.1712, -0.1148, +0.0214, +0.1626, +0.2909, +0.5589, +0.6176, +0.6844, +0.7584, +1.0000});  // Re 400   horiz vel on verti slice
+static const std::vector<double> GhiaData0Y({0.0000, +0.2749, +0.2901, +0.3035, +0.3263, +0.3710, +0.3308, +0.3224, +0.0253, -0.3197, -0.4267, -0.5150, -0.3919, -0.3371, -0.2767, -0.2139, +0.0000});  // Re 1000  verti vel on horiz slice
+static const std::vector<double> GhiaData1X({0.0000, -0.1811, -0.2020, -0.2222, -0.2973, -0.3829, -0.2781, -0.1065, -0.0608, +0.0570, +0.1872, +0.3330, +0.4660, +0.5112, +0.5749, +0.6593, +1.0000});  // Re 1000  horiz vel on verti slice
+// static const std::vector<double> GhiaData0Y({0.0000, +0.3956, +0.4092, +0.4191, +0.4277, +0.3712, +0.2903, +0.2819, +0.0100, -0.3118, -0.3740, -0.4431, -0.5405, -0.5236, -0.4743, -0.3902, +0.0000});  // Re 3200  verti vel on horiz slice
+// static const std::vector<double> GhiaData1X({0.0000, -0.3241, -0.3534, -0.3783, -0.4193, -0.3432, -0.2443, -0.8664, -0.0427, +0.0716, +0.1979, +0.3468, +0.4610, +0.4655, +0.4830, +0.5324, +1.0000});  // Re 3200  horiz vel on verti slice
+// static const std::vector<double> GhiaData0Y({0.0000, +0.4245, +0.4333, +0.4365, +0.4295, +0.3537, +0.2807, +0.2728, +0.0095, -0.3002, -0.3621, -0.4144, -0.5288, -0.5541, -0.5507, -0.4977, +0.0000});  // Re 5000  verti vel on horiz slice
+// static const std::vector<double> GhiaData1X({0.0000, -0.4117, -0.4290, -0.4364, -0.4044, -0.3305, -0.2286, -0.0740, -0.0304, +0.0818, +0.2009, +0.3356, +0.4604, +0.4599, +0.4612, +0.4822, +1.0000});  // Re 5000  horiz vel on verti slice
+// static const std::vector<double> GhiaData0Y({0.0000, +0.4398, +0.4403, +0.4356, +0.4182, +0.3506, +0.2812, +0.2735, +0.0082, -0.3045, -0.3621, -0.4105, -0.4859, -0.5235, -0.5522, -0.5386, +0.0000});  // Re 7500  verti vel on horiz slice
+// static const std::vector<double> GhiaData1X({0.0000, -0.4315, -0.4359, -0.4303, -0.3832, -0.3239, -0.2318, -0.0750, -0.0380, +0.0834, +0.2059, +0.3423, +0.4717, +0.4732, +0.4705, +0.4724, +1.0000});  // Re 7500  horiz vel on verti slice
+// static const std::vector<double> GhiaData0Y({0.0000, +0.4398, +0.4373, +0.4312, +0.4149, +0.3507, +0.2800, +0.2722, +0.0083, -0.3072, -0.3674, -0.4150, -0.4586, -0.4910, -0.5299, -0.5430, +0.0000});  // Re 10000 verti vel on horiz slice
+// static const std::vector<double> GhiaData1X({0.0000, -0.4274, -0.4254, -0.4166, -0.3800, -0.3271, -0.2319, -0.0754, +0.0311, +0.0834, +0.2067, +0.3464, +0.4780, +0.4807, +0.4778, +0.4722, +1.0000});  // Re 10000 horiz vel on verti slice
+// Data from Erturk 2005 https://arxiv.org/pdf/physics/0505121.pdf
+static const std::vector<double> ErtuData0X({0.0000, +0.0150, +0.0300, +0.0450, +0.0600, +0.0750, +0.0900, +0.1050, +0.1200, +0.1350, +0.1500, +0.5000, +0.8500, +0.8650, +0.8800, +0.8950, +0.9100, +0.9250, +0.9400, +0.9550, +0.9700, +0.9850, +1.0000});  // coord on horiz slice
+static const std::vector<double> ErtuData1Y({0.0000, +0.0200, +0.0400, +0.0600, +0.0800, +0.1000, +0.1200, +0.1400, +0.1600, +0.1800, +0.2000, +0.5000, +0.9000, +0.9100, +0.9200, +0.9300, +0.9400, +0.9500, +0.9600, +0.9700, +0.9800, +0.9900, +1.0000});  // coord on verti slice
+static const std::vector<double> ErtuData0Y({0.0000, +0.1019, +0.1792, +0.2349, +0.2746, +0.3041, +0.3273, +0.3460, +0.3605, +0.3705, +0.3756, +0.0258, -0.4028, -0.4407, -0.4803, -0.5132, -0.5263, -0.5052, -0.4417, -0.3400, -0.2173, -0.0973, +0.0000});  // Re 1000  verti vel on horiz slice
+static const std::vector<double> ErtuData1X({0.0000, -0.0757, -0.1392, -0.1951, -0.2472, -0.2960, -0.3381, -0.3690, -0.3854, -0.3869, -0.3756, -0.0620, +0.3838, +0.3913, +0.3993, +0.4101, +0.4276, +0.4582, +0.5102, +0.5917, +0.7065, +0.8486, +1.0000});  // Re 1000  horiz vel on verti slice
+// static const std::vector<double> ErtuData0Y({0.0000, +0.1607, +0.2633, +0.3238, +0.3649, +0.3950, +0.4142, +0.4217, +0.4187, +0.4078, +0.3918, +0.0160, -0.3671, -0.3843, -0.4042, -0.4321, -0.4741, -0.5268, -0.5603, -0.5192, -0.3725, -0.1675, +0.0000});  // Re 2500  verti vel on horiz slice
+// static const std::vector<double> ErtuData1X({0.0000, -0.1517, -0.2547, -0.3372, -0.3979, -0.4250, -0.4200, -0.3965, -0.3688, -0.3439, -0.3228, -0.0403, +0.4141, +0.4256, +0.4353, +0.4424, +0.4470, +0.4506, +0.4607, +0.4971, +0.5924, +0.7704, +1.0000});  // Re 2500  horiz vel on verti slice
+// static const std::vector<double> ErtuData0Y({0.0000, +0.2160, +0.3263, +0.3868, +0.4258, +0.4426, +0.4403, +0.4260, +0.4070, +0.3878, +0.3699, +0.0117, -0.3624, -0.3806, -0.3982, -0.4147, -0.4318, -0.4595, -0.5139, -0.5700, -0.5019, -0.2441, +0.0000});  // Re 5000  verti vel on horiz slice
+// static const std::vector<double> ErtuData1X({0.0000, -0.2223, -0.3480, -0.4272, -0.4419, -0.4168, -0.3876, -0.3652, -0.3467, -0.3285, -0.3100, -0.0319, +0.4155, +0.4307, +0.4452, +0.4582, +0.4683, +0.4738, +0.4739, +0.4749, +0.5159, +0.6866, +1.0000});  // Re 5000  horiz vel on verti slice
+// static const std::vector<double> ErtuData0Y({0.0000, +0.2509, +0.3608, +0.4210, +0.4494, +0.4495, +0.4337, +0.4137, +0.3950, +0.3779, +0.3616, +0.0099, -0.3574, -0.3755, -0.3938, -0.4118, -0.4283, -0.4443, -0.4748, -0.5434, -0.5550, -0.2991, +0.0000});  // Re 7500  verti vel on horiz slice
+// static const std::vector<double> ErtuData1X({0.0000, -0.2633, -0.3980, -0.4491, -0.4284, -0.3978, -0.3766, -0.3587, -0.3406, -0.3222, -0.3038, -0.0287, +0.4123, +0.4275, +0.4431, +0.4585, +0.4723, +0.4824, +0.4860, +0.4817, +0.4907, +0.6300, +1.0000});  // Re 7500  horiz vel on verti slice
+// static const std::vector<double> ErtuData0Y({0.0000, +0.2756, +0.3844, +0.4409, +0.4566, +0.4449, +0.4247, +0.4056, +0.3885, +0.3722, +0.3562, +0.0088, -0.3538, -0.3715, -0.3895, -0.4078, -0.4256, -0.4411, -0.4592, -0.5124, -0.5712, -0.3419, +0.0000});  // Re 10000 verti vel on horiz slice
+// static const std::vector<double> ErtuData1X({0.0000, -0.2907, -0.4259, -0.4469, -0.4142, -0.3899, -0.3721, -0.3543, -0.3361, -0.3179, -0.2998, -0.0268, +0.4095, +0.4243, +0.4398, +0.4556, +0.4711, +0.4843, +0.4917, +0.4891, +0.4837, +0.5891, +1.0000});  // Re 10000 horiz vel on verti slice
+// static const std::vector<double> ErtuData0Y({0.0000, +0.2940, +0.4018, +0.4522, +0.4563, +0.4383, +0.4180, +0.4004, +0.3840, +0.3678, +0.3519, +0.0080, -0.3508, -0.3682, -0.3859, -0.4040, -0.4221, -0.4388, -0.4534, -0.4899, -0.5694, -0.3762, +0.0000});  // Re 12500 verti vel on horiz slice
+// static const std::vector<double> ErtuData1X({0.0000, -0.3113, -0.4407, -0.4380, -0.4054, -0.3859, -0.3685, -0.3506, -0.3326, -0.3146, -0.2967, -0.0256, +0.4070, +0.4216, +0.4366, +0.4523, +0.4684, +0.4833, +0.4937, +0.4941, +0.4833, +0.5587, +1.0000});  // Re 12500 horiz vel on verti slice
+// static const std::vector<double> ErtuData0Y({0.0000, +0.3083, +0.4152, +0.4580, +0.4529, +0.4323, +0.4132, +0.3964, +0.3801, +0.3641, +0.3483, +0.0074, -0.3481, -0.3654, -0.3828, -0.4005, -0.4186, -0.4361, -0.4505, -0.4754, -0.5593, -0.4041, +0.0000});  // Re 15000 verti vel on horiz slice
+// static const std::vector<double> ErtuData1X({0.0000, -0.3278, -0.4474, -0.4286, -0.4001, -0.3827, -0.3652, -0.3474, -0.3297, -0.3119, -0.2942, -0.0247, +0.4047, +0.4190, +0.4338, +0.4492, +0.4653, +0.4811, +0.4937, +0.4969, +0.4850, +0.5358, +1.0000});  // Re 15000 horiz vel on verti slice
+// static const std::vector<double> ErtuData0Y({0.0000, +0.3197, +0.4254, +0.4602, +0.4484, +0.4273, +0.4093, +0.3929, +0.3767, +0.3608, +0.3452, +0.0069, -0.3457, -0.3627, -0.3800, -0.3975, -0.4153, -0.4331, -0.4482, -0.4664, -0.5460, -0.4269, +0.0000});  // Re 17500 verti vel on horiz slice
+// static const std::vector<double> ErtuData1X({0.0000, -0.3412, -0.4490, -0.4206, -0.3965, -0.3797, -0.3622, -0.3446, -0.3271, -0.3096, -0.2920, -0.0240, +0.4024, +0.4166, +0.4312, +0.4463, +0.4622, +0.4784, +0.4925, +0.4982, +0.4871, +0.5183, +1.0000});  // Re 17500 horiz vel on verti slice
+// static const std::vector<double> ErtuData0Y({0.0000, +0.3290, +0.4332, +0.4601, +0.4438, +0.4232, +0.4060, +0.3897, +0.3736, +0.3579, +0.3423, +0.0065, -0.3434, -0.3603, -0.3774, -0.3946, -0.4122, -0.4300, -0.4459, -0.4605, -0.5321, -0.4457, +0.0000});  // Re 20000 verti vel on horiz slice
+// static const std::vector<double> ErtuData1X({0.0000, -0.3523, -0.4475, -0.4143, -0.3936, -0.3769, -0.3595, -0.3422, -0.3248, -0.3074, -0.2899, -0.0234, +0.4001, +0.4142, +0.4287, +0.4436, +0.4592, +0.4754, +0.4906, +0.4985, +0.4889, +0.5048, +1.0000});  // Re 20000 horiz vel on verti slice
+// static const std::vector<double> ErtuData0Y({0.0000, +0.3323, +0.4357, +0.4596, +0.4420, +0.4218, +0.4048, +0.3885, +0.3725, +0.3567, +0.3413, +0.0063, -0.3425, -0.3593, -0.3764, -0.3936, -0.4110, -0.4287, -0.4449, -0.4588, -0.5266, -0.4522, +0.0000});  // Re 21000 verti vel on horiz slice
+// static const std::vector<double> ErtuData1X({0.0000, -0.3562, -0.4463, -0.4121, -0.3925, -0.3758, -0.3585, -0.3412, -0.3239, -0.3066, -0.2892, -0.0232, +0.3992, +0.4132, +0.4277, +0.4425, +0.4580, +0.4742, +0.4897, +0.4983, +0.4895, +0.5003, +1.0000});  // Re 21000 horiz vel on verti slice
+
+
 void CompuFluidDyna::SetUpUIData() {
   // Draw the scatter data
   const int yCursor= std::min(std::max((int)std::round((float)(nY - 1) * D.UI[SlicePlotY__].GetF()), 0), nY - 1);
@@ -36,11 +86,12 @@ void CompuFluidDyna::SetUpUIData() {
     D.scatData[k].clear();
   if (nZ > 1) {
     for (int y= 0; y < nY; y++) {
+      if (!StoredCols[nX / 2][y]) continue;
       D.scatData[0].push_back(std::array<double, 2>({(double)y / (double)(nY - 1), VelZ[nX / 2][y][zCursor]}));
       D.scatData[2].push_back(std::array<double, 2>({(double)y / (double)(nY - 1), Pres[nX / 2][y][zCursor]}));
     }
   }
-  if (nY > 1) {
+  if (nY > 1 && StoredCols[nX / 2][yCursor]) {
     for (int z= 0; z < nZ; z++) {
       D.scatData[1].push_back(std::array<double, 2>({VelY[nX / 2][yCursor][z], (double)z / (double)(nZ - 1)}));
       D.scatData[3].push_back(std::array<double, 2>({Pres[nX / 2][yCursor][z], (double)z / (double)(nZ - 1)}));
@@ -63,47 +114,6 @@ void CompuFluidDyna::SetUpUIData() {
     D.scatData[5].clear();
     D.scatData[6].clear();
     D.scatData[7].clear();
-    // TODO add vorticity data from https://www.acenumerics.com/the-benchmarks.html
-    // Data from Ghia 1982 http://www.msaidi.ir/upload/Ghia1982.pdf
-    const std::vector<double> GhiaData0X({0.0000, +0.0625, +0.0703, +0.0781, +0.0938, +0.1563, +0.2266, +0.2344, +0.5000, +0.8047, +0.8594, +0.9063, +0.9453, +0.9531, +0.9609, +0.9688, +1.0000});  // coord on horiz slice
-    const std::vector<double> GhiaData1Y({0.0000, +0.0547, +0.0625, +0.0703, +0.1016, +0.1719, +0.2813, +0.4531, +0.5000, +0.6172, +0.7344, +0.8516, +0.9531, +0.9609, +0.9688, +0.9766, +1.0000});  // coord on verti slice
-    // const std::vector<double> GhiaData0Y({0.0000, +0.0923, +0.1009, +0.1089, +0.1232, +0.1608, +0.1751, +0.1753, +0.0545, -0.2453, -0.2245, -0.1691, -0.1031, -0.0886, -0.0739, -0.0591, +0.0000});  // Re 100   verti vel on horiz slice
-    // const std::vector<double> GhiaData1X({0.0000, -0.0372, -0.0419, -0.0478, -0.0643, -0.1015, -0.1566, -0.2109, -0.2058, -0.1364, +0.0033, +0.2315, +0.6872, +0.7372, +0.7887, +0.8412, +1.0000});  // Re 100   horiz vel on verti slice
-    // const std::vector<double> GhiaData0Y({0.0000, +0.1836, +0.1971, +0.2092, +0.2297, +0.2812, +0.3020, +0.3017, +0.0519, -0.3860, -0.4499, -0.2383, -0.2285, -0.1925, -0.1566, -0.1215, +0.0000});  // Re 400   verti vel on horiz slice
-    // const std::vector<double> GhiaData1X({0.0000, -0.0819, -0.0927, -0.1034, -0.1461, -0.2430, -0.3273, -0.1712, -0.1148, +0.0214, +0.1626, +0.2909, +0.5589, +0.6176, +0.6844, +0.7584, +1.0000});  // Re 400   horiz vel on verti slice
-    const std::vector<double> GhiaData0Y({0.0000, +0.2749, +0.2901, +0.3035, +0.3263, +0.3710, +0.3308, +0.3224, +0.0253, -0.3197, -0.4267, -0.5150, -0.3919, -0.3371, -0.2767, -0.2139, +0.0000});  // Re 1000  verti vel on horiz slice
-    const std::vector<double> GhiaData1X({0.0000, -0.1811, -0.2020, -0.2222, -0.2973, -0.3829, -0.2781, -0.1065, -0.0608, +0.0570, +0.1872, +0.3330, +0.4660, +0.5112, +0.5749, +0.6593, +1.0000});  // Re 1000  horiz vel on verti slice
-    // const std::vector<double> GhiaData0Y({0.0000, +0.3956, +0.4092, +0.4191, +0.4277, +0.3712, +0.2903, +0.2819, +0.0100, -0.3118, -0.3740, -0.4431, -0.5405, -0.5236, -0.4743, -0.3902, +0.0000});  // Re 3200  verti vel on horiz slice
-    // const std::vector<double> GhiaData1X({0.0000, -0.3241, -0.3534, -0.3783, -0.4193, -0.3432, -0.2443, -0.8664, -0.0427, +0.0716, +0.1979, +0.3468, +0.4610, +0.4655, +0.4830, +0.5324, +1.0000});  // Re 3200  horiz vel on verti slice
-    // const std::vector<double> GhiaData0Y({0.0000, +0.4245, +0.4333, +0.4365, +0.4295, +0.3537, +0.2807, +0.2728, +0.0095, -0.3002, -0.3621, -0.4144, -0.5288, -0.5541, -0.5507, -0.4977, +0.0000});  // Re 5000  verti vel on horiz slice
-    // const std::vector<double> GhiaData1X({0.0000, -0.4117, -0.4290, -0.4364, -0.4044, -0.3305, -0.2286, -0.0740, -0.0304, +0.0818, +0.2009, +0.3356, +0.4604, +0.4599, +0.4612, +0.4822, +1.0000});  // Re 5000  horiz vel on verti slice
-    // const std::vector<double> GhiaData0Y({0.0000, +0.4398, +0.4403, +0.4356, +0.4182, +0.3506, +0.2812, +0.2735, +0.0082, -0.3045, -0.3621, -0.4105, -0.4859, -0.5235, -0.5522, -0.5386, +0.0000});  // Re 7500  verti vel on horiz slice
-    // const std::vector<double> GhiaData1X({0.0000, -0.4315, -0.4359, -0.4303, -0.3832, -0.3239, -0.2318, -0.0750, -0.0380, +0.0834, +0.2059, +0.3423, +0.4717, +0.4732, +0.4705, +0.4724, +1.0000});  // Re 7500  horiz vel on verti slice
-    // const std::vector<double> GhiaData0Y({0.0000, +0.4398, +0.4373, +0.4312, +0.4149, +0.3507, +0.2800, +0.2722, +0.0083, -0.3072, -0.3674, -0.4150, -0.4586, -0.4910, -0.5299, -0.5430, +0.0000});  // Re 10000 verti vel on horiz slice
-    // const std::vector<double> GhiaData1X({0.0000, -0.4274, -0.4254, -0.4166, -0.3800, -0.3271, -0.2319, -0.0754, +0.0311, +0.0834, +0.2067, +0.3464, +0.4780, +0.4807, +0.4778, +0.4722, +1.0000});  // Re 10000 horiz vel on verti slice
-    // Data from Erturk 2005 https://arxiv.org/pdf/physics/0505121.pdf
-    const std::vector<double> ErtuData0X({0.0000, +0.0150, +0.0300, +0.0450, +0.0600, +0.0750, +0.0900, +0.1050, +0.1200, +0.1350, +0.1500, +0.5000, +0.8500, +0.8650, +0.8800, +0.8950, +0.9100, +0.9250, +0.9400, +0.9550, +0.9700, +0.9850, +1.0000});  // coord on horiz slice
-    const std::vector<double> ErtuData1Y({0.0000, +0.0200, +0.0400, +0.0600, +0.0800, +0.1000, +0.1200, +0.1400, +0.1600, +0.1800, +0.2000, +0.5000, +0.9000, +0.9100, +0.9200, +0.9300, +0.9400, +0.9500, +0.9600, +0.9700, +0.9800, +0.9900, +1.0000});  // coord on verti slice
-    const std::vector<double> ErtuData0Y({0.0000, +0.1019, +0.1792, +0.2349, +0.2746, +0.3041, +0.3273, +0.3460, +0.3605, +0.3705, +0.3756, +0.0258, -0.4028, -0.4407, -0.4803, -0.5132, -0.5263, -0.5052, -0.4417, -0.3400, -0.2173, -0.0973, +0.0000});  // Re 1000  verti vel on horiz slice
-    const std::vector<double> ErtuData1X({0.0000, -0.0757, -0.1392, -0.1951, -0.2472, -0.2960, -0.3381, -0.3690, -0.3854, -0.3869, -0.3756, -0.0620, +0.3838, +0.3913, +0.3993, +0.4101, +0.4276, +0.4582, +0.5102, +0.5917, +0.7065, +0.8486, +1.0000});  // Re 1000  horiz vel on verti slice
-    // const std::vector<double> ErtuData0Y({0.0000, +0.1607, +0.2633, +0.3238, +0.3649, +0.3950, +0.4142, +0.4217, +0.4187, +0.4078, +0.3918, +0.0160, -0.3671, -0.3843, -0.4042, -0.4321, -0.4741, -0.5268, -0.5603, -0.5192, -0.3725, -0.1675, +0.0000});  // Re 2500  verti vel on horiz slice
-    // const std::vector<double> ErtuData1X({0.0000, -0.1517, -0.2547, -0.3372, -0.3979, -0.4250, -0.4200, -0.3965, -0.3688, -0.3439, -0.3228, -0.0403, +0.4141, +0.4256, +0.4353, +0.4424, +0.4470, +0.4506, +0.4607, +0.4971, +0.5924, +0.7704, +1.0000});  // Re 2500  horiz vel on verti slice
-    // const std::vector<double> ErtuData0Y({0.0000, +0.2160, +0.3263, +0.3868, +0.4258, +0.4426, +0.4403, +0.4260, +0.4070, +0.3878, +0.3699, +0.0117, -0.3624, -0.3806, -0.3982, -0.4147, -0.4318, -0.4595, -0.5139, -0.5700, -0.5019, -0.2441, +0.0000});  // Re 5000  verti vel on horiz slice
-    // const std::vector<double> ErtuData1X({0.0000, -0.2223, -0.3480, -0.4272, -0.4419, -0.4168, -0.3876, -0.3652, -0.3467, -0.3285, -0.3100, -0.0319, +0.4155, +0.4307, +0.4452, +0.4582, +0.4683, +0.4738, +0.4739, +0.4749, +0.5159, +0.6866, +1.0000});  // Re 5000  horiz vel on verti slice
-    // const std::vector<double> ErtuData0Y({0.0000, +0.2509, +0.3608, +0.4210, +0.4494, +0.4495, +0.4337, +0.4137, +0.3950, +0.3779, +0.3616, +0.0099, -0.3574, -0.3755, -0.3938, -0.4118, -0.4283, -0.4443, -0.4748, -0.5434, -0.5550, -0.2991, +0.0000});  // Re 7500  verti vel on horiz slice
-    // const std::vector<double> ErtuData1X({0.0000, -0.2633, -0.3980, -0.4491, -0.4284, -0.3978, -0.3766, -0.3587, -0.3406, -0.3222, -0.3038, -0.0287, +0.4123, +0.4275, +0.4431, +0.4585, +0.4723, +0.4824, +0.4860, +0.4817, +0.4907, +0.6300, +1.0000});  // Re 7500  horiz vel on verti slice
-    // const std::vector<double> ErtuData0Y({0.0000, +0.2756, +0.3844, +0.4409, +0.4566, +0.4449, +0.4247, +0.4056, +0.3885, +0.3722, +0.3562, +0.0088, -0.3538, -0.3715, -0.3895, -0.4078, -0.4256, -0.4411, -0.4592, -0.5124, -0.5712, -0.3419, +0.0000});  // Re 10000 verti vel on horiz slice
-    // const std::vector<double> ErtuData1X({0.0000, -0.2907, -0.4259, -0.4469, -0.4142, -0.3899, -0.3721, -0.3543, -0.3361, -0.3179, -0.2998, -0.0268, +0.4095, +0.4243, +0.4398, +0.4556, +0.4711, +0.4843, +0.4917, +0.4891, +0.4837, +0.5891, +1.0000});  // Re 10000 horiz vel on verti slice
-    // const std::vector<double> ErtuData0Y({0.0000, +0.2940, +0.4018, +0.4522, +0.4563, +0.4383, +0.4180, +0.4004, +0.3840, +0.3678, +0.3519, +0.0080, -0.3508, -0.3682, -0.3859, -0.4040, -0.4221, -0.4388, -0.4534, -0.4899, -0.5694, -0.3762, +0.0000});  // Re 12500 verti vel on horiz slice
-    // const std::vector<double> ErtuData1X({0.0000, -0.3113, -0.4407, -0.4380, -0.4054, -0.3859, -0.3685, -0.3506, -0.3326, -0.3146, -0.2967, -0.0256, +0.4070, +0.4216, +0.4366, +0.4523, +0.4684, +0.4833, +0.4937, +0.4941, +0.4833, +0.5587, +1.0000});  // Re 12500 horiz vel on verti slice
-    // const std::vector<double> ErtuData0Y({0.0000, +0.3083, +0.4152, +0.4580, +0.4529, +0.4323, +0.4132, +0.3964, +0.3801, +0.3641, +0.3483, +0.0074, -0.3481, -0.3654, -0.3828, -0.4005, -0.4186, -0.4361, -0.4505, -0.4754, -0.5593, -0.4041, +0.0000});  // Re 15000 verti vel on horiz slice
-    // const std::vector<double> ErtuData1X({0.0000, -0.3278, -0.4474, -0.4286, -0.4001, -0.3827, -0.3652, -0.3474, -0.3297, -0.3119, -0.2942, -0.0247, +0.4047, +0.4190, +0.4338, +0.4492, +0.4653, +0.4811, +0.4937, +0.4969, +0.4850, +0.5358, +1.0000});  // Re 15000 horiz vel on verti slice
-    // const std::vector<double> ErtuData0Y({0.0000, +0.3197, +0.4254, +0.4602, +0.4484, +0.4273, +0.4093, +0.3929, +0.3767, +0.3608, +0.3452, +0.0069, -0.3457, -0.3627, -0.3800, -0.3975, -0.4153, -0.4331, -0.4482, -0.4664, -0.5460, -0.4269, +0.0000});  // Re 17500 verti vel on horiz slice
-    // const std::vector<double> ErtuData1X({0.0000, -0.3412, -0.4490, -0.4206, -0.3965, -0.3797, -0.3622, -0.3446, -0.3271, -0.3096, -0.2920, -0.0240, +0.4024, +0.4166, +0.4312, +0.4463, +0.4622, +0.4784, +0.4925, +0.4982, +0.4871, +0.5183, +1.0000});  // Re 17500 horiz vel on verti slice
-    // const std::vector<double> ErtuData0Y({0.0000, +0.3290, +0.4332, +0.4601, +0.4438, +0.4232, +0.4060, +0.3897, +0.3736, +0.3579, +0.3423, +0.0065, -0.3434, -0.3603, -0.3774, -0.3946, -0.4122, -0.4300, -0.4459, -0.4605, -0.5321, -0.4457, +0.0000});  // Re 20000 verti vel on horiz slice
-    // const std::vector<double> ErtuData1X({0.0000, -0.3523, -0.4475, -0.4143, -0.3936, -0.3769, -0.3595, -0.3422, -0.3248, -0.3074, -0.2899, -0.0234, +0.4001, +0.4142, +0.4287, +0.4436, +0.4592, +0.4754, +0.4906, +0.4985, +0.4889, +0.5048, +1.0000});  // Re 20000 horiz vel on verti slice
-    // const std::vector<double> ErtuData0Y({0.0000, +0.3323, +0.4357, +0.4596, +0.4420, +0.4218, +0.4048, +0.3885, +0.3725, +0.3567, +0.3413, +0.0063, -0.3425, -0.3593, -0.3764, -0.3936, -0.4110, -0.4287, -0.4449, -0.4588, -0.5266, -0.4522, +0.0000});  // Re 21000 verti vel on horiz slice
-    // const std::vector<double> ErtuData1X({0.0000, -0.3562, -0.4463, -0.4121, -0.3925, -0.3758, -0.3585, -0.3412, -0.3239, -0.3066, -0.2892, -0.0232, +0.3992, +0.4132, +0.4277, +0.4425, +0.4580, +0.4742, +0.4897, +0.4983, +0.4895, +0.5003, +1.0000});  // Re 21000 horiz vel on verti slice
     // Add hard coded experimental values in the scatter plot
     for (int k= 0; k < (int)GhiaData0X.size(); k++) {
       D.scatData[4].push_back(std::array<double, 2>({GhiaData0X[k], GhiaData0Y[k]}));
@@ -113,6 +123,11 @@ void CompuFluidDyna::SetUpUIData() {
       D.scatData[6].push_back(std::array<double, 2>({ErtuData0X[k], ErtuData0Y[k]}));
       D.scatData[7].push_back(std::array<double, 2>({ErtuData1X[k], ErtuData1Y[k]}));
     }
+    // Benchmark the simulated centerline profiles against the Ghia data normalized by the lid velocity
+    if (D.UI[Verbose_____].GetB() && !D.scatData[0].empty() && !D.scatData[1].empty()) {
+      const std::array<double, 4> errProf= CavityProfileErrors(yCursor, zCursor);
+      printf("Ghia Re1k RMS error  VZ %.4f  VY %.4f\n", errProf[0], errProf[1]);
+    }
   }
 
   // Add hard coded analytical values for Poiseuille flow benchmark
@@ -181,10 +196,303 @@ void CompuFluidDyna::SetUpUIData() {
         D.plotData[0 + i][D.plotData[0 + i].size() - 1] = MFR[i];
       }
     }
+    // Residual history of the steady state mode
+    if (!SteadyResVel.empty()) {
+      D.plotLegend.push_back("Steady ResV");
+      D.plotLegend.push_back("Steady ResD");
+      D.plotData.push_back(std::vector<double>(SteadyResVel.begin(), SteadyResVel.end()));
+      D.plotData.push_back(std::vector<double>(SteadyResDiv.begin(), SteadyResDiv.end()));
+    }
+  }
+}
+
+
+// RMS errors of the lid driven cavity centerline velocity profiles normalized by the lid velocity
+// - Horizontal VelZ profile at height iZ and vertical VelY profile at abscissa iY in the middle X plane
+// - Returns the errors of both profiles against the Ghia data, then against the Erturk data
+std::array<double, 4> CompuFluidDyna::CavityProfileErrors(const int iY, const int iZ) {
+  // Sample the simulated profiles as sorted pairs of normalized coordinate and velocity
+  std::vector<std::array<double, 2>> profVZ, profVY;
+  if (nY > 1) {
+    for (int y= 0; y < nY; y++)
+      if (StoredCols[nX / 2][y]) profVZ.push_back(std::array<double, 2>({(double)y / (double)(nY - 1), VelZ[nX / 2][y][iZ]}));
+  }
+  if (nZ > 1 && StoredCols[nX / 2][iY]) {
+    for (int z= 0; z < nZ; z++)
+      profVY.push_back(std::array<double, 2>({(double)z / (double)(nZ - 1), VelY[nX / 2][iY][z]}));
+  }
+  if (profVZ.empty() || profVY.empty()) return std::array<double, 4>({INFINITY, INFINITY, INFINITY, INFINITY});
+
+  // Linear interpolation of the simulated profile at the reference coordinates
+  const double velLid= (std::abs(D.UI[BCVelY______].GetF()) > 0.0f) ? std::abs(D.UI[BCVelY______].GetF()) : 1.0;
+  const auto Interp= [](const std::vector<std::array<double, 2>>& iProfile, const double iCoord) {
+    if (iCoord <= iProfile.front()[0]) return iProfile.front()[1];
+    for (int k= 1; k < (int)iProfile.size(); k++) {
+      if (iCoord <= iProfile[k][0]) {
+        const double t= (iCoord - iProfile[k - 1][0]) / (iProfile[k][0] - iProfile[k - 1][0]);
+        return (1.0 - t) * iProfile[k - 1][1] + t * iProfile[k][1];
+      }
+    }
+    return iProfile.back()[1];
+  };
+  const auto ErrorRMS= [&](const std::vector<std::array<double, 2>>& iProfile, const std::vector<double>& iRefCoord, const std::vector<double>& iRefVal) {
+    double err= 0.0;
+    for (int k= 0; k < (int)iRefCoord.size(); k++)
+      err+= std::pow(Interp(iProfile, iRefCoord[k]) / velLid - iRefVal[k], 2.0);
+    return std::sqrt(err / (double)iRefCoord.size());
+  };
+  return std::array<double, 4>({ErrorRMS(profVZ, GhiaData0X, GhiaData0Y), ErrorRMS(profVY, GhiaData1Y, GhiaData1X),
+                                ErrorRMS(profVZ, ErtuData0X, ErtuData0Y), ErrorRMS(profVY, ErtuData1Y, ErtuData1X)});
+}
+
+
+// Time-to-accuracy benchmark of the lid driven cavity flow against the Ghia and Erturk reference profiles
+// - Each combination of grid coarsening, linear solver and time step fraction runs from rest in a copy of the project
+// - Coarser grids scale the voxel size to keep the cavity size, and thus the Reynolds number
+// - The centerline profile errors are measured every BenchCheck__ steps and their cost is excluded from the wall time
+// - Reports the step count, simulated time and wall time at which the worst profile error drops below BenchErrTol_
+void CompuFluidDyna::CavityBenchmark() {
+  const int maxStep= std::max(D.UI[BenchSteps__].GetI(), 0);
+  const int checkPeriod= std::max(D.UI[BenchCheck__].GetI(), 1);
+  const double errTol= D.UI[BenchErrTol_].GetD();
+  const bool lbmEngine= (D.UI[SolvEngine__].GetI() == 1);
+  const double solvTypeUI= D.UI[SolvType____].GetD();
+  const double timeStepUI= D.UI[TimeStep____].GetD();
+
+  // The lattice Boltzmann engine has no linear solve so only the time steps are compared
+  const std::vector<int> coarseFactors({4, 2, 1});
+  const std::vector<int> solvTypes= lbmEngine ? std::vector<int>({D.UI[SolvType____].GetI()}) : std::vector<int>({0, 1, 2, 3});
+  const std::vector<double> timeStepFracs({1.0, 0.5});
+
+  printf("Cavity benchmark  target error %.4f  max steps %d  check period %d\n", errTol, maxStep, checkPeriod);
+  for (const int factor : coarseFactors) {
+    if (factor > 1 && (nY / factor < 8 || nZ / factor < 8)) continue;
+    for (const int solvType : solvTypes) {
+      for (const double timeStepFrac : timeStepFracs) {
+        // The stepping reads the solver type and time step from the UI
+        D.UI[SolvType____].Set(solvType);
+        D.UI[TimeStep____].Set(timeStepUI * timeStepFrac);
+
+        // Set up the configuration as Refresh does
+        CompuFluidDyna bench= *this;
+        bench.nX= (nX + factor - 1) / factor;
+        bench.nY= (nY + factor - 1) / factor;
+        bench.nZ= (nZ + factor - 1) / factor;
+        bench.voxSize= voxSize * (float)factor;
+        bench.AllocateFields();
+        bench.simTime= 0.0f;
+        bench.simStep= 0;
+        bench.simTimeStep= D.UI[TimeStep____].GetF();
+        bench.maxVelMag= 0.0f;
+        bench.SteadyResVel.clear();
+        bench.SteadyResDiv.clear();
+        bench.diagStep.fill(-1);
+        bench.BuildScenario();
+        bench.ComputeMaxVelocity();
+        bench.LbmDist.clear();
+        bench.LbmDistNew.clear();
+        if (lbmEngine) bench.LatticeBoltzmannInit();
+
+        // Step until the worst centerline profile error reaches the target
+        const int yCenter= (int)std::round(0.5f * (float)(bench.nY - 1));
+        const int zCenter= (int)std::round(0.5f * (float)(bench.nZ - 1));
+        std::array<double, 4> errProf= bench.CavityProfileErrors(yCenter, zCenter);
+        double wallTime= 0.0;
+        bool reached= false;
+        while (bench.simStep < maxStep && !reached) {
+          Timer::PushTimer();
+          for (int k= 0; k < checkPeriod && bench.simStep < maxStep; k++)
+            bench.StepSimulation();
+          wallTime+= Timer::PopTimer();
+          errProf= bench.CavityProfileErrors(yCenter, zCenter);
+          reached= (*std::max_element(errProf.begin(), errProf.end()) < errTol);
+        }
+        printf("Cavity benchmark  res %dx%dx%d  solver %d  timestep %f  steps %d  simTime %f  wall %f s  Ghia VZ %.4f VY %.4f  Ertu VZ %.4f VY %.4f  %s\n",
+               bench.nX, bench.nY, bench.nZ, solvType, D.UI[TimeStep____].GetF(), bench.simStep, bench.simTime, wallTime,
+               errProf[0], errProf[1], errProf[2], errProf[3], reached ? "reached" : "not reached");
+      }
+    }
+  }
+
+  // Restore the UI values driving the live simulation
+  D.UI[SolvType____].Set(solvTypeUI);
+  D.UI[TimeStep____].Set(timeStepUI);
+}
+
+
+// Pack the selected fields in a pooled buffer and hand it over to the background VTI writer
+// The packing copy is the only cost on the solver thread, the file is written while the simulation goes on
+void CompuFluidDyna::ExportFields() {
+  if (!VTIWriter) {
+    std::error_code errCode;
+    std::filesystem::create_directories("FileOutput", errCode);
+    VTIWriter= std::make_shared<FileOutputQueue>(vtiNbBuffers);
+  }
+  FileOutputQueue::Frame* frame= VTIWriter->AcquireFrame();
+  if (frame == nullptr) {
+    if (D.UI[Verbose_____].GetB()) printf("[WARNING] VTI export of step %d skipped, all the writer buffers are in use\n", simStep);
+    return;
+  }
+
+  // Select the fields from the bit mask
+  const int fieldMask= D.UI[ExportField_].GetI();
+  char fullpath[64];
+  std::snprintf(fullpath, sizeof(fullpath), "FileOutput/CFD_%06d.vti", simStep);
+  frame->fullpath= fullpath;
+  frame->nbX= nX;
+  frame->nbY= nY;
+  frame->nbZ= nZ;
+  frame->bboxMin= {D.boxMin[0], D.boxMin[1], D.boxMin[2]};
+  frame->bboxMax= {D.boxMax[0], D.boxMax[1], D.boxMax[2]};
+  frame->names.clear();
+  frame->nbComp.clear();
+  if (fieldMask & 1) { frame->names.push_back("Smok"); frame->nbComp.push_back(1); }
+  if (fieldMask & 2) { frame->names.push_back("Pres"); frame->nbComp.push_back(1); }
+  if (fieldMask & 4) { frame->names.push_back("Vel"); frame->nbComp.push_back(3); }
+  if (fieldMask & 8) { frame->names.push_back("Dive"); frame->nbComp.push_back(1); }
+  if (fieldMask & 16) { frame->names.push_back("Vort"); frame->nbComp.push_back(1); }
+  if (fieldMask & 32) { frame->names.push_back("Solid"); frame->nbComp.push_back(1); }
+  frame->fillVal.assign(frame->names.size(), 0.0f);
+  if (fieldMask & 32) frame->fillVal.back()= 1.0f;
+
+  // Rank the stored columns, the writer fills the others with the values of the solid voxels
+  frame->colIndex.resize((size_t)nX * nY);
+  int64_t nbCols= 0;
+  for (int x= 0; x < nX; x++)
+    for (int y= 0; y < nY; y++)
+      frame->colIndex[(size_t)x * nY + y]= StoredCols[x][y] ? nbCols++ : -1;
+  frame->data.resize(frame->names.size());
+  for (int k= 0; k < (int)frame->names.size(); k++)
+    frame->data[k].resize((size_t)nbCols * nZ * frame->nbComp[k]);
+
+  if (fieldMask & 8) UpdateDiagnostic(DiagID::DiagDive);
+  if (fieldMask & 16) UpdateDiagnostic(DiagID::DiagVort);
+
+  // Copy the stored columns one after the other
+#pragma omp parallel for collapse(2)
+  for (int x= 0; x < nX; x++) {
+    for (int y= 0; y < nY; y++) {
+      const int64_t col= frame->colIndex[(size_t)x * nY + y];
+      if (col < 0) continue;
+      for (int z= 0; z < nZ; z++) {
+        const size_t idx= (size_t)col * nZ + z;
+        int k= 0;
+        if (fieldMask & 1) frame->data[k++][idx]= Smok[x][y][z];
+        if (fieldMask & 2) frame->data[k++][idx]= Pres[x][y][z];
+        if (fieldMask & 4) {
+          frame->data[k][3 * idx + 0]= VelX[x][y][z];
+          frame->data[k][3 * idx + 1]= VelY[x][y][z];
+          frame->data[k][3 * idx + 2]= VelZ[x][y][z];
+          k++;
+        }
+        if (fieldMask & 8) frame->data[k++][idx]= Dive[x][y][z];
+        if (fieldMask & 16) frame->data[k++][idx]= (float)Vort[x][y][z];
+        if (fieldMask & 32) frame->data[k++][idx]= Solid[x][y][z] ? 1.0f : 0.0f;
+      }
+    }
+  }
+  VTIWriter->SubmitFrame(frame);
+}
+
+
+// Flatten the run fields recorded in the history
+// The first array is the mask of the stored columns, the others hold the stored columns of each field one after the other
+std::vector<std::vector<float>> CompuFluidDyna::PackRunFields() {
+  const std::array<const std::vector<std::vector<std::vector<float>>>*, 5> fields({&Smok, &Pres, &VelX, &VelY, &VelZ});
+  std::vector<std::vector<float>> frame(fields.size() + 1);
+  frame[0].resize((size_t)nX * nY);
+  size_t nbCols= 0;
+  for (int x= 0; x < nX; x++) {
+    for (int y= 0; y < nY; y++) {
+      frame[0][(size_t)x * nY + y]= StoredCols[x][y] ? 1.0f : 0.0f;
+      if (StoredCols[x][y]) nbCols++;
+    }
+  }
+  for (int k= 0; k < (int)fields.size(); k++) {
+    frame[k + 1].reserve(nbCols * nZ);
+    for (int x= 0; x < nX; x++)
+      for (int y= 0; y < nY; y++)
+        if (StoredCols[x][y])
+          frame[k + 1].insert(frame[k + 1].end(), (*fields[k])[x][y].begin(), (*fields[k])[x][y].end());
+  }
+  return frame;
+}
+
+
+// Write back flattened run fields in the stored columns
+// Columns stored now but not in the frame are zeroed, columns of the frame not stored now are skipped
+void CompuFluidDyna::UnpackRunFields(const std::vector<std::vector<float>>& iFrame) {
+  const std::array<std::vector<std::vector<std::vector<float>>>*, 5> fields({&Smok, &Pres, &VelX, &VelY, &VelZ});
+  if (iFrame.size() != fields.size() + 1 || iFrame[0].size() != (size_t)nX * nY) return;
+  size_t nbCols= 0;
+  for (float mask : iFrame[0])
+    if (mask > 0.5f) nbCols++;
+  for (int k= 0; k < (int)fields.size(); k++)
+    if (iFrame[k + 1].size() != nbCols * nZ) return;
+  for (int k= 0; k < (int)fields.size(); k++) {
+    const float* col= iFrame[k + 1].data();
+    for (int x= 0; x < nX; x++) {
+      for (int y= 0; y < nY; y++) {
+        const bool isInFrame= (iFrame[0][(size_t)x * nY + y] > 0.5f);
+        if (StoredCols[x][y]) {
+          if (isInFrame) std::copy(col, col + nZ, (*fields[k])[x][y].begin());
+          else std::fill((*fields[k])[x][y].begin(), (*fields[k])[x][y].end(), 0.0f);
+        }
+        if (isInFrame) col+= nZ;
+      }
+    }
   }
 }
 
 
+// Append the run fields to the compressed history, created on the first record
+void CompuFluidDyna::RecordTimeline() {
+  if (!History) {
+    std::error_code errCode;
+    std::filesystem::create_directories("FileOutput", errCode);
+    const size_t memBudget= (size_t)(std::max(D.UI[TimelineMem_].GetD(), 0.0) * 1024.0 * 1024.0);
+    History= std::make_shared<Timeline>(timelineKeyPeriod, timelineQuantBits, memBudget, "FileOutput/CFD_timeline.bin");
+  }
+  History->Record(PackRunFields());
+  if (D.UI[Verbose_____].GetB())
+    printf("Timeline frame %d  step %d  memory %zu B  file %zu B\n", History->NbFrames() - 1, simStep, History->MemBytes(), History->FileBytes());
+}
+
+
+// Show the recorded frame selected in the UI in place of the live fields
+// The live fields are saved when scrubbing starts and restored exactly when going back to the live simulation
+void CompuFluidDyna::ScrubTimeline() {
+  const float seekPos= D.UI[TimelineSeek].GetF();
+  int frame= -1;
+  if (seekPos >= 0.0f && History && History->NbFrames() > 0)
+    frame= (int)std::round(std::min(seekPos, 1.0f) * (float)(History->NbFrames() - 1));
+  if (frame == historyFrame) return;
+
+  if (frame < 0) {
+    UnpackRunFields(LiveFrame);
+    LiveFrame.clear();
+  }
+  else {
+    if (historyFrame < 0) LiveFrame= PackRunFields();
+    if (D.UI[Verbose_____].GetB()) Timer::PushTimer();
+    std::vector<std::vector<float>> recFrame;
+    if (!History->Seek(frame, recFrame)) {
+      printf("[ERROR] Unable to decode frame %d of the timeline\n\n", frame);
+      if (historyFrame < 0) LiveFrame.clear();
+      return;
+    }
+    UnpackRunFields(recFrame);
+    if (D.UI[Verbose_____].GetB()) printf("Timeline seek frame %d/%d in %f s\n", frame, History->NbFrames(), Timer::PopTimer());
+  }
+  historyFrame= frame;
+
+  // Diagnostics, plots and colored voxels follow the shown fields
+  diagStep.fill(-1);
+  isCubeBatchValid= false;
+  SetUpUIData();
+}
+
+
 void CompuFluidDyna::InitializeScenario() {
   // Get scenario ID and optionnally load bitmap file
   const int scenarioType= D.UI[Scenario____].GetI();
@@ -218,21 +526,21 @@ void CompuFluidDyna::InitializeScenario() {
             Solid[x][y][z]= true;
           }
           else {
-            if (std::abs(colRGBA[0] - 0.5f) > 0.1f) {PreBC[x][y][z]= true;/*printf("[x][y][z]=[%d][%d][%d]; PresBC\n",x,y,z);*/}
-            if (std::abs(colRGBA[1] - 0.5f) > 0.1f) {VelBC[x][y][z]= true;/*printf("[x][y][z]=[%d][%d][%d]; VelBC\n",x,y,z);*/}
-            if (std::abs(colRGBA[2] - 0.5f) > 0.1f) {SmoBC[x][y][z]= true;/*printf("[x][y][z]=[%d][%d][%d]; SmoBC\n",x,y,z);*/}
+            if (std::abs(colRGBA[0] - 0.5f) > 0.1f) {Scen->PreBC[x][y][z]= true;/*printf("[x][y][z]=[%d][%d][%d]; PresBC\n",x,y,z);*/}
+            if (std::abs(colRGBA[1] - 0.5f) > 0.1f) {Scen->VelBC[x][y][z]= true;/*printf("[x][y][z]=[%d][%d][%d]; VelBC\n",x,y,z);*/}
+            if (std::abs(colRGBA[2] - 0.5f) > 0.1f) {Scen->SmoBC[x][y][z]= true;/*printf("[x][y][z]=[%d][%d][%d]; SmoBC\n",x,y,z);*/}
             
           }
-          if (PreBC[x][y][z]) {
-            PresForced[x][y][z]= D.UI[BCPres______].GetF() * ((colRGBA[0] > 0.5f) ? (1.0f) : (-1.0f));
+          if (Scen->PreBC[x][y][z]) {
+            Scen->PresForced[x][y][z]= D.UI[BCPres______].GetF() * ((colRGBA[0] > 0.5f) ? (1.0f) : (-1.0f));
           }
-          if (VelBC[x][y][z]) {
-            VelXForced[x][y][z]= D.UI[BCVelX______].GetF() * ((colRGBA[1] > 0.5f) ? (1.0f) : (-1.0f));
-            VelYForced[x][y][z]= D.UI[BCVelY______].GetF() * ((colRGBA[1] > 0.5f) ? (1.0f) : (-1.0f));
-            VelZForced[x][y][z]= D.UI[BCVelZ______].GetF() * ((colRGBA[1] > 0.5f) ? (1.0f) : (-1.0f));
+          if (Scen->VelBC[x][y][z]) {
+            Scen->VelXForced[x][y][z]= D.UI[BCVelX______].GetF() * ((colRGBA[1] > 0.5f) ? (1.0f) : (-1.0f));
+            Scen->VelYForced[x][y][z]= D.UI[BCVelY______].GetF() * ((colRGBA[1] > 0.5f) ? (1.0f) : (-1.0f));
+            Scen->VelZForced[x][y][z]= D.UI[BCVelZ______].GetF() * ((colRGBA[1] > 0.5f) ? (1.0f) : (-1.0f));
           }
-          if (SmoBC[x][y][z]) {
-            SmokForced[x][y][z]= D.UI[BCSmok______].GetF() * ((colRGBA[2] > 0.5f) ? (1.0f) : (-1.0f));
+          if (Scen->SmoBC[x][y][z]) {
+            Scen->SmokForced[x][y][z]= D.UI[BCSmok______].GetF() * ((colRGBA[2] > 0.5f) ? (1.0f) : (-1.0f));
           }
         }
         // Double opposing inlets
@@ -243,8 +551,8 @@ void CompuFluidDyna::InitializeScenario() {
         // |-----------|
         if (scenarioType == 1) {
           if (nY > 1 && (y == 0 || y == nY - 1)) {
-            PreBC[x][y][z]= true;
-            PresForced[x][y][z]= 0.0f;
+            Scen->PreBC[x][y][z]= true;
+            Scen->PresForced[x][y][z]= 0.0f;
           }
           else if ((nX > 1 && (x == 0 || x == nX - 1)) ||
                    (nZ > 1 && (z == 0 || z == nZ - 1))) {
@@ -256,12 +564,12 @@ void CompuFluidDyna::InitializeScenario() {
             for (int k= 0; k < 2; k++) {
               if (k == 0 && (posVox - posInlet).norm() > D.UI[ObjectSize0_].GetF()) continue;
               if (k == 1 && (posVox - Vec::Vec3<float>(1.0f, 1.0f, 1.0f) + posInlet).norm() > D.UI[ObjectSize1_].GetF()) continue;
-              VelBC[x][y][z]= true;
-              SmoBC[x][y][z]= true;
-              VelXForced[x][y][z]= D.UI[BCVelX______].GetF() * ((k == 0) ? (1.0f) : (-1.0f));
-              VelYForced[x][y][z]= D.UI[BCVelY______].GetF() * ((k == 0) ? (1.0f) : (-1.0f));
-              VelZForced[x][y][z]= D.UI[BCVelZ______].GetF() * ((k == 0) ? (1.0f) : (-1.0f));
-              SmokForced[x][y][z]= D.UI[BCSmok______].GetF() * ((k == 0) ? (1.0f) : (-1.0f));
+              Scen->VelBC[x][y][z]= true;
+              Scen->SmoBC[x][y][z]= true;
+              Scen->VelXForced[x][y][z]= D.UI[BCVelX______].GetF() * ((k == 0) ? (1.0f) : (-1.0f));
+              Scen->VelYForced[x][y][z]= D.UI[BCVelY______].GetF() * ((k == 0) ? (1.0f) : (-1.0f));
+              Scen->VelZForced[x][y][z]= D.UI[BCVelZ______].GetF() * ((k == 0) ? (1.0f) : (-1.0f));
+              Scen->SmokForced[x][y][z]= D.UI[BCSmok______].GetF() * ((k == 0) ? (1.0f) : (-1.0f));
             }
           }
         }
@@ -273,22 +581,22 @@ void CompuFluidDyna::InitializeScenario() {
         if (scenarioType == 2) {
           if ((nX > 1 && (x == 0 || x == nX - 1)) ||
               (nZ > 1 && (z == 0 || z == nZ - 1))) {
-            VelBC[x][y][z]= true;
-            VelXForced[x][y][z]= D.UI[BCVelX______].GetF();
-            VelYForced[x][y][z]= D.UI[BCVelY______].GetF();
-            VelZForced[x][y][z]= D.UI[BCVelZ______].GetF();
+            Scen->VelBC[x][y][z]= true;
+            Scen->VelXForced[x][y][z]= D.UI[BCVelX______].GetF();
+            Scen->VelYForced[x][y][z]= D.UI[BCVelY______].GetF();
+            Scen->VelZForced[x][y][z]= D.UI[BCVelZ______].GetF();
           }
           else if (y == nY - 1) {
-            PreBC[x][y][z]= true;
-            PresForced[x][y][z]= 0.0f;
+            Scen->PreBC[x][y][z]= true;
+            Scen->PresForced[x][y][z]= 0.0f;
           }
           else if (y == 0) {
-            VelBC[x][y][z]= true;
-            VelXForced[x][y][z]= D.UI[BCVelX______].GetF();
-            VelYForced[x][y][z]= D.UI[BCVelY______].GetF();
-            VelZForced[x][y][z]= D.UI[BCVelZ______].GetF();
-            SmoBC[x][y][z]= true;
-            SmokForced[x][y][z]= D.UI[BCSmok______].GetF();
+            Scen->VelBC[x][y][z]= true;
+            Scen->VelXForced[x][y][z]= D.UI[BCVelX______].GetF();
+            Scen->VelYForced[x][y][z]= D.UI[BCVelY______].GetF();
+            Scen->VelZForced[x][y][z]= D.UI[BCVelZ______].GetF();
+            Scen->SmoBC[x][y][z]= true;
+            Scen->SmokForced[x][y][z]= D.UI[BCSmok______].GetF();
           }
           else {
             const Vec::Vec3<float> posCell(((float)x + 0.5f) / (float)nX, ((float)y + 0.5f) / (float)nY, ((float)z + 0.5f) / (float)nZ);
@@ -312,14 +620,14 @@ void CompuFluidDyna::InitializeScenario() {
             Solid[x][y][z]= true;
           }
           else if (z == nZ - 1) {
-            VelBC[x][y][z]= true;
-            VelXForced[x][y][z]= D.UI[BCVelX______].GetF();
-            VelYForced[x][y][z]= D.UI[BCVelY______].GetF();
-            VelZForced[x][y][z]= D.UI[BCVelZ______].GetF();
+            Scen->VelBC[x][y][z]= true;
+            Scen->VelXForced[x][y][z]= D.UI[BCVelX______].GetF();
+            Scen->VelYForced[x][y][z]= D.UI[BCVelY______].GetF();
+            Scen->VelZForced[x][y][z]= D.UI[BCVelZ______].GetF();
           }
           else if (y == nY / 2 && z > nZ / 2) {
-            SmoBC[x][y][z]= true;
-            SmokForced[x][y][z]= D.UI[BCSmok______].GetF();
+            Scen->SmoBC[x][y][z]= true;
+            Scen->SmokForced[x][y][z]= D.UI[BCSmok______].GetF();
           }
         }
         // Flow constriction test with circular hole in a wall
@@ -342,16 +650,16 @@ void CompuFluidDyna::InitializeScenario() {
             Solid[x][y][z]= true;
           }
           else if (y == 0) {
-            VelBC[x][y][z]= true;
-            VelXForced[x][y][z]= D.UI[BCVelX______].GetF();
-            VelYForced[x][y][z]= D.UI[BCVelY______].GetF();
-            VelZForced[x][y][z]= D.UI[BCVelZ______].GetF();
-            SmoBC[x][y][z]= true;
-            SmokForced[x][y][z]= D.UI[BCSmok______].GetF();
+            Scen->VelBC[x][y][z]= true;
+            Scen->VelXForced[x][y][z]= D.UI[BCVelX______].GetF();
+            Scen->VelYForced[x][y][z]= D.UI[BCVelY______].GetF();
+            Scen->VelZForced[x][y][z]= D.UI[BCVelZ______].GetF();
+            Scen->SmoBC[x][y][z]= true;
+            Scen->SmokForced[x][y][z]= D.UI[BCSmok______].GetF();
           }
           else if (y == nY - 1) {
-            PreBC[x][y][z]= true;
-            PresForced[x][y][z]= 0.0f;
+            Scen->PreBC[x][y][z]= true;
+            Scen->PresForced[x][y][z]= 0.0f;
           }
         }
         // Central bloc with initial velocity
@@ -363,6 +671,7 @@ void CompuFluidDyna::InitializeScenario() {
           if (((nX == 1) != (std::min(x, nX - 1 - x) > nX / 3)) &&
               ((nY == 1) != (std::min(y, nY - 1 - y) > nY / 3)) &&
               ((nZ == 1) != (std::min(z, nZ - 1 - z) > nZ / 3))) {
+            StoreColumn(x, y);
             VelX[x][y][z]= D.UI[BCVelX______].GetF();
             VelY[x][y][z]= D.UI[BCVelY______].GetF();
             VelZ[x][y][z]= D.UI[BCVelZ______].GetF();
@@ -376,18 +685,18 @@ void CompuFluidDyna::InitializeScenario() {
         if (scenarioType == 6) {
           if ((nX > 1 && (x == 0 || x == nX - 1)) ||
               (nZ > 1 && (z == 0 || z == nZ - 1))) {
-            VelBC[x][y][z]= true;
-            VelXForced[x][y][z]= D.UI[BCVelX______].GetF() * ((z < nZ / 2) ? (-1.0f) : (1.0f));
-            VelYForced[x][y][z]= D.UI[BCVelY______].GetF() * ((z < nZ / 2) ? (-1.0f) : (1.0f));
-            VelZForced[x][y][z]= D.UI[BCVelZ______].GetF() * ((z < nZ / 2) ? (-1.0f) : (1.0f));
+            Scen->VelBC[x][y][z]= true;
+            Scen->VelXForced[x][y][z]= D.UI[BCVelX______].GetF() * ((z < nZ / 2) ? (-1.0f) : (1.0f));
+            Scen->VelYForced[x][y][z]= D.UI[BCVelY______].GetF() * ((z < nZ / 2) ? (-1.0f) : (1.0f));
+            Scen->VelZForced[x][y][z]= D.UI[BCVelZ______].GetF() * ((z < nZ / 2) ? (-1.0f) : (1.0f));
           }
           else if (nY > 1 && (y == 0 || y == nY - 1)) {
-            PreBC[x][y][z]= true;
-            PresForced[x][y][z]= D.UI[BCPres______].GetF() * ((y < nY / 2) ? (1.0f) : (-1.0f));
+            Scen->PreBC[x][y][z]= true;
+            Scen->PresForced[x][y][z]= D.UI[BCPres______].GetF() * ((y < nY / 2) ? (1.0f) : (-1.0f));
           }
           else if (std::max(y, nY - 1 - y) == nY / 2) {
-            SmoBC[x][y][z]= true;
-            SmokForced[x][y][z]= D.UI[BCSmok______].GetF();
+            Scen->SmoBC[x][y][z]= true;
+            Scen->SmokForced[x][y][z]= D.UI[BCSmok______].GetF();
           }
         }
         // Thermal convection cell
@@ -401,6 +710,7 @@ void CompuFluidDyna::InitializeScenario() {
             Solid[x][y][z]= true;
           }
           else if (nZ > 1 && std::min(z, nZ - 1 - z) < nZ / 3) {
+            StoreColumn(x, y);
             Smok[x][y][z]= D.UI[BCSmok______].GetF() * ((z > nZ / 2) ? (-1.0f) : (1.0f));
             Smok[x][y][z]+= Random::Val(-0.01f, 0.01f);
           }
@@ -426,14 +736,14 @@ void CompuFluidDyna::InitializeScenario() {
               Solid[x][y][z]= true;
             }
             else if (y == 0) {
-              VelBC[x][y][z]= true;
-              VelXForced[x][y][z]= D.UI[BCVelX______].GetF();
-              VelYForced[x][y][z]= D.UI[BCVelY______].GetF();
-              VelZForced[x][y][z]= D.UI[BCVelZ______].GetF();
-              // PreBC[x][y][z]= true;
-              // PresForced[x][y][z]= D.UI[BCPres______].GetF();
-              SmoBC[x][y][z]= true;
-              SmokForced[x][y][z]= D.UI[BCSmok______].GetF();
+              Scen->VelBC[x][y][z]= true;
+              Scen->VelXForced[x][y][z]= D.UI[BCVelX______].GetF();
+              Scen->VelYForced[x][y][z]= D.UI[BCVelY______].GetF();
+              Scen->VelZForced[x][y][z]= D.UI[BCVelZ______].GetF();
+              // Scen->PreBC[x][y][z]= true;
+              // Scen->PresForced[x][y][z]= D.UI[BCPres______].GetF();
+              Scen->SmoBC[x][y][z]= true;
+              Scen->SmokForced[x][y][z]= D.UI[BCSmok______].GetF();
             }
           }
           else if (posVox[2] < posBend[2]) {
@@ -441,8 +751,8 @@ void CompuFluidDyna::InitializeScenario() {
               Solid[x][y][z]= true;
             }
             else if (z == 0) {
-              PreBC[x][y][z]= true;
-              PresForced[x][y][z]= 0.0;
+              Scen->PreBC[x][y][z]= true;
+              Scen->PresForced[x][y][z]= 0.0;
             }
           }
           else if ((posBend + ((posVox - posBend).coeffMul(Vec::Vec3<float>(0.0f, 1.0f, 1.0f)).normalized() * (radBend + radPipe)) - posVox).norm() > radPipe) {
@@ -455,47 +765,585 @@ void CompuFluidDyna::InitializeScenario() {
 }
 
 
+// Set up the flags and forced values of the scenario, then compact and constrain the fields accordingly
+void CompuFluidDyna::BuildScenario() {
+  InitializeScenario();
+
+  // Enforce scenario validity
+  for (int x= 0; x < nX; x++) {
+    for (int y= 0; y < nY; y++) {
+      for (int z= 0; z < nZ; z++) {
+        if (Solid[x][y][z]) {
+          Scen->VelBC[x][y][z]= Scen->PreBC[x][y][z]= Scen->SmoBC[x][y][z]= false;
+          Scen->VelXForced[x][y][z]= Scen->VelYForced[x][y][z]= Scen->VelZForced[x][y][z]= Scen->PresForced[x][y][z]= Scen->SmokForced[x][y][z]= 0.0f;
+        }
+      }
+    }
+  }
+
+  // Compact the active voxels of the scenario
+  BuildSpans();
+  BuildSafeZone();
+  if (sparseStore) {
+    CompactRunFields();
+    CompactScenario();
+  }
+
+  // Zero the solid voxels left over from the previous scenario, the boundary conditions only maintain the interface ones
+  const std::vector<std::vector<std::vector<std::vector<float>>>*> runFields= RunFields();
+  SweepSubDomains([&](const int xBeg, const int xEnd, const int yBeg, const int yEnd) {
+    for (int x= xBeg; x < xEnd; x++)
+      for (int y= yBeg; y < yEnd; y++)
+        if (StoredCols[x][y])
+          for (int z= 0; z < nZ; z++)
+            if (Solid[x][y][z])
+              for (std::vector<std::vector<std::vector<float>>>* field : runFields)
+                if (!field->empty()) (*field)[x][y][z]= 0.0f;
+  });
+
+  // Apply BC on fields
+  ApplyBC(FieldID::IDSmok, Smok);
+  ApplyBC(FieldID::IDVelX, VelX);
+  ApplyBC(FieldID::IDVelY, VelY);
+  ApplyBC(FieldID::IDVelZ, VelZ);
+  ApplyBC(FieldID::IDPres, Dive);
+  ApplyBC(FieldID::IDPres, Pres);
+}
+
+
+// Initialize the velocity and pressure with the steady flow of the scenario on a grid coarsened by the given factor
+// - A coarse voxel is solid when most of its fine voxels are, unless it holds fine boundary conditions that keep inlets and outlets open
+// - Each boundary condition of a coarse voxel enforces the average of the values enforced on its fine voxels
+// - The coarse flow is stepped until its kinetic energy delta, scaled to the fine voxel count, drops below the stability tolerance
+// - Velocity and pressure are then trilinearly interpolated at the fine voxel centers
+void CompuFluidDyna::CoarseContinuation(const int iFactor) {
+  CompuFluidDyna coarse= *this;
+  coarse.nX= (nX + iFactor - 1) / iFactor;
+  coarse.nY= (nY + iFactor - 1) / iFactor;
+  coarse.nZ= (nZ + iFactor - 1) / iFactor;
+  coarse.voxSize= voxSize * (float)iFactor;
+  coarse.AllocateFields();
+
+  // Accumulate the fine voxel states in the coarse voxels
+  std::vector<std::vector<std::vector<int>>> nbVox= Field::AllocField3D(coarse.nX, coarse.nY, coarse.nZ, 0);
+  std::vector<std::vector<std::vector<int>>> nbSolid= Field::AllocField3D(coarse.nX, coarse.nY, coarse.nZ, 0);
+  std::vector<std::vector<std::vector<int>>> nbVelBC= Field::AllocField3D(coarse.nX, coarse.nY, coarse.nZ, 0);
+  std::vector<std::vector<std::vector<int>>> nbPreBC= Field::AllocField3D(coarse.nX, coarse.nY, coarse.nZ, 0);
+  std::vector<std::vector<std::vector<int>>> nbSmoBC= Field::AllocField3D(coarse.nX, coarse.nY, coarse.nZ, 0);
+  for (int x= 0; x < nX; x++) {
+    for (int y= 0; y < nY; y++) {
+      for (int z= 0; z < nZ; z++) {
+        const int xC= x / iFactor, yC= y / iFactor, zC= z / iFactor;
+        nbVox[xC][yC][zC]++;
+        if (IsSolid(x, y, z)) nbSolid[xC][yC][zC]++;
+        if (Scen->IsVelBC(x, y, z)) {
+          nbVelBC[xC][yC][zC]++;
+          coarse.Scen->VelXForced[xC][yC][zC]+= Scen->VelXForced[x][y][z];
+          coarse.Scen->VelYForced[xC][yC][zC]+= Scen->VelYForced[x][y][z];
+          coarse.Scen->VelZForced[xC][yC][zC]+= Scen->VelZForced[x][y][z];
+        }
+        if (Scen->IsPreBC(x, y, z)) {
+          nbPreBC[xC][yC][zC]++;
+          coarse.Scen->PresForced[xC][yC][zC]+= Scen->PresForced[x][y][z];
+        }
+        if (Scen->IsSmoBC(x, y, z)) {
+          nbSmoBC[xC][yC][zC]++;
+          coarse.Scen->SmokForced[xC][yC][zC]+= Scen->SmokForced[x][y][z];
+        }
+      }
+    }
+  }
+  for (int x= 0; x < coarse.nX; x++) {
+    for (int y= 0; y < coarse.nY; y++) {
+      for (int z= 0; z < coarse.nZ; z++) {
+        coarse.Scen->VelBC[x][y][z]= (nbVelBC[x][y][z] > 0);
+        coarse.Scen->PreBC[x][y][z]= (nbPreBC[x][y][z] > 0);
+        coarse.Scen->SmoBC[x][y][z]= (nbSmoBC[x][y][z] > 0);
+        coarse.Solid[x][y][z]= (2 * nbSolid[x][y][z] > nbVox[x][y][z]) && !coarse.Scen->VelBC[x][y][z] && !coarse.Scen->PreBC[x][y][z] && !coarse.Scen->SmoBC[x][y][z];
+        if (coarse.Scen->VelBC[x][y][z]) {
+          coarse.Scen->VelXForced[x][y][z]/= (float)nbVelBC[x][y][z];
+          coarse.Scen->VelYForced[x][y][z]/= (float)nbVelBC[x][y][z];
+          coarse.Scen->VelZForced[x][y][z]/= (float)nbVelBC[x][y][z];
+        }
+        if (coarse.Scen->PreBC[x][y][z]) coarse.Scen->PresForced[x][y][z]/= (float)nbPreBC[x][y][z];
+        if (coarse.Scen->SmoBC[x][y][z]) coarse.Scen->SmokForced[x][y][z]/= (float)nbSmoBC[x][y][z];
+      }
+    }
+  }
+
+  // Set up the coarse scenario as Refresh does
+  coarse.BuildSpans();
+  if (coarse.sparseStore) {
+    coarse.CompactRunFields();
+    coarse.CompactScenario();
+  }
+  coarse.ApplyBC(FieldID::IDSmok, coarse.Smok);
+  coarse.ApplyBC(FieldID::IDVelX, coarse.VelX);
+  coarse.ApplyBC(FieldID::IDVelY, coarse.VelY);
+  coarse.ApplyBC(FieldID::IDVelZ, coarse.VelZ);
+  coarse.ApplyBC(FieldID::IDPres, coarse.Dive);
+  coarse.ApplyBC(FieldID::IDPres, coarse.Pres);
+  coarse.ComputeMaxVelocity();
+
+  // Step the coarse flow to steady state
+  const int nbDim= (nX > 1) + (nY > 1) + (nZ > 1);
+  const float tolKED= D.UI[KEDTol______].GetF() / std::pow((float)iFactor, (float)nbDim);
+  const int maxStep= std::max(D.UI[CoarseSteps_].GetI(), 0);
+  coarse.ComputeKineticEnergy();
+  int idxStep= 0;
+  while (idxStep < maxStep) {
+    coarse.StepSimulation();
+    idxStep++;
+    const float oldKE= coarse.KE;
+    coarse.ComputeKineticEnergy();
+    if (std::abs(coarse.KE - oldKE) < tolKED) break;
+  }
+  if (D.UI[Verbose_____].GetB()) printf("Coarse continuation  factor %d  steps %d  simTime %f\n", iFactor, idxStep, coarse.simTime);
+
+  // Prolongate the coarse flow on the fine voxels
+  SweepTiles(FluidSpans, [&](const int x, const int y, const int zBeg, const int zEnd) {
+    const float posX= ((float)x + 0.5f) / (float)iFactor - 0.5f;
+    const float posY= ((float)y + 0.5f) / (float)iFactor - 0.5f;
+    for (int z= zBeg; z < zEnd; z++) {
+      const float posZ= ((float)z + 0.5f) / (float)iFactor - 0.5f;
+      VelX[x][y][z]= coarse.TrilinearInterpolation(posX, posY, posZ, coarse.VelX);
+      VelY[x][y][z]= coarse.TrilinearInterpolation(posX, posY, posZ, coarse.VelY);
+      VelZ[x][y][z]= coarse.TrilinearInterpolation(posX, posY, posZ, coarse.VelZ);
+      Pres[x][y][z]= coarse.TrilinearInterpolation(posX, posY, posZ, coarse.Pres);
+    }
+  });
+  ApplyBC(FieldID::IDVelX, VelX);
+  ApplyBC(FieldID::IDVelY, VelY);
+  ApplyBC(FieldID::IDVelZ, VelZ);
+  ApplyBC(FieldID::IDPres, Pres);
+}
+
+
 // Apply boundary conditions enforcing fixed values to fields
 void CompuFluidDyna::ApplyBC(const int iFieldID, std::vector<std::vector<std::vector<float>>>& ioField) {
-  // Sweep through the field
+  // Select the forced value flags and values of the field once per call
+  const std::vector<std::vector<std::vector<bool>>>& fixed= (iFieldID == FieldID::IDSmok) ? Scen->SmoBC : (iFieldID == FieldID::IDPres) ? Scen->PreBC : Scen->VelBC;
+  const std::vector<std::vector<std::vector<float>>>& forced= (iFieldID == FieldID::IDSmok) ? Scen->SmokForced :
+                                                              (iFieldID == FieldID::IDVelX) ? Scen->VelXForced :
+                                                              (iFieldID == FieldID::IDVelY) ? Scen->VelYForced :
+                                                              (iFieldID == FieldID::IDVelZ) ? Scen->VelZForced : Scen->PresForced;
+  // Sweep through the spans of interface solid and forced voxels in the stored columns, each subdomain handles its own boundary voxels
+  SweepSubDomains([&](const int xBeg, const int xEnd, const int yBeg, const int yEnd) {
+    for (int x= xBeg; x < xEnd; x++) {
+      for (int y= yBeg; y < yEnd; y++) {
+        if (ioField[x][y].empty()) continue;
+        // Columns without boundary condition of the field hold no flag and only zero their interface solid voxels
+        const bool hasForced= !fixed[x][y].empty() && !isHomogeneousBC;
+        for (std::array<int, 2> span : FixedSpans[iFieldID][x][y])
+          for (int z= span[0]; z < span[1]; z++)
+            ioField[x][y][z]= (hasForced && fixed[x][y][z]) ? forced[x][y][z] : 0.0f;  // Forced value takes precedence over the zero of solid voxels
+      }
+    }
+  });
+}
+
+
+// Build the run-length spans of active voxels for all the columns of the domain
+void CompuFluidDyna::BuildSpans() {
+  nbFluidVox= nbIfacVox= 0;
   for (int x= 0; x < nX; x++) {
     for (int y= 0; y < nY; y++) {
-      for (int z= 0; z < nZ; z++) {
-        // Set forced value
-        if (Solid[x][y][z] && iFieldID == FieldID::IDSmok) ioField[x][y][z]= 0.0f;
-        if (Solid[x][y][z] && iFieldID == FieldID::IDVelX) ioField[x][y][z]= 0.0f;
-        if (Solid[x][y][z] && iFieldID == FieldID::IDVelY) ioField[x][y][z]= 0.0f;
-        if (Solid[x][y][z] && iFieldID == FieldID::IDVelZ) ioField[x][y][z]= 0.0f;
-        if (Solid[x][y][z] && iFieldID == FieldID::IDPres) ioField[x][y][z]= 0.0f;
-        if (SmoBC[x][y][z] && iFieldID == FieldID::IDSmok) ioField[x][y][z]= SmokForced[x][y][z]/* * std::cos(simTime * 2.0f * std::numbers::pi / D.UI[BCSmokTime__].GetF())*/;
-        if (VelBC[x][y][z] && iFieldID == FieldID::IDVelX) ioField[x][y][z]= VelXForced[x][y][z];
-        if (VelBC[x][y][z] && iFieldID == FieldID::IDVelY) ioField[x][y][z]= VelYForced[x][y][z];
-        if (VelBC[x][y][z] && iFieldID == FieldID::IDVelZ) ioField[x][y][z]= VelZForced[x][y][z];
-        if (PreBC[x][y][z] && iFieldID == FieldID::IDPres) ioField[x][y][z]= PresForced[x][y][z];
+      FluidSpans[x][y].clear();
+      IfacSpans[x][y].clear();
+      for (int k= 0; k < (int)FreeSpans.size(); k++) {
+        FreeSpans[k][x][y].clear();
+        FixedSpans[k][x][y].clear();
+      }
+      UpdateSpans(x, y);
+    }
+  }
+}
+
+
+// Rebuild the run-length spans of the (x,y) column after a change in the flag fields
+void CompuFluidDyna::UpdateSpans(const int x, const int y) {
+  // Remove the previous contribution of the column to the voxel counts
+  for (std::array<int, 2> span : FluidSpans[x][y]) nbFluidVox-= span[1] - span[0];
+  for (std::array<int, 2> span : IfacSpans[x][y]) nbIfacVox-= span[1] - span[0];
+  FluidSpans[x][y].clear();
+  IfacSpans[x][y].clear();
+  for (int k= 0; k < (int)FreeSpans.size(); k++) {
+    FreeSpans[k][x][y].clear();
+    FixedSpans[k][x][y].clear();
+  }
+  // Append the voxel to the span list, merging with the last span if contiguous
+  auto AddToSpans= [](std::vector<std::array<int, 2>>& ioSpans, const int z) {
+    if (!ioSpans.empty() && ioSpans.back()[1] == z) ioSpans.back()[1]++;
+    else ioSpans.push_back({z, z + 1});
+  };
+  isSpectralValid= false;
+  // Columns becoming active after a geometry change get their storage, the others stay all solid without spans
+  if (!StoredCols[x][y]) {
+    bool isActive= false;
+    for (int z= 0; z < nZ && !isActive; z++)
+      isActive= !IsSolid(x, y, z) ||
+                (x - 1 >= 0 && !IsSolid(x - 1, y, z)) || (x + 1 < nX && !IsSolid(x + 1, y, z)) ||
+                (y - 1 >= 0 && !IsSolid(x, y - 1, z)) || (y + 1 < nY && !IsSolid(x, y + 1, z));
+    if (!isActive) return;
+    StoreColumn(x, y);
+  }
+  // Sweep the column, the lateral neighbors may lie in columns without storage
+  for (int z= 0; z < nZ; z++) {
+    uint16_t flags= 0;
+    if (x - 1 >= 0) flags|= IsSolid(x - 1, y, z) ? (1u << 8) : (1u << 0);
+    if (x + 1 < nX) flags|= IsSolid(x + 1, y, z) ? (1u << 9) : (1u << 1);
+    if (y - 1 >= 0) flags|= IsSolid(x, y - 1, z) ? (1u << 10) : (1u << 2);
+    if (y + 1 < nY) flags|= IsSolid(x, y + 1, z) ? (1u << 11) : (1u << 3);
+    if (z - 1 >= 0) flags|= Solid[x][y][z - 1] ? (1u << 12) : (1u << 4);
+    if (z + 1 < nZ) flags|= Solid[x][y][z + 1] ? (1u << 13) : (1u << 5);
+    FaceFlags[x][y][z]= flags;
+    if (Solid[x][y][z]) {
+      const bool isIfac= (flags & 0x3Fu) != 0;
+      if (isIfac) AddToSpans(IfacSpans[x][y], z);
+      // Interior solid voxels are zeroed once when they turn solid and left out of the boundary conditions
+      if (isIfac || Scen->IsSmoBC(x, y, z)) AddToSpans(FixedSpans[FieldID::IDSmok][x][y], z);
+      if (isIfac || Scen->IsVelBC(x, y, z)) AddToSpans(FixedSpans[FieldID::IDVelX][x][y], z);
+      if (isIfac || Scen->IsVelBC(x, y, z)) AddToSpans(FixedSpans[FieldID::IDVelY][x][y], z);
+      if (isIfac || Scen->IsVelBC(x, y, z)) AddToSpans(FixedSpans[FieldID::IDVelZ][x][y], z);
+      if (isIfac || Scen->IsPreBC(x, y, z)) AddToSpans(FixedSpans[FieldID::IDPres][x][y], z);
+      continue;
+    }
+    AddToSpans(FluidSpans[x][y], z);
+    AddToSpans(Scen->IsSmoBC(x, y, z) ? FixedSpans[FieldID::IDSmok][x][y] : FreeSpans[FieldID::IDSmok][x][y], z);
+    AddToSpans(Scen->IsVelBC(x, y, z) ? FixedSpans[FieldID::IDVelX][x][y] : FreeSpans[FieldID::IDVelX][x][y], z);
+    AddToSpans(Scen->IsVelBC(x, y, z) ? FixedSpans[FieldID::IDVelY][x][y] : FreeSpans[FieldID::IDVelY][x][y], z);
+    AddToSpans(Scen->IsVelBC(x, y, z) ? FixedSpans[FieldID::IDVelZ][x][y] : FreeSpans[FieldID::IDVelZ][x][y], z);
+    AddToSpans(Scen->IsPreBC(x, y, z) ? FixedSpans[FieldID::IDPres][x][y] : FreeSpans[FieldID::IDPres][x][y], z);
+  }
+  // Add the new contribution of the column to the voxel counts
+  for (std::array<int, 2> span : FluidSpans[x][y]) nbFluidVox+= span[1] - span[0];
+  for (std::array<int, 2> span : IfacSpans[x][y]) nbIfacVox+= span[1] - span[0];
+}
+
+
+// Get the solid flag of a voxel, columns without storage are all solid
+bool CompuFluidDyna::IsSolid(const int x, const int y, const int z) const {
+  return Solid[x][y].empty() || Solid[x][y][z];
+}
+
+
+// Get the column of a field and its 4 lateral neighbors in the order (x,y) -X +X -Y +Y
+// Columns outside the domain or without storage read as zero, the face flags tell the stencils to ignore them
+std::array<const float*, 5> CompuFluidDyna::NeighborCols(const std::vector<std::vector<std::vector<float>>>& iField, const int x, const int y) {
+  auto Col= [&](const int iX, const int iY) -> const float* {
+    if (iX < 0 || iX >= nX || iY < 0 || iY >= nY || iField[iX][iY].empty()) return ZeroCol.data();
+    return iField[iX][iY].data();
+  };
+  return {Col(x, y), Col(x - 1, y), Col(x + 1, y), Col(x, y - 1), Col(x, y + 1)};
+}
+
+
+// Change the solid state of a voxel and incrementally update the spans of the affected columns
+// Derived fields that kernels no longer sweep on solid voxels are reset
+// Voxels turned solid are zeroed in all the run fields as the boundary conditions only maintain the interface ones
+void CompuFluidDyna::SetSolidVoxel(const int x, const int y, const int z, const bool iSolid) {
+  // Columns without storage are all solid, a voxel turned fluid first gets its column
+  if (iSolid && !StoredCols[x][y]) return;
+  StoreColumn(x, y);
+  Solid[x][y][z]= iSolid;
+  if (iSolid)
+    for (std::vector<std::vector<std::vector<float>>>* field : RunFields())
+      if (!field->empty()) (*field)[x][y][z]= 0.0f;
+  Dive[x][y][z]= 0.0f;
+  for (std::vector<std::vector<std::vector<diag_float>>>* field : DiagFields())
+    if (!field->empty()) (*field)[x][y][z]= 0.0f;
+  diagStep.fill(-1);
+  isWireBatchValid= false;
+  isCubeBatchValid= false;
+  // Voxels turned fluid start from rest in the lattice Boltzmann engine
+  if (!iSolid && !LbmDist.empty())
+    for (int k= 0; k < lbmNbDir; k++)
+      LbmDist[(((size_t)k * nX + x) * nY + y) * nZ + z]= LbmWeight[k];
+  UpdateSpans(x, y);
+  if (x - 1 >= 0) UpdateSpans(x - 1, y);
+  if (x + 1 < nX) UpdateSpans(x + 1, y);
+  if (y - 1 >= 0) UpdateSpans(x, y - 1);
+  if (y + 1 < nY) UpdateSpans(x, y + 1);
+}
+
+
+// Split the domain in slabs of planes along X, or along Y for 2D cases in the YZ plane
+// Each slab is swept by its own thread and reads the boundary planes of its neighbors as halo directly in shared memory
+void CompuFluidDyna::BuildSubDomains() {
+  subDomAxis= (nX > 1) ? 0 : 1;
+  const int nbPlanes= (subDomAxis == 0) ? nX : nY;
+  const int nbSub= std::min(std::max(D.UI[NbSubDomain_].GetI(), 1), nbPlanes);
+  SubDomains.resize(nbSub);
+  for (int k= 0; k < nbSub; k++)
+    SubDomains[k]= {k * nbPlanes / nbSub, (k + 1) * nbPlanes / nbSub};
+  ColPartial= Field::AllocField2D(nX, nY, 0.0f);
+}
+
+
+// Run the kernel on the (x,y) column box of each subdomain in parallel
+// Consecutive sweeps are separated by the implicit barrier at the end of the parallel loop so halos are always up to date
+template <typename BoxKernel>
+void CompuFluidDyna::SweepSubDomains(BoxKernel&& iKernel) {
+  const int nbSub= (int)SubDomains.size();
+#pragma omp parallel for num_threads(nbSub) schedule(static, 1) if (nbSub > 1)
+  for (int k= 0; k < nbSub; k++) {
+    if (subDomAxis == 0) iKernel(SubDomains[k][0], SubDomains[k][1], 0, nY);
+    else iKernel(0, nX, SubDomains[k][0], SubDomains[k][1]);
+  }
+}
+
+
+// Sum the per column partial results in a fixed order so reductions do not depend on the decomposition
+float CompuFluidDyna::ReduceColPartial() {
+  float val= 0.0f;
+  for (int x= 0; x < nX; x++)
+    for (int y= 0; y < nY; y++)
+      val+= ColPartial[x][y];
+  return val;
+}
+
+
+// Get the tile sizes of the blocked stencil sweeps, a non positive size spans the whole dimension
+void CompuFluidDyna::GetTileSizes(int& oTileX, int& oTileY, int& oTileZ) {
+  oTileX= (D.UI[TileSizeX___].GetI() > 0) ? std::min(D.UI[TileSizeX___].GetI(), nX) : nX;
+  oTileY= (D.UI[TileSizeY___].GetI() > 0) ? std::min(D.UI[TileSizeY___].GetI(), nY) : nY;
+  oTileZ= (D.UI[TileSizeZ___].GetI() > 0) ? std::min(D.UI[TileSizeZ___].GetI(), nZ) : nZ;
+}
+
+
+// Sweep the span parts falling in each tile, tile after tile within each subdomain
+// Stencil kernels keep the neighborhoods of a tile in cache instead of streaming whole planes between rows
+template <typename SpanKernel>
+void CompuFluidDyna::SweepTiles(const std::vector<std::vector<std::vector<std::array<int, 2>>>>& iSpans, SpanKernel&& iKernel) {
+  int tileX, tileY, tileZ;
+  GetTileSizes(tileX, tileY, tileZ);
+  SweepSubDomains([&](const int xBeg, const int xEnd, const int yBeg, const int yEnd) {
+    for (int xLo= xBeg; xLo < xEnd; xLo+= tileX) {
+      for (int yLo= yBeg; yLo < yEnd; yLo+= tileY) {
+        for (int zLo= 0; zLo < nZ; zLo+= tileZ) {
+          for (int x= xLo; x < std::min(xLo + tileX, xEnd); x++) {
+            for (int y= yLo; y < std::min(yLo + tileY, yEnd); y++) {
+              for (std::array<int, 2> span : iSpans[x][y]) {
+                if (span[1] <= zLo || span[0] >= zLo + tileZ) continue;
+                iKernel(x, y, std::max(span[0], zLo), std::min(span[1], zLo + tileZ));
+              }
+            }
+          }
+        }
+      }
+    }
+  });
+}
+
+
+// Run the voxel kernel on [zBeg, zEnd) of a column with the indices of the Z neighbors kept inside the column
+// Voxels away from the column ends run in their own loop with plain neighbor indices so the compiler can vectorize it
+template <typename VoxelKernel>
+void CompuFluidDyna::SweepColumn(const int zBeg, const int zEnd, VoxelKernel&& iKernel) {
+  const int zInBeg= std::min(std::max(zBeg, 1), zEnd);
+  const int zInEnd= std::max(std::min(zEnd, nZ - 1), zInBeg);
+  for (int z= zBeg; z < zInBeg; z++)
+    iKernel(z, std::max(z - 1, 0), std::min(z + 1, nZ - 1));
+  for (int z= zInBeg; z < zInEnd; z++)
+    iKernel(z, z - 1, z + 1);
+  for (int z= zInEnd; z < zEnd; z++)
+    iKernel(z, std::max(z - 1, 0), std::min(z + 1, nZ - 1));
+}
+
+
+// Call the generic kernel with the field ID and the activity of the X dimension as compile time constants
+// Kernels are instantiated once per combination so their inner loops carry no field or dimension test
+// 2D cases lie in the YZ plane, so a single X plane is the only dead dimension the solvers need to drop
+template <typename FieldKernel>
+void CompuFluidDyna::DispatchFieldDim(const int iFieldID, FieldKernel&& iKernel) {
+  auto WithDim= [&](auto iFieldConst) {
+    if (nX > 1) iKernel(iFieldConst, std::true_type());
+    else iKernel(iFieldConst, std::false_type());
+  };
+  if (iFieldID == FieldID::IDSmok) WithDim(std::integral_constant<int, FieldID::IDSmok>());
+  if (iFieldID == FieldID::IDVelX) WithDim(std::integral_constant<int, FieldID::IDVelX>());
+  if (iFieldID == FieldID::IDVelY) WithDim(std::integral_constant<int, FieldID::IDVelY>());
+  if (iFieldID == FieldID::IDVelZ) WithDim(std::integral_constant<int, FieldID::IDVelZ>());
+  if (iFieldID == FieldID::IDPres) WithDim(std::integral_constant<int, FieldID::IDPres>());
+}
+
+
+// Get the sign of the voxel value mirrored across solid faces normal to each axis
+// Smoke and pressure have zero normal derivative, velocity has zero normal component and free slip
+constexpr std::array<float, 3> CompuFluidDyna::SolidBCSigns(const int iFieldID) {
+  if (iFieldID == FieldID::IDSmok || iFieldID == FieldID::IDPres) return {1.0f, 1.0f, 1.0f};
+  return {(iFieldID == FieldID::IDVelX) ? -1.0f : 0.0f,
+          (iFieldID == FieldID::IDVelY) ? -1.0f : 0.0f,
+          (iFieldID == FieldID::IDVelZ) ? -1.0f : 0.0f};
+}
+
+
+// Sum the neighbor values of voxel z in the Laplacian stencil, weighting by the face flags instead of branching
+// Neighbors outside the domain are skipped and solid neighbors take the mirrored voxel value
+// Mirror terms with a zero sign and the X neighbors of 2D cases are removed at compile time
+template <int FieldIDT, bool ActiveX>
+inline float CompuFluidDyna::StencilSum(const std::array<const float*, 5>& iCols, const uint16_t iFlags,
+                                        const int z, const int zN, const int zP) {
+  constexpr std::array<float, 3> bcSign= SolidBCSigns(FieldIDT);
+  auto Fluid= [iFlags](const int iDir) { return (float)((iFlags >> iDir) & 1u); };
+  auto Wall= [iFlags](const int iDir) { return (float)((iFlags >> (iDir + 8)) & 1u); };
+  const float val= iCols[0][z];
+  float sum= 0.0f;
+  if constexpr (ActiveX && bcSign[0] != 0.0f) {
+    sum+= Fluid(0) * iCols[1][z] + Wall(0) * (bcSign[0] * val);
+    sum+= Fluid(1) * iCols[2][z] + Wall(1) * (bcSign[0] * val);
+  }
+  else if constexpr (ActiveX) {
+    sum+= Fluid(0) * iCols[1][z];
+    sum+= Fluid(1) * iCols[2][z];
+  }
+  if constexpr (bcSign[1] != 0.0f) {
+    sum+= Fluid(2) * iCols[3][z] + Wall(2) * (bcSign[1] * val);
+    sum+= Fluid(3) * iCols[4][z] + Wall(3) * (bcSign[1] * val);
+  }
+  else {
+    sum+= Fluid(2) * iCols[3][z];
+    sum+= Fluid(3) * iCols[4][z];
+  }
+  if constexpr (bcSign[2] != 0.0f) {
+    sum+= Fluid(4) * iCols[0][zN] + Wall(4) * (bcSign[2] * val);
+    sum+= Fluid(5) * iCols[0][zP] + Wall(5) * (bcSign[2] * val);
+  }
+  else {
+    sum+= Fluid(4) * iCols[0][zN];
+    sum+= Fluid(5) * iCols[0][zP];
+  }
+  return sum;
+}
+
+
+// List the run fields sharing the sparse column storage, the lazily allocated ones stay empty until first use
+std::vector<std::vector<std::vector<std::vector<float>>>*> CompuFluidDyna::RunFields() {
+  return {&Pres, &Dive, &Smok, &VelX, &VelY, &VelZ, &OldStepVelX, &OldStepVelY, &OldStepVelZ, &OldStepPres};
+}
+
+
+// List the diagnostic run fields stored in reduced precision
+std::vector<std::vector<std::vector<std::vector<CompuFluidDyna::diag_float>>>*> CompuFluidDyna::DiagFields() {
+  return {&Dum0, &Dum1, &Dum2, &Dum3, &Dum4, &Vort, &Vmag, &CurX, &CurY, &CurZ, &AdvX, &AdvY, &AdvZ, &StrRate, &AdjSens};
+}
+
+
+// Allocate a field with storage only in the currently stored columns
+std::vector<std::vector<std::vector<float>>> CompuFluidDyna::AllocRunField(const float iVal) {
+  std::vector<std::vector<std::vector<float>>> field= Field::AllocField2D(nX, nY, std::vector<float>());
+  // Columns are first touched by the thread of their subdomain to place them in its local memory
+  SweepSubDomains([&](const int xBeg, const int xEnd, const int yBeg, const int yEnd) {
+    for (int x= xBeg; x < xEnd; x++)
+      for (int y= yBeg; y < yEnd; y++)
+        if (StoredCols[x][y]) field[x][y].assign(nZ, iVal);
+  });
+  return field;
+}
+
+
+// Allocate a reduced precision field with storage only in the currently stored columns
+std::vector<std::vector<std::vector<CompuFluidDyna::diag_float>>> CompuFluidDyna::AllocDiagField(const float iVal) {
+  std::vector<std::vector<std::vector<diag_float>>> field= Field::AllocField2D(nX, nY, std::vector<diag_float>());
+  SweepSubDomains([&](const int xBeg, const int xEnd, const int yBeg, const int yEnd) {
+    for (int x= xBeg; x < xEnd; x++)
+      for (int y= yBeg; y < yEnd; y++)
+        if (StoredCols[x][y]) field[x][y].assign(nZ, diag_float(iVal));
+  });
+  return field;
+}
+
+
+// Allocate the storage of the (x,y) column in all the run fields
+// A column without solid flags was all solid, the flag columns kept through the scenario setup are left as is
+void CompuFluidDyna::StoreColumn(const int x, const int y) {
+  if (StoredCols[x][y]) return;
+  StoredCols[x][y]= true;
+  for (std::vector<std::vector<std::vector<float>>>* field : RunFields())
+    if (!field->empty()) (*field)[x][y].assign(nZ, 0.0f);
+  for (std::vector<std::vector<std::vector<diag_float>>>* field : DiagFields())
+    if (!field->empty()) (*field)[x][y].assign(nZ, diag_float(0.0f));
+  if (Solid[x][y].empty()) Solid[x][y].assign(nZ, true);
+  if (FaceFlags[x][y].empty()) FaceFlags[x][y].assign(nZ, 0);
+  if (OptimAvoid[x][y].empty()) OptimAvoid[x][y].assign(nZ, false);
+}
+
+
+// Store the columns with fluid or interface voxels and release the others, whose voxels are all solid
+void CompuFluidDyna::CompactRunFields() {
+  int nbStored= 0;
+  for (int x= 0; x < nX; x++) {
+    for (int y= 0; y < nY; y++) {
+      if (!FluidSpans[x][y].empty() || !IfacSpans[x][y].empty()) {
+        StoreColumn(x, y);
+        nbStored++;
+        continue;
+      }
+      if (StoredCols[x][y]) {
+        StoredCols[x][y]= false;
+        for (std::vector<std::vector<std::vector<float>>>* field : RunFields())
+          if (!field->empty()) std::vector<float>().swap((*field)[x][y]);
+        for (std::vector<std::vector<std::vector<diag_float>>>* field : DiagFields())
+          if (!field->empty()) std::vector<diag_float>().swap((*field)[x][y]);
       }
+      std::vector<bool>().swap(Solid[x][y]);
+      std::vector<uint16_t>().swap(FaceFlags[x][y]);
+      std::vector<bool>().swap(OptimAvoid[x][y]);
     }
   }
+  if (D.UI[Verbose_____].GetB()) printf("Stored columns %d / %d\n", nbStored, nX * nY);
 }
 
 
+// Release the flag and forced value columns of the fields without boundary condition in the column
+// Boundary condition voxels are never solid, so the columns kept are a subset of the stored columns
+void CompuFluidDyna::CompactScenario() {
+  auto HasFlag= [&](const std::vector<bool>& iCol) {
+    return std::find(iCol.begin(), iCol.end(), true) != iCol.end();
+  };
+  int nbKept= 0;
+  for (int x= 0; x < nX; x++) {
+    for (int y= 0; y < nY; y++) {
+      if (!HasFlag(Scen->VelBC[x][y])) {
+        std::vector<bool>().swap(Scen->VelBC[x][y]);
+        std::vector<float>().swap(Scen->VelXForced[x][y]);
+        std::vector<float>().swap(Scen->VelYForced[x][y]);
+        std::vector<float>().swap(Scen->VelZForced[x][y]);
+      }
+      if (!HasFlag(Scen->PreBC[x][y])) {
+        std::vector<bool>().swap(Scen->PreBC[x][y]);
+        std::vector<float>().swap(Scen->PresForced[x][y]);
+      }
+      if (!HasFlag(Scen->SmoBC[x][y])) {
+        std::vector<bool>().swap(Scen->SmoBC[x][y]);
+        std::vector<float>().swap(Scen->SmokForced[x][y]);
+      }
+      if (!Scen->VelBC[x][y].empty() || !Scen->PreBC[x][y].empty() || !Scen->SmoBC[x][y].empty()) nbKept++;
+    }
+  }
+  if (D.UI[Verbose_____].GetB()) printf("Boundary condition columns %d / %d\n", nbKept, nX * nY);
+}
+
+
+// Field operations only sweep non-solid voxels, solid voxels hold zero in all solver fields
 // Addition of one field to an other
 void CompuFluidDyna::ImplicitFieldAdd(const std::vector<std::vector<std::vector<float>>>& iFieldA,
                                       const std::vector<std::vector<std::vector<float>>>& iFieldB,
                                       std::vector<std::vector<std::vector<float>>>& oField) {  
-  for (int x= 0; x < nX; x++)
-    for (int y= 0; y < nY; y++)
-      for (int z= 0; z < nZ; z++)
-        oField[x][y][z]= iFieldA[x][y][z] + iFieldB[x][y][z];        
+  SweepTiles(FluidSpans, [&](const int x, const int y, const int zBeg, const int zEnd) {
+    for (int z= zBeg; z < zEnd; z++)
+      oField[x][y][z]= iFieldA[x][y][z] + iFieldB[x][y][z];
+  });
 }
 
 // Multiplication of one field by an other
 void CompuFluidDyna::ImplicitFieldMult(const std::vector<std::vector<std::vector<float>>>& iFieldA,
                                       const std::vector<std::vector<std::vector<float>>>& iFieldB,
                                       std::vector<std::vector<std::vector<float>>>& oField) {
-  for (int x= 0; x < nX; x++)
-    for (int y= 0; y < nY; y++)
-      for (int z= 0; z < nZ; z++)
-        oField[x][y][z]= iFieldA[x][y][z] * iFieldB[x][y][z];
+  SweepTiles(FluidSpans, [&](const int x, const int y, const int zBeg, const int zEnd) {
+    for (int z= zBeg; z < zEnd; z++)
+      oField[x][y][z]= iFieldA[x][y][z] * iFieldB[x][y][z];
+  });
 }
 
 
@@ -503,10 +1351,10 @@ void CompuFluidDyna::ImplicitFieldMult(const std::vector<std::vector<std::vector
 void CompuFluidDyna::ImplicitFieldSub(const std::vector<std::vector<std::vector<float>>>& iFieldA,
                                       const std::vector<std::vector<std::vector<float>>>& iFieldB,
                                       std::vector<std::vector<std::vector<float>>>& oField) {
-  for (int x= 0; x < nX; x++)
-    for (int y= 0; y < nY; y++)
-      for (int z= 0; z < nZ; z++)
-        oField[x][y][z]= iFieldA[x][y][z] - iFieldB[x][y][z];
+  SweepTiles(FluidSpans, [&](const int x, const int y, const int zBeg, const int zEnd) {
+    for (int z= zBeg; z < zEnd; z++)
+      oField[x][y][z]= iFieldA[x][y][z] - iFieldB[x][y][z];
+  });
 }
 
 
@@ -514,22 +1362,29 @@ void CompuFluidDyna::ImplicitFieldSub(const std::vector<std::vector<std::vector<
 void CompuFluidDyna::ImplicitFieldScale(const float iVal,
                                         const std::vector<std::vector<std::vector<float>>>& iField,
                                         std::vector<std::vector<std::vector<float>>>& oField) {
-  for (int x= 0; x < nX; x++)
-    for (int y= 0; y < nY; y++)
-      for (int z= 0; z < nZ; z++)
-        oField[x][y][z]= iField[x][y][z] * iVal;
+  SweepTiles(FluidSpans, [&](const int x, const int y, const int zBeg, const int zEnd) {
+    for (int z= zBeg; z < zEnd; z++)
+      oField[x][y][z]= iField[x][y][z] * iVal;
+  });
 }
 
 
 // Dot product between two fields
 float CompuFluidDyna::ImplicitFieldDotProd(const std::vector<std::vector<std::vector<float>>>& iFieldA,
                                            const std::vector<std::vector<std::vector<float>>>& iFieldB) {
-  float val= 0.0f;
-  for (int x= 0; x < nX; x++)
-    for (int y= 0; y < nY; y++)
-      for (int z= 0; z < nZ; z++)
-        val+= iFieldA[x][y][z] * iFieldB[x][y][z];
-  return val;
+  // Accumulate per column within the subdomains before the ordered global sum
+  SweepSubDomains([&](const int xBeg, const int xEnd, const int yBeg, const int yEnd) {
+    for (int x= xBeg; x < xEnd; x++) {
+      for (int y= yBeg; y < yEnd; y++) {
+        float val= 0.0f;
+        for (std::array<int, 2> span : FluidSpans[x][y])
+          for (int z= span[0]; z < span[1]; z++)
+            val+= iFieldA[x][y][z] * iFieldB[x][y][z];
+        ColPartial[x][y]= val;
+      }
+    }
+  });
+  return ReduceColPartial();
 }
 
 
@@ -540,45 +1395,36 @@ void CompuFluidDyna::ImplicitFieldLaplacianMatMult(const int iFieldID, const flo
                                                    std::vector<std::vector<std::vector<float>>>& oField) {
   // Precompute value
   const float diffuVal= iDiffuCoeff * iTimeStep / (voxSize * voxSize);
-  // Sweep through the field
-  for (int x= 0; x < nX; x++) {
-    for (int y= 0; y < nY; y++) {
-      for (int z= 0; z < nZ; z++) {
-        // Skip solid or fixed values
-        if (Solid[x][y][z]) continue;
-        if (SmoBC[x][y][z] && iFieldID == FieldID::IDSmok) continue;
-        if (VelBC[x][y][z] && (iFieldID == FieldID::IDVelX || iFieldID == FieldID::IDVelY || iFieldID == FieldID::IDVelZ)) continue;
-        if (PreBC[x][y][z] && iFieldID == FieldID::IDPres) continue;
+  // Sweep through the voxels without solid or fixed values with the kernel specialized for the field and dimensionality
+  DispatchFieldDim(iFieldID, [&](auto iFieldConst, auto iActiveX) {
+    constexpr int fieldID= decltype(iFieldConst)::value;
+    constexpr bool activeX= decltype(iActiveX)::value;
+    SweepTiles(FreeSpans[fieldID], [&](const int x, const int y, const int zBeg, const int zEnd) {
+      const std::array<const float*, 5> cols= NeighborCols(iField, x, y);
+      const uint16_t* flags= FaceFlags[x][y].data();
+      const float* val= cols[0];
+      float* out= oField[x][y].data();
+      const int countXY= (activeX ? (x > 0) + (x < nX - 1) : 0) + (y > 0) + (y < nY - 1);
+      SweepColumn(zBeg, zEnd, [&](const int z, const int zN, const int zP) {
         // Get count and sum of valid neighbors
-        const int count= (x > 0) + (y > 0) + (z > 0) + (x < nX - 1) + (y < nY - 1) + (z < nZ - 1);
-        float sum= 0.0f;
-        if (!iPrecondMode) {
-          const float xBCVal= (iFieldID == FieldID::IDSmok || iFieldID == FieldID::IDPres) ? (iField[x][y][z]) : (iFieldID == FieldID::IDVelX ? -iField[x][y][z] : 0.0f);
-          const float yBCVal= (iFieldID == FieldID::IDSmok || iFieldID == FieldID::IDPres) ? (iField[x][y][z]) : (iFieldID == FieldID::IDVelY ? -iField[x][y][z] : 0.0f);
-          const float zBCVal= (iFieldID == FieldID::IDSmok || iFieldID == FieldID::IDPres) ? (iField[x][y][z]) : (iFieldID == FieldID::IDVelZ ? -iField[x][y][z] : 0.0f);
-          if (x - 1 >= 0) sum+= Solid[x - 1][y][z] ? xBCVal : iField[x - 1][y][z];
-          if (x + 1 < nX) sum+= Solid[x + 1][y][z] ? xBCVal : iField[x + 1][y][z];
-          if (y - 1 >= 0) sum+= Solid[x][y - 1][z] ? yBCVal : iField[x][y - 1][z];
-          if (y + 1 < nY) sum+= Solid[x][y + 1][z] ? yBCVal : iField[x][y + 1][z];
-          if (z - 1 >= 0) sum+= Solid[x][y][z - 1] ? zBCVal : iField[x][y][z - 1];
-          if (z + 1 < nZ) sum+= Solid[x][y][z + 1] ? zBCVal : iField[x][y][z + 1];
-        }
+        const int count= countXY + (z > 0) + (z < nZ - 1);
+        const float sum= iPrecondMode ? 0.0f : StencilSum<fieldID, activeX>(cols, flags[z], z, zN, zP);
         // Apply linear expression
         if (iDiffuMode) {
           if (iPrecondMode)
-            oField[x][y][z]= 1.0f / (1.0f + diffuVal * (float)count) * iField[x][y][z];            //               [   -D*dt/(h*h)]
-          else                                                                                     // [-D*dt/(h*h)] [1+4*D*dt/(h*h)] [-D*dt/(h*h)]
-            oField[x][y][z]= (1.0f + diffuVal * (float)count) * iField[x][y][z] - diffuVal * sum;  //               [   -D*dt/(h*h)]
+            out[z]= 1.0f / (1.0f + diffuVal * (float)count) * val[z];            //               [   -D*dt/(h*h)]
+          else                                                                   // [-D*dt/(h*h)] [1+4*D*dt/(h*h)] [-D*dt/(h*h)]
+            out[z]= (1.0f + diffuVal * (float)count) * val[z] - diffuVal * sum;  //               [   -D*dt/(h*h)]
         }
         else {
           if (iPrecondMode)
-            oField[x][y][z]= ((voxSize * voxSize) / (float)count) * iField[x][y][z];        //            [-1/(h*h)]
-          else                                                                              // [-1/(h*h)] [ 4/(h*h)] [-1/(h*h)]
-            oField[x][y][z]= ((float)count * iField[x][y][z] - sum) / (voxSize * voxSize);  //            [-1/(h*h)]
+            out[z]= ((voxSize * voxSize) / (float)count) * val[z];        //            [-1/(h*h)]
+          else                                                            // [-1/(h*h)] [ 4/(h*h)] [-1/(h*h)]
+            out[z]= ((float)count * val[z] - sum) / (voxSize * voxSize);  //            [-1/(h*h)]
         }
-      }
-    }
-  }
+      });
+    });
+  });
 }
 
 
@@ -605,11 +1451,11 @@ void CompuFluidDyna::ConjugateGradientSolve(const int iFieldID, const int iMaxIt
     D.plotData[iFieldID].clear();
   }
   // Allocate fields
-  std::vector<std::vector<std::vector<float>>> rField= Field::AllocField3D(nX, nY, nZ, 0.0f);
-  std::vector<std::vector<std::vector<float>>> qField= Field::AllocField3D(nX, nY, nZ, 0.0f);
-  std::vector<std::vector<std::vector<float>>> dField= Field::AllocField3D(nX, nY, nZ, 0.0f);
-  std::vector<std::vector<std::vector<float>>> t0Field= Field::AllocField3D(nX, nY, nZ, 0.0f);
-  std::vector<std::vector<std::vector<float>>> t1Field= Field::AllocField3D(nX, nY, nZ, 0.0f);
+  std::vector<std::vector<std::vector<float>>> rField= AllocRunField(0.0f);
+  std::vector<std::vector<std::vector<float>>> qField= AllocRunField(0.0f);
+  std::vector<std::vector<std::vector<float>>> dField= AllocRunField(0.0f);
+  std::vector<std::vector<std::vector<float>>> t0Field= AllocRunField(0.0f);
+  std::vector<std::vector<std::vector<float>>> t1Field= AllocRunField(0.0f);
   // Compute residual error magnitude    r = b - A x    errNew = r · r
   ImplicitFieldLaplacianMatMult(iFieldID, iTimeStep, iDiffuMode, iDiffuCoeff, false, ioField, t0Field);
   ApplyBC(iFieldID, t0Field);
@@ -663,21 +1509,59 @@ void CompuFluidDyna::ConjugateGradientSolve(const int iFieldID, const int iMaxIt
   }
   // Error plot
   if (D.UI[VerboseSolv_].GetB()) {
-    if (iFieldID == FieldID::IDSmok) Dum0= rField;
-    if (iFieldID == FieldID::IDVelX) Dum1= rField;
-    if (iFieldID == FieldID::IDVelY) Dum2= rField;
-    if (iFieldID == FieldID::IDVelZ) Dum3= rField;
-    if (iFieldID == FieldID::IDPres) Dum4= rField;
+    if (iFieldID == FieldID::IDSmok) Field::ConvertField3D(rField, Dum0);
+    if (iFieldID == FieldID::IDVelX) Field::ConvertField3D(rField, Dum1);
+    if (iFieldID == FieldID::IDVelY) Field::ConvertField3D(rField, Dum2);
+    if (iFieldID == FieldID::IDVelZ) Field::ConvertField3D(rField, Dum3);
+    if (iFieldID == FieldID::IDPres) Field::ConvertField3D(rField, Dum4);
   }
 }
 
 
-// Solve linear system with Gradient descent approach
-// Reference on page 55 of https://www.cs.cmu.edu/~quake-papers/painless-conjugate-gradient.pdf
-void CompuFluidDyna::GradientDescentSolve(const int iFieldID, const int iMaxIter, const float iTimeStep,
-                                          const bool iDiffuMode, const float iDiffuCoeff,
-                                          const std::vector<std::vector<std::vector<float>>>& iField,
-                                          std::vector<std::vector<std::vector<float>>>& ioField) {
+// Perform the diffusion matrix-vector multiplication of the active velocity components in a single sweep
+// The components share the free spans, face flags and neighbor counts, only their solid mirror signs differ
+void CompuFluidDyna::ImplicitVelLaplacianMatMult(const float iTimeStep, const float iDiffuCoeff, const std::array<bool, 3>& iActive,
+                                                 const std::array<const std::vector<std::vector<std::vector<float>>>*, 3>& iFields,
+                                                 const std::array<std::vector<std::vector<std::vector<float>>>*, 3>& oFields) {
+  // Precompute value
+  const float diffuVal= iDiffuCoeff * iTimeStep / (voxSize * voxSize);
+  // Sweep through the voxels without solid or fixed velocity, shared by the three components
+  auto SweepVel= [&](auto iActiveX) {
+    constexpr bool activeX= decltype(iActiveX)::value;
+    SweepTiles(FreeSpans[FieldID::IDVelX], [&](const int x, const int y, const int zBeg, const int zEnd) {
+      std::array<std::array<const float*, 5>, 3> cols;
+      std::array<float*, 3> out;
+      for (int c= 0; c < 3; c++) {
+        if (!iActive[c]) continue;
+        cols[c]= NeighborCols(*iFields[c], x, y);
+        out[c]= (*oFields[c])[x][y].data();
+      }
+      const uint16_t* flags= FaceFlags[x][y].data();
+      const int countXY= (activeX ? (x > 0) + (x < nX - 1) : 0) + (y > 0) + (y < nY - 1);
+      SweepColumn(zBeg, zEnd, [&](const int z, const int zN, const int zP) {
+        // Get count of valid neighbors and apply the linear expression to each component
+        const float diagVal= 1.0f + diffuVal * (float)(countXY + (z > 0) + (z < nZ - 1));
+        if (activeX && iActive[0]) out[0][z]= diagVal * cols[0][0][z] - diffuVal * StencilSum<FieldID::IDVelX, activeX>(cols[0], flags[z], z, zN, zP);
+        if (iActive[1]) out[1][z]= diagVal * cols[1][0][z] - diffuVal * StencilSum<FieldID::IDVelY, activeX>(cols[1], flags[z], z, zN, zP);
+        if (iActive[2]) out[2][z]= diagVal * cols[2][0][z] - diffuVal * StencilSum<FieldID::IDVelZ, activeX>(cols[2], flags[z], z, zN, zP);
+      });
+    });
+  };
+  if (nX > 1) SweepVel(std::true_type());
+  else SweepVel(std::false_type());
+}
+
+
+// Solve the diffusion systems of the velocity components along the dimensions of the domain with lockstep Conjugate Gradients
+// - Each component keeps its own step sizes and convergence checks, converged components are frozen while the others continue
+// - Operator products and vector updates of the live components are fused in single sweeps so the spans,
+//   face flags and neighbor counts are streamed once per iteration instead of once per component
+// - Each component follows exactly the iterates of ConjugateGradientSolve
+void CompuFluidDyna::BlockConjugateGradientSolve(const int iMaxIter, const float iTimeStep, const float iDiffuCoeff,
+                                                 const std::array<const std::vector<std::vector<std::vector<float>>>*, 3>& iFields,
+                                                 const std::array<std::vector<std::vector<std::vector<float>>>*, 3>& ioFields) {
+  const std::array<int, 3> fieldIDs= {FieldID::IDVelX, FieldID::IDVelY, FieldID::IDVelZ};
+  const std::array<bool, 3> isSolved= {nX > 1, nY > 1, nZ > 1};
   // Prepare convergence plot
   if (D.UI[VerboseSolv_].GetB()) {
     D.plotLegend.resize(5);
@@ -687,17 +1571,138 @@ void CompuFluidDyna::GradientDescentSolve(const int iFieldID, const int iMaxIter
     D.plotLegend[FieldID::IDVelZ]= "Diffu VZ";
     D.plotLegend[FieldID::IDPres]= "Proj  P";
     D.plotData.resize(5);
-    D.plotData[iFieldID].clear();
+    for (int c= 0; c < 3; c++)
+      if (isSolved[c]) D.plotData[fieldIDs[c]].clear();
   }
   // Allocate fields
-  std::vector<std::vector<std::vector<float>>> rField= Field::AllocField3D(nX, nY, nZ, 0.0f);
-  std::vector<std::vector<std::vector<float>>> qField= Field::AllocField3D(nX, nY, nZ, 0.0f);
-  std::vector<std::vector<std::vector<float>>> t0Field= Field::AllocField3D(nX, nY, nZ, 0.0f);
-  std::vector<std::vector<std::vector<float>>> t1Field= Field::AllocField3D(nX, nY, nZ, 0.0f);
-  // Compute residual error magnitude    r = b - A x    errNew = r · r
-  ImplicitFieldLaplacianMatMult(iFieldID, iTimeStep, iDiffuMode, iDiffuCoeff, false, ioField, t0Field);
-  ApplyBC(iFieldID, t0Field);
-  ImplicitFieldSub(iField, t0Field, rField);
+  std::array<std::vector<std::vector<std::vector<float>>>, 3> rField, qField, dField;
+  std::array<const std::vector<std::vector<std::vector<float>>>*, 3> dFieldRef;
+  std::array<std::vector<std::vector<std::vector<float>>>*, 3> qFieldRef;
+  for (int c= 0; c < 3; c++) {
+    if (!isSolved[c]) continue;
+    rField[c]= AllocRunField(0.0f);
+    qField[c]= AllocRunField(0.0f);
+    dFieldRef[c]= &dField[c];
+    qFieldRef[c]= &qField[c];
+  }
+  // Compute residual error magnitudes    r = b - A x    errNew = r · r
+  std::array<float, 3> errBeg= {0.0f, 0.0f, 0.0f}, normRHS= {0.0f, 0.0f, 0.0f}, errNew= {0.0f, 0.0f, 0.0f}, alpha, beta;
+  std::array<std::vector<std::vector<std::vector<float>>>, 3> t0Field;
+  std::array<std::vector<std::vector<std::vector<float>>>*, 3> t0FieldRef;
+  for (int c= 0; c < 3; c++) {
+    if (!isSolved[c]) continue;
+    t0Field[c]= AllocRunField(0.0f);
+    t0FieldRef[c]= &t0Field[c];
+  }
+  ImplicitVelLaplacianMatMult(iTimeStep, iDiffuCoeff, isSolved, {ioFields[0], ioFields[1], ioFields[2]}, t0FieldRef);
+  for (int c= 0; c < 3; c++) {
+    if (!isSolved[c]) continue;
+    ApplyBC(fieldIDs[c], t0Field[c]);
+    ImplicitFieldSub(*iFields[c], t0Field[c], rField[c]);
+    errBeg[c]= ImplicitFieldDotProd(rField[c], rField[c]);
+    normRHS[c]= ImplicitFieldDotProd(*iFields[c], *iFields[c]);
+    errNew[c]= errBeg[c];
+    dField[c]= rField[c];
+    if (D.UI[VerboseSolv_].GetB()) D.plotData[fieldIDs[c]].push_back(errNew[c]);
+    std::vector<std::vector<std::vector<float>>>().swap(t0Field[c]);
+  }
+  // Iterate to solve
+  std::array<bool, 3> isLive= isSolved;
+  for (int idxIter= 0; idxIter < iMaxIter; idxIter++) {
+    // Check exit conditions of each component
+    for (int c= 0; c < 3; c++) {
+      if (!isLive[c]) continue;
+      if (errNew[c] <= D.UI[SolvTolAbs__].GetF()) isLive[c]= false;
+      else if (errNew[c] / normRHS[c] <= std::max(D.UI[SolvTolRhs__].GetF(), 0.0f)) isLive[c]= false;
+      else if (errNew[c] / errBeg[c] <= std::max(D.UI[SolvTolRel__].GetF(), 0.0f)) isLive[c]= false;
+    }
+    if (!isLive[0] && !isLive[1] && !isLive[2]) break;
+    // q = A d
+    ImplicitVelLaplacianMatMult(iTimeStep, iDiffuCoeff, isLive, dFieldRef, qFieldRef);
+    // alpha = errNew / (d^T q)
+    for (int c= 0; c < 3; c++) {
+      if (!isLive[c]) continue;
+      const float denom= ImplicitFieldDotProd(dField[c], qField[c]);
+      if (denom == 0.0) isLive[c]= false;
+      else alpha[c]= errNew[c] / denom;
+    }
+    // x = x + alpha d    r = r - alpha q
+    SweepTiles(FluidSpans, [&](const int x, const int y, const int zBeg, const int zEnd) {
+      for (int c= 0; c < 3; c++) {
+        if (!isLive[c]) continue;
+        float* xCol= (*ioFields[c])[x][y].data();
+        float* rCol= rField[c][x][y].data();
+        const float* dCol= dField[c][x][y].data();
+        const float* qCol= qField[c][x][y].data();
+        for (int z= zBeg; z < zEnd; z++) {
+          xCol[z]= xCol[z] + dCol[z] * alpha[c];
+          rCol[z]= rCol[z] - qCol[z] * alpha[c];
+        }
+      }
+    });
+    // errNew = r^T r
+    for (int c= 0; c < 3; c++) {
+      if (!isLive[c]) continue;
+      ApplyBC(fieldIDs[c], *ioFields[c]);
+      const float errOld= errNew[c];
+      errNew[c]= ImplicitFieldDotProd(rField[c], rField[c]);
+      beta[c]= errNew[c] / errOld;
+      if (D.UI[VerboseSolv_].GetB()) D.plotData[fieldIDs[c]].push_back(errNew[c]);
+    }
+    // d = r + (errNew / errOld) * d
+    SweepTiles(FluidSpans, [&](const int x, const int y, const int zBeg, const int zEnd) {
+      for (int c= 0; c < 3; c++) {
+        if (!isLive[c]) continue;
+        const float* rCol= rField[c][x][y].data();
+        float* dCol= dField[c][x][y].data();
+        for (int z= zBeg; z < zEnd; z++)
+          dCol[z]= rCol[z] + dCol[z] * beta[c];
+      }
+    });
+  }
+  // Error plot
+  if (D.UI[VerboseSolv_].GetB()) {
+    for (int c= 0; c < 3; c++) {
+      if (!isSolved[c]) continue;
+      if (c == 0) printf("\nCG Diffu VX [%.2e] ", normRHS[c]);
+      if (c == 1) printf("\nCG Diffu VY [%.2e] ", normRHS[c]);
+      if (c == 2) printf("\nCG Diffu VZ [%.2e] ", normRHS[c]);
+      for (const double err : D.plotData[fieldIDs[c]])
+        printf("%.2e ", err);
+    }
+    if (isSolved[0]) Field::ConvertField3D(rField[0], Dum1);
+    if (isSolved[1]) Field::ConvertField3D(rField[1], Dum2);
+    if (isSolved[2]) Field::ConvertField3D(rField[2], Dum3);
+  }
+}
+
+
+// Solve linear system with Gradient descent approach
+// Reference on page 55 of https://www.cs.cmu.edu/~quake-papers/painless-conjugate-gradient.pdf
+void CompuFluidDyna::GradientDescentSolve(const int iFieldID, const int iMaxIter, const float iTimeStep,
+                                          const bool iDiffuMode, const float iDiffuCoeff,
+                                          const std::vector<std::vector<std::vector<float>>>& iField,
+                                          std::vector<std::vector<std::vector<float>>>& ioField) {
+  // Prepare convergence plot
+  if (D.UI[VerboseSolv_].GetB()) {
+    D.plotLegend.resize(5);
+    D.plotLegend[FieldID::IDSmok]= "Diffu S";
+    D.plotLegend[FieldID::IDVelX]= "Diffu VX";
+    D.plotLegend[FieldID::IDVelY]= "Diffu VY";
+    D.plotLegend[FieldID::IDVelZ]= "Diffu VZ";
+    D.plotLegend[FieldID::IDPres]= "Proj  P";
+    D.plotData.resize(5);
+    D.plotData[iFieldID].clear();
+  }
+  // Allocate fields
+  std::vector<std::vector<std::vector<float>>> rField= AllocRunField(0.0f);
+  std::vector<std::vector<std::vector<float>>> qField= AllocRunField(0.0f);
+  std::vector<std::vector<std::vector<float>>> t0Field= AllocRunField(0.0f);
+  std::vector<std::vector<std::vector<float>>> t1Field= AllocRunField(0.0f);
+  // Compute residual error magnitude    r = b - A x    errNew = r · r
+  ImplicitFieldLaplacianMatMult(iFieldID, iTimeStep, iDiffuMode, iDiffuCoeff, false, ioField, t0Field);
+  ApplyBC(iFieldID, t0Field);
+  ImplicitFieldSub(iField, t0Field, rField);
   const float errBeg= ImplicitFieldDotProd(rField, rField);
   const float normRHS= ImplicitFieldDotProd(iField, iField);
   float errNew= errBeg;
@@ -743,11 +1748,11 @@ void CompuFluidDyna::GradientDescentSolve(const int iFieldID, const int iMaxIter
   }
   // Error plot
   if (D.UI[VerboseSolv_].GetB()) {
-    if (iFieldID == FieldID::IDSmok) Dum0= rField;
-    if (iFieldID == FieldID::IDVelX) Dum1= rField;
-    if (iFieldID == FieldID::IDVelY) Dum2= rField;
-    if (iFieldID == FieldID::IDVelZ) Dum3= rField;
-    if (iFieldID == FieldID::IDPres) Dum4= rField;
+    if (iFieldID == FieldID::IDSmok) Field::ConvertField3D(rField, Dum0);
+    if (iFieldID == FieldID::IDVelX) Field::ConvertField3D(rField, Dum1);
+    if (iFieldID == FieldID::IDVelY) Field::ConvertField3D(rField, Dum2);
+    if (iFieldID == FieldID::IDVelZ) Field::ConvertField3D(rField, Dum3);
+    if (iFieldID == FieldID::IDPres) Field::ConvertField3D(rField, Dum4);
   }
 }
 
@@ -772,8 +1777,8 @@ void CompuFluidDyna::GaussSeidelSolve(const int iFieldID, const int iMaxIter, co
     D.plotData[iFieldID].clear();
   }
   // Allocate fields
-  std::vector<std::vector<std::vector<float>>> rField= Field::AllocField3D(nX, nY, nZ, 0.0f);
-  std::vector<std::vector<std::vector<float>>> t0Field= Field::AllocField3D(nX, nY, nZ, 0.0f);
+  std::vector<std::vector<std::vector<float>>> rField= AllocRunField(0.0f);
+  std::vector<std::vector<std::vector<float>>> t0Field= AllocRunField(0.0f);
   std::vector<std::vector<std::vector<std::vector<float>>>> FieldT(2);
   // Compute residual error magnitude    r = b - A x    errNew = r · r
   ImplicitFieldLaplacianMatMult(iFieldID, iTimeStep, iDiffuMode, iDiffuCoeff, false, ioField, t0Field);
@@ -795,6 +1800,13 @@ void CompuFluidDyna::GaussSeidelSolve(const int iFieldID, const int iMaxIter, co
   // Precompute values
   const float diffuVal= iDiffuCoeff * iTimeStep / (voxSize * voxSize);
   const float coeffOverrelax= std::max(D.UI[SolvSOR_____].GetF(), 0.0f);
+  // Get the tiling of the passes, a tile can be relaxed several times before moving to the next one
+  int tileX, tileY, tileZ;
+  GetTileSizes(tileX, tileY, tileZ);
+  const int nbTileX= (nX + tileX - 1) / tileX;
+  const int nbTileY= (nY + tileY - 1) / tileY;
+  const int nbTileZ= (nZ + tileZ - 1) / tileZ;
+  const int nbSweeps= std::max(D.UI[TileSweeps__].GetI(), 1);
   // Iterate to solve with Gauss-Seidel scheme
   for (int idxIter= 0; idxIter < iMaxIter; idxIter++) {
     // Check exit conditions
@@ -804,56 +1816,61 @@ void CompuFluidDyna::GaussSeidelSolve(const int iFieldID, const int iMaxIter, co
     // Initialize fields for forward and backward passes
     FieldT[0]= ioField;
     FieldT[1]= ioField;
-    // Execute the two passes in parallel
+    // Execute the two passes in parallel with the relaxation kernel specialized for the field and dimensionality
+    DispatchFieldDim(iFieldID, [&](auto iFieldConst, auto iActiveX) {
+      constexpr int fieldID= decltype(iFieldConst)::value;
+      constexpr bool activeX= decltype(iActiveX)::value;
 #pragma omp parallel for
-    for (int k= 0; k < 2; k++) {
-      // Set the loop settings for the current pass
-      const int xBeg= (k == 0) ? 0 : nX - 1;
-      const int yBeg= (k == 0) ? 0 : nY - 1;
-      const int zBeg= (k == 0) ? 0 : nZ - 1;
-      const int xEnd= (k == 0) ? nX : -1;
-      const int yEnd= (k == 0) ? nY : -1;
-      const int zEnd= (k == 0) ? nZ : -1;
-      const int xInc= (k == 0) ? 1 : -1;
-      const int yInc= (k == 0) ? 1 : -1;
-      const int zInc= (k == 0) ? 1 : -1;
-      // Sweep through the field
-      for (int x= xBeg; x != xEnd; x+= xInc) {
-        for (int y= yBeg; y != yEnd; y+= yInc) {
-          for (int z= zBeg; z != zEnd; z+= zInc) {
-            // Skip solid or fixed values
-            if (Solid[x][y][z]) continue;
-            if (SmoBC[x][y][z] && iFieldID == FieldID::IDSmok) continue;
-            if (VelBC[x][y][z] && (iFieldID == FieldID::IDVelX || iFieldID == FieldID::IDVelY || iFieldID == FieldID::IDVelZ)) continue;
-            if (PreBC[x][y][z] && iFieldID == FieldID::IDPres) continue;
-            // Get count and sum of valid neighbors
-            const int count= (x > 0) + (y > 0) + (z > 0) + (x < nX - 1) + (y < nY - 1) + (z < nZ - 1);
-            float sum= 0.0f;
-            const float xBCVal= (iFieldID == FieldID::IDSmok || iFieldID == FieldID::IDPres) ? (FieldT[k][x][y][z]) : (iFieldID == FieldID::IDVelX ? -FieldT[k][x][y][z] : 0.0f);
-            const float yBCVal= (iFieldID == FieldID::IDSmok || iFieldID == FieldID::IDPres) ? (FieldT[k][x][y][z]) : (iFieldID == FieldID::IDVelY ? -FieldT[k][x][y][z] : 0.0f);
-            const float zBCVal= (iFieldID == FieldID::IDSmok || iFieldID == FieldID::IDPres) ? (FieldT[k][x][y][z]) : (iFieldID == FieldID::IDVelZ ? -FieldT[k][x][y][z] : 0.0f);
-            if (x - 1 >= 0) sum+= Solid[x - 1][y][z] ? xBCVal : FieldT[k][x - 1][y][z];
-            if (x + 1 < nX) sum+= Solid[x + 1][y][z] ? xBCVal : FieldT[k][x + 1][y][z];
-            if (y - 1 >= 0) sum+= Solid[x][y - 1][z] ? yBCVal : FieldT[k][x][y - 1][z];
-            if (y + 1 < nY) sum+= Solid[x][y + 1][z] ? yBCVal : FieldT[k][x][y + 1][z];
-            if (z - 1 >= 0) sum+= Solid[x][y][z - 1] ? zBCVal : FieldT[k][x][y][z - 1];
-            if (z + 1 < nZ) sum+= Solid[x][y][z + 1] ? zBCVal : FieldT[k][x][y][z + 1];
-            // Set new value according to coefficients and flags
-            if (count > 0) {
-              const float prevVal= FieldT[k][x][y][z];
-              if (iDiffuMode) FieldT[k][x][y][z]= (iField[x][y][z] + diffuVal * sum) / (1.0f + diffuVal * (float)count);
-              else FieldT[k][x][y][z]= ((voxSize * voxSize) * iField[x][y][z] + sum) / (float)count;
-              FieldT[k][x][y][z]= prevVal + coeffOverrelax * (FieldT[k][x][y][z] - prevVal);
+      for (int k= 0; k < 2; k++) {
+        // Sweep through the tiles in the order of the current pass
+        for (int iTX= 0; iTX < nbTileX; iTX++) {
+          for (int iTY= 0; iTY < nbTileY; iTY++) {
+            for (int iTZ= 0; iTZ < nbTileZ; iTZ++) {
+              const int xLo= ((k == 0) ? iTX : nbTileX - 1 - iTX) * tileX, xHi= std::min(xLo + tileX, nX);
+              const int yLo= ((k == 0) ? iTY : nbTileY - 1 - iTY) * tileY, yHi= std::min(yLo + tileY, nY);
+              const int zLo= ((k == 0) ? iTZ : nbTileZ - 1 - iTZ) * tileZ, zHi= std::min(zLo + tileZ, nZ);
+              // Relax the tile several times while it is cache resident
+              for (int idxSweep= 0; idxSweep < nbSweeps; idxSweep++) {
+                // Sweep through the voxels without solid or fixed values
+                for (int i= 0; i < xHi - xLo; i++) {
+                  const int x= (k == 0) ? xLo + i : xHi - 1 - i;
+                  for (int j= 0; j < yHi - yLo; j++) {
+                    const int y= (k == 0) ? yLo + j : yHi - 1 - j;
+                    const std::vector<std::array<int, 2>>& spans= FreeSpans[fieldID][x][y];
+                    for (int s= 0; s < (int)spans.size(); s++) {
+                      const std::array<int, 2>& span= spans[(k == 0) ? s : (int)spans.size() - 1 - s];
+                      const int zBeg= std::max(span[0], zLo);
+                      const int zEnd= std::min(span[1], zHi);
+                      const std::array<const float*, 5> cols= NeighborCols(FieldT[k], x, y);
+                      const int countXY= (activeX ? (x > 0) + (x < nX - 1) : 0) + (y > 0) + (y < nY - 1);
+                      for (int l= 0; l < zEnd - zBeg; l++) {
+                        const int z= (k == 0) ? zBeg + l : zEnd - 1 - l;
+                        // Get count and sum of valid neighbors
+                        const int count= countXY + (z > 0) + (z < nZ - 1);
+                        const float sum= StencilSum<fieldID, activeX>(cols, FaceFlags[x][y][z], z, std::max(z - 1, 0), std::min(z + 1, nZ - 1));
+                        // Set new value according to coefficients and flags
+                        if (count > 0) {
+                          const float prevVal= FieldT[k][x][y][z];
+                          if (iDiffuMode) FieldT[k][x][y][z]= (iField[x][y][z] + diffuVal * sum) / (1.0f + diffuVal * (float)count);
+                          else FieldT[k][x][y][z]= ((voxSize * voxSize) * iField[x][y][z] + sum) / (float)count;
+                          FieldT[k][x][y][z]= prevVal + coeffOverrelax * (FieldT[k][x][y][z] - prevVal);
+                        }
+                      }
+                    }
+                  }
+                }
+              }
             }
           }
         }
       }
-    }
+    });
     // Recombine forward and backward passes
     for (int x= 0; x < nX; x++)
       for (int y= 0; y < nY; y++)
-        for (int z= 0; z < nZ; z++)
-          ioField[x][y][z]= (FieldT[0][x][y][z] + FieldT[1][x][y][z]) / 2.0f;
+        for (std::array<int, 2> span : FreeSpans[iFieldID][x][y])
+          for (int z= span[0]; z < span[1]; z++)
+            ioField[x][y][z]= (FieldT[0][x][y][z] + FieldT[1][x][y][z]) / 2.0f;
     // Compute residual error magnitude    r = b - A x    errNew = r · r
     ImplicitFieldLaplacianMatMult(iFieldID, iTimeStep, iDiffuMode, iDiffuCoeff, false, ioField, t0Field);
     ApplyBC(iFieldID, t0Field);
@@ -867,12 +1884,378 @@ void CompuFluidDyna::GaussSeidelSolve(const int iFieldID, const int iMaxIter, co
   }
   // Error plot
   if (D.UI[VerboseSolv_].GetB()) {
-    if (iFieldID == FieldID::IDSmok) Dum0= rField;
-    if (iFieldID == FieldID::IDVelX) Dum1= rField;
-    if (iFieldID == FieldID::IDVelY) Dum2= rField;
-    if (iFieldID == FieldID::IDVelZ) Dum3= rField;
-    if (iFieldID == FieldID::IDPres) Dum4= rField;
+    if (iFieldID == FieldID::IDSmok) Field::ConvertField3D(rField, Dum0);
+    if (iFieldID == FieldID::IDVelX) Field::ConvertField3D(rField, Dum1);
+    if (iFieldID == FieldID::IDVelY) Field::ConvertField3D(rField, Dum2);
+    if (iFieldID == FieldID::IDVelZ) Field::ConvertField3D(rField, Dum3);
+    if (iFieldID == FieldID::IDPres) Field::ConvertField3D(rField, Dum4);
+  }
+}
+
+
+// Analyze whether the free pressure voxels fit the direct solver and cache the layout
+// The free voxels must fill an axis aligned box, once the outer layers holding enforced pressure voxels are peeled off
+// Each axis of the box is either closed by solid voxels or the domain boundary on both sides (Neumann, DCT-II)
+// or bordered by enforced pressure voxels on both sides (Dirichlet, DST-I)
+// Free voxels left in the peeled layers, like the corners of the moving walls in the Couette and Poiseuille scenarios,
+// are coupled to the box through a small dense capacitance system, which requires a single Dirichlet axis
+// References for capacitance matrix methods
+// https://en.wikipedia.org/wiki/Schur_complement#Application_to_solving_linear_equations
+void CompuFluidDyna::SpectralLayout() {
+  isSpectralValid= true;
+  isSpectralBox= false;
+  SpectralExtra.clear();
+  SpectralExtraNbr.clear();
+  SpectralCapa.clear();
+  SpectralPivot.clear();
+
+  // Get the bounding box and count of the free pressure voxels
+  std::array<int, 3> beg= {nX, nY, nZ}, end= {0, 0, 0};
+  long long nbFree= 0;
+  for (int x= 0; x < nX; x++) {
+    for (int y= 0; y < nY; y++) {
+      for (std::array<int, 2> span : FreeSpans[FieldID::IDPres][x][y]) {
+        beg= {std::min(beg[0], x), std::min(beg[1], y), std::min(beg[2], span[0])};
+        end= {std::max(end[0], x + 1), std::max(end[1], y + 1), std::max(end[2], span[1])};
+        nbFree+= span[1] - span[0];
+      }
+    }
+  }
+  if (nbFree == 0) return;
+
+  // Sweep the layer at the given position along an axis, within the lateral extent of the box
+  const std::array<int, 3> dims= {nX, nY, nZ};
+  auto SweepLayer= [&](const int iAxis, const int iPos, auto&& iFunc) {
+    const int a0= (iAxis == 0) ? 1 : 0, a1= (iAxis == 2) ? 1 : 2;
+    for (int i0= beg[a0]; i0 < end[a0]; i0++) {
+      for (int i1= beg[a1]; i1 < end[a1]; i1++) {
+        std::array<int, 3> vox;
+        vox[iAxis]= iPos;
+        vox[a0]= i0;
+        vox[a1]= i1;
+        iFunc(vox[0], vox[1], vox[2]);
+      }
+    }
+  };
+  auto IsEnforced= [&](const int x, const int y, const int z) {
+    return !IsSolid(x, y, z) && Scen->IsPreBC(x, y, z);
+  };
+
+  // Peel the outer layers of the bounding box that hold enforced pressure voxels, along the axes where it is thicker than one layer
+  std::array<std::array<bool, 2>, 3> peel= {};
+  for (int axis= 0; axis < 3; axis++)
+    for (int side= 0; side < 2 && end[axis] - beg[axis] > 1; side++)
+      SweepLayer(axis, side == 0 ? beg[axis] : end[axis] - 1, [&](const int x, const int y, const int z) {
+        if (IsEnforced(x, y, z)) peel[axis][side]= true;
+      });
+  for (int axis= 0; axis < 3; axis++) {
+    beg[axis]+= peel[axis][0];
+    end[axis]-= peel[axis][1];
+    if (end[axis] <= beg[axis]) return;
+  }
+
+  // Check that the box is full and gather the free voxels left outside
+  const long long nbBox= (long long)(end[0] - beg[0]) * (end[1] - beg[1]) * (end[2] - beg[2]);
+  auto IsInBox= [&](const int x, const int y, const int z) {
+    return x >= beg[0] && x < end[0] && y >= beg[1] && y < end[1] && z >= beg[2] && z < end[2];
+  };
+  for (int x= 0; x < nX; x++)
+    for (int y= 0; y < nY; y++)
+      for (std::array<int, 2> span : FreeSpans[FieldID::IDPres][x][y])
+        for (int z= span[0]; z < span[1]; z++)
+          if (!IsInBox(x, y, z)) SpectralExtra.push_back({x, y, z});
+  if (nbFree - (long long)SpectralExtra.size() != nbBox || (int)SpectralExtra.size() > spectralExtraMax) {
+    SpectralExtra.clear();
+    return;
+  }
+
+  // Classify the box faces from their face neighbors only, voxels across the edges and corners do not couple into the system
+  for (int axis= 0; axis < 3; axis++) {
+    std::array<bool, 2> isDirichlet= {false, false};
+    for (int side= 0; side < 2; side++) {
+      const int pos= (side == 0) ? beg[axis] - 1 : end[axis];
+      if (pos < 0 || pos >= dims[axis]) continue;
+      bool hasSolid= false, hasOpen= false;
+      SweepLayer(axis, pos, [&](const int x, const int y, const int z) {
+        if (IsSolid(x, y, z)) hasSolid= true;
+        else hasOpen= true;
+      });
+      if (hasSolid && hasOpen) {
+        SpectralExtra.clear();
+        return;
+      }
+      isDirichlet[side]= hasOpen;
+    }
+    // Mixed conditions along an axis are diagonal in neither transform
+    if (isDirichlet[0] != isDirichlet[1]) {
+      SpectralExtra.clear();
+      return;
+    }
+    spectralDirichlet[axis]= isDirichlet[0];
+  }
+  spectralBox= {beg[0], beg[1], beg[2], end[0], end[1], end[2]};
+  isSpectralBox= true;
+
+  // Extra voxels are only handled across the two faces of a single Dirichlet axis
+  const int m= (int)SpectralExtra.size();
+  if (m == 0) return;
+  const int nbDirichlet= (int)spectralDirichlet[0] + (int)spectralDirichlet[1] + (int)spectralDirichlet[2];
+  if (nbDirichlet != 1) {
+    isSpectralBox= false;
+    SpectralExtra.clear();
+    return;
+  }
+  const int aD= spectralDirichlet[0] ? 0 : (spectralDirichlet[1] ? 1 : 2);
+  const int aL0= (aD == 0) ? 1 : 0, aL1= (aD == 2) ? 1 : 2;
+  const int nD= end[aD] - beg[aD], nL0= end[aL0] - beg[aL0], nL1= end[aL1] - beg[aL1];
+
+  // Locate the face neighbor in the box of each extra voxel
+  const int offsets[6][3]= {{-1, 0, 0}, {1, 0, 0}, {0, -1, 0}, {0, 1, 0}, {0, 0, -1}, {0, 0, 1}};
+  std::unordered_map<long long, int> extraIdx;
+  for (int e= 0; e < m; e++) {
+    const std::array<int, 3> vox= SpectralExtra[e];
+    extraIdx[((long long)vox[0] * nY + vox[1]) * nZ + vox[2]]= e;
+    SpectralExtraNbr.push_back(-1);
+    for (int k= 0; k < 6; k++) {
+      const int x= vox[0] + offsets[k][0], y= vox[1] + offsets[k][1], z= vox[2] + offsets[k][2];
+      if (IsInBox(x, y, z))
+        SpectralExtraNbr[e]= ((long long)(x - beg[0]) * (end[1] - beg[1]) + (y - beg[1])) * (end[2] - beg[2]) + (z - beg[2]);
+    }
+  }
+
+  // Build the capacitance matrix  C = D - A_EE - A_EB × L_B⁻¹ × A_BE
+  SpectralCapa.assign((size_t)m * m, 0.0);
+  for (int e= 0; e < m; e++) {
+    const std::array<int, 3> vox= SpectralExtra[e];
+    for (int k= 0; k < 6; k++) {
+      const int x= vox[0] + offsets[k][0], y= vox[1] + offsets[k][1], z= vox[2] + offsets[k][2];
+      if (x < 0 || x >= nX || y < 0 || y >= nY || z < 0 || z >= nZ || Solid[x][y][z]) continue;
+      SpectralCapa[(size_t)e * m + e]+= 1.0;
+      const std::unordered_map<long long, int>::const_iterator it= extraIdx.find(((long long)x * nY + y) * nZ + z);
+      if (it != extraIdx.end()) SpectralCapa[(size_t)e * m + it->second]-= 1.0;
+    }
+  }
+  // The box neighbors all lie on the two Dirichlet faces, so the box Green's function between them is expanded
+  // in the orthonormal DCT-II modes of the face, each mode leaving a 1D tridiagonal problem along the Dirichlet axis
+  // L_B⁻¹(a, b) = Σ_k ψ_k(a) ψ_k(b) T_k(side a, side b)    T_k= (tridiag(-1, 2 + λ_k, -1))⁻¹ corner values
+  auto Basis= [](const int iN, const int iK, const int iPos) {
+    if (iK == 0) return 1.0 / std::sqrt((double)iN);
+    return std::sqrt(2.0 / (double)iN) * std::cos(std::numbers::pi * (double)iK * (2.0 * iPos + 1.0) / (2.0 * (double)iN));
+  };
+  const int nbModes= nL0 * nL1;
+  std::vector<double> cornerSame(nbModes), cornerOpp(nbModes);
+  std::vector<double> cPrime(nD), dPrime(nD);
+  for (int k0= 0; k0 < nL0; k0++) {
+    for (int k1= 0; k1 < nL1; k1++) {
+      const double eig0= 2.0 - 2.0 * std::cos(std::numbers::pi * (double)k0 / (double)nL0);
+      const double eig1= 2.0 - 2.0 * std::cos(std::numbers::pi * (double)k1 / (double)nL1);
+      const double diag= 2.0 + eig0 + eig1;
+      // Thomas algorithm for the first column of the inverse
+      cPrime[0]= -1.0 / diag;
+      dPrime[0]= 1.0 / diag;
+      for (int i= 1; i < nD; i++) {
+        const double denom= diag + cPrime[i - 1];
+        cPrime[i]= -1.0 / denom;
+        dPrime[i]= dPrime[i - 1] / denom;
+      }
+      for (int i= nD - 2; i >= 0; i--) dPrime[i]-= cPrime[i] * dPrime[i + 1];
+      cornerSame[k0 * nL1 + k1]= dPrime[0];
+      cornerOpp[k0 * nL1 + k1]= dPrime[nD - 1];
+    }
+  }
+  std::vector<double> modes((size_t)m * nbModes, 0.0);
+  std::vector<int> side(m, 0);
+  for (int e= 0; e < m; e++) {
+    if (SpectralExtraNbr[e] < 0) continue;
+    const std::array<int, 3> vox= SpectralExtra[e];
+    side[e]= (vox[aD] < beg[aD]) ? 0 : 1;
+    for (int k0= 0; k0 < nL0; k0++)
+      for (int k1= 0; k1 < nL1; k1++)
+        modes[(size_t)e * nbModes + k0 * nL1 + k1]= Basis(nL0, k0, vox[aL0] - beg[aL0]) * Basis(nL1, k1, vox[aL1] - beg[aL1]);
+  }
+#pragma omp parallel for
+  for (int e= 0; e < m; e++) {
+    if (SpectralExtraNbr[e] < 0) continue;
+    for (int f= 0; f < m; f++) {
+      if (SpectralExtraNbr[f] < 0) continue;
+      const std::vector<double>& corner= (side[e] == side[f]) ? cornerSame : cornerOpp;
+      double green= 0.0;
+      for (int k= 0; k < nbModes; k++)
+        green+= modes[(size_t)e * nbModes + k] * corner[k] * modes[(size_t)f * nbModes + k];
+      SpectralCapa[(size_t)e * m + f]-= green;
+    }
+  }
+
+  // Factorize with partial pivoting
+  SpectralPivot.resize(m);
+  for (int i= 0; i < m; i++) {
+    int iPiv= i;
+    for (int r= i + 1; r < m; r++)
+      if (std::abs(SpectralCapa[(size_t)r * m + i]) > std::abs(SpectralCapa[(size_t)iPiv * m + i])) iPiv= r;
+    SpectralPivot[i]= iPiv;
+    if (iPiv != i)
+      std::swap_ranges(SpectralCapa.begin() + (size_t)i * m, SpectralCapa.begin() + (size_t)(i + 1) * m, SpectralCapa.begin() + (size_t)iPiv * m);
+    for (int r= i + 1; r < m; r++) {
+      SpectralCapa[(size_t)r * m + i]/= SpectralCapa[(size_t)i * m + i];
+      const double coeff= SpectralCapa[(size_t)r * m + i];
+      for (int c= i + 1; c < m; c++)
+        SpectralCapa[(size_t)r * m + c]-= coeff * SpectralCapa[(size_t)i * m + c];
+    }
+  }
+}
+
+
+// Solve the Laplacian of the cached box in place, the RHS being scaled by the voxel area
+// Dirichlet axes have zero values beyond the box, the caller moves the enforced values into the RHS
+void CompuFluidDyna::SpectralBoxSolve(std::vector<double>& ioBuf, const double iMeanGuess) {
+  const int bX= spectralBox[3] - spectralBox[0], bY= spectralBox[4] - spectralBox[1], bZ= spectralBox[5] - spectralBox[2];
+  const int dims[3]= {bX, bY, bZ};
+  const size_t strides[3]= {(size_t)bY * bZ, (size_t)bZ, 1};
+  const long long nbBox= (long long)bX * bY * bZ;
+
+  // Apply a separable transform along the three axes of the box
+  auto TransformAxes= [&](const bool iInverse) {
+    for (int axis= 0; axis < 3; axis++) {
+      if (dims[axis] <= 1) continue;
+      const int nbLines= (int)(nbBox / dims[axis]);
+#pragma omp parallel for
+      for (int l= 0; l < nbLines; l++) {
+        // Start of the line from the indices in the two other axes
+        const size_t inner= (size_t)l % strides[axis];
+        const size_t outer= (size_t)l / strides[axis];
+        const size_t start= outer * strides[axis] * dims[axis] + inner;
+        std::vector<double> line(dims[axis]);
+        for (int k= 0; k < dims[axis]; k++) line[k]= ioBuf[start + k * strides[axis]];
+        if (spectralDirichlet[axis]) {
+          if (iInverse) FFT::DST1Inverse(line);
+          else FFT::DST1(line);
+        }
+        else {
+          if (iInverse) FFT::DCT2Inverse(line);
+          else FFT::DCT2(line);
+        }
+        for (int k= 0; k < dims[axis]; k++) ioBuf[start + k * strides[axis]]= line[k];
+      }
+    }
+  };
+
+  // Divide by the eigenvalues  λ(k)= Σ 2 - 2 cos(π k_d / n_d) with Neumann or 2 - 2 cos(π (k_d+1) / (n_d+1)) with Dirichlet
+  TransformAxes(false);
+  std::array<std::vector<double>, 3> eig;
+  for (int axis= 0; axis < 3; axis++) {
+    eig[axis].resize(dims[axis]);
+    for (int k= 0; k < dims[axis]; k++) {
+      if (spectralDirichlet[axis]) eig[axis][k]= 2.0 - 2.0 * std::cos(std::numbers::pi * (double)(k + 1) / (double)(dims[axis] + 1));
+      else eig[axis][k]= 2.0 - 2.0 * std::cos(std::numbers::pi * (double)k / (double)dims[axis]);
+    }
+  }
+  const bool isNeumann= !spectralDirichlet[0] && !spectralDirichlet[1] && !spectralDirichlet[2];
+  for (int x= 0; x < bX; x++)
+    for (int y= 0; y < bY; y++)
+      for (int z= 0; z < bZ; z++)
+        if (!isNeumann || x + y + z > 0)
+          ioBuf[((size_t)x * bY + y) * bZ + z]/= eig[0][x] + eig[1][y] + eig[2][z];
+  // The constant mode is left undetermined by pure Neumann conditions, keep the one of the guess like the iterative solvers
+  if (isNeumann) ioBuf[0]= iMeanGuess * (double)nbBox;
+  TransformAxes(true);
+}
+
+
+// Solve the pressure Poisson equation directly with discrete cosine and sine transforms
+// Only applies when the layout analysis finds the free pressure voxels fit an axis aligned box with separable conditions,
+// in which case the Laplacian has constant coefficients and is diagonal in the DCT-II or DST-I basis of each axis
+// Returns false without modifying the field when the fluid region does not fit
+// References for spectral Poisson solvers
+// https://en.wikipedia.org/wiki/Discrete_cosine_transform#Applications
+// https://en.wikipedia.org/wiki/Discrete_sine_transform
+// https://en.wikipedia.org/wiki/Chirp_Z-transform#Bluestein's_algorithm
+bool CompuFluidDyna::SpectralPoissonSolve(const std::vector<std::vector<std::vector<float>>>& iField,
+                                          std::vector<std::vector<std::vector<float>>>& ioField) {
+  if (!isSpectralValid) SpectralLayout();
+  if (!isSpectralBox) return false;
+  const int xBeg= spectralBox[0], yBeg= spectralBox[1], zBeg= spectralBox[2];
+  const int bX= spectralBox[3] - xBeg, bY= spectralBox[4] - yBeg, bZ= spectralBox[5] - zBeg;
+  const long long nbBox= (long long)bX * bY * bZ;
+  const double area= (double)voxSize * (double)voxSize;
+
+  // Gather the RHS scaled by the voxel area and the mean of the guess which sets the free constant mode
+  std::vector<double> buf((size_t)nbBox);
+  double meanGuess= 0.0;
+  for (int x= 0; x < bX; x++) {
+    for (int y= 0; y < bY; y++) {
+      for (int z= 0; z < bZ; z++) {
+        buf[((size_t)x * bY + y) * bZ + z]= (double)iField[xBeg + x][yBeg + y][zBeg + z] * area;
+        meanGuess+= (double)ioField[xBeg + x][yBeg + y][zBeg + z];
+      }
+    }
+  }
+  meanGuess/= (double)nbBox;
+
+  // Move the enforced pressure values across the Dirichlet faces into the RHS
+  const int dims[3]= {bX, bY, bZ};
+  const int nbVox[3]= {nX, nY, nZ};
+  for (int axis= 0; axis < 3; axis++) {
+    if (!spectralDirichlet[axis]) continue;
+    const int a0= (axis == 0) ? 1 : 0, a1= (axis == 2) ? 1 : 2;
+    for (int side= 0; side < 2; side++) {
+      const int posIn= (side == 0) ? 0 : dims[axis] - 1;
+      const int posOut= (side == 0) ? spectralBox[axis] - 1 : spectralBox[axis + 3];
+      if (posOut < 0 || posOut >= nbVox[axis]) continue;
+      for (int i0= 0; i0 < dims[a0]; i0++) {
+        for (int i1= 0; i1 < dims[a1]; i1++) {
+          std::array<int, 3> in;
+          in[axis]= posIn;
+          in[a0]= i0;
+          in[a1]= i1;
+          std::array<int, 3> out= {xBeg + in[0], yBeg + in[1], zBeg + in[2]};
+          out[axis]= posOut;
+          if (Scen->IsPreBC(out[0], out[1], out[2]))
+            buf[((size_t)in[0] * bY + in[1]) * bZ + in[2]]+= (double)ioField[out[0]][out[1]][out[2]];
+        }
+      }
+    }
   }
+
+  // Solve the extra voxels with the capacitance system, then the box with their values as Dirichlet conditions
+  const int m= (int)SpectralExtra.size();
+  if (m > 0) {
+    std::vector<double> boxSol= buf;
+    SpectralBoxSolve(boxSol, 0.0);
+    const int offsets[6][3]= {{-1, 0, 0}, {1, 0, 0}, {0, -1, 0}, {0, 1, 0}, {0, 0, -1}, {0, 0, 1}};
+    std::vector<double> extraSol(m);
+    for (int e= 0; e < m; e++) {
+      const std::array<int, 3> vox= SpectralExtra[e];
+      extraSol[e]= (double)iField[vox[0]][vox[1]][vox[2]] * area;
+      for (int k= 0; k < 6; k++) {
+        const int x= vox[0] + offsets[k][0], y= vox[1] + offsets[k][1], z= vox[2] + offsets[k][2];
+        if (x < 0 || x >= nX || y < 0 || y >= nY || z < 0 || z >= nZ) continue;
+        if (!Solid[x][y][z] && Scen->IsPreBC(x, y, z)) extraSol[e]+= (double)ioField[x][y][z];
+      }
+      if (SpectralExtraNbr[e] >= 0) extraSol[e]+= boxSol[SpectralExtraNbr[e]];
+    }
+    // Forward and back substitution with the cached LU factors
+    for (int i= 0; i < m; i++) {
+      std::swap(extraSol[i], extraSol[SpectralPivot[i]]);
+      for (int c= 0; c < i; c++) extraSol[i]-= SpectralCapa[(size_t)i * m + c] * extraSol[c];
+    }
+    for (int i= m - 1; i >= 0; i--) {
+      for (int c= i + 1; c < m; c++) extraSol[i]-= SpectralCapa[(size_t)i * m + c] * extraSol[c];
+      extraSol[i]/= SpectralCapa[(size_t)i * m + i];
+    }
+    for (int e= 0; e < m; e++) {
+      const std::array<int, 3> vox= SpectralExtra[e];
+      ioField[vox[0]][vox[1]][vox[2]]= (float)extraSol[e];
+      if (SpectralExtraNbr[e] >= 0) buf[SpectralExtraNbr[e]]+= extraSol[e];
+    }
+  }
+  SpectralBoxSolve(buf, meanGuess);
+
+  // Scatter the solution back
+  for (int x= 0; x < bX; x++)
+    for (int y= 0; y < bY; y++)
+      for (int z= 0; z < bZ; z++)
+        ioField[xBeg + x][yBeg + y][zBeg + z]= (float)buf[((size_t)x * bY + y) * bZ + z];
+  return true;
 }
 
 
@@ -882,9 +2265,10 @@ void CompuFluidDyna::ExternalForces() {
   // Update velocities based on applied external forces
   for (int x= 0; x < nX; x++) {
     for (int y= 0; y < nY; y++) {
-      for (int z= 0; z < nZ; z++) {
-        if (Solid[x][y][z] || VelBC[x][y][z]) continue;
-        VelZ[x][y][z]+= D.UI[TimeStep____].GetF() * D.UI[CoeffGravi__].GetF() * Smok[x][y][z] / fluidDensity;
+      for (std::array<int, 2> span : FreeSpans[FieldID::IDVelZ][x][y]) {
+        for (int z= span[0]; z < span[1]; z++) {
+          VelZ[x][y][z]+= simTimeStep * D.UI[CoeffGravi__].GetF() * Smok[x][y][z] / fluidDensity;
+        }
       }
     }
   }
@@ -912,7 +2296,7 @@ void CompuFluidDyna::ProjectField(const int iIter, const float iTimeStep,
   ComputeVelocityDivergence();
   // Reset pressure guess to test convergence
   if (D.UI[CoeffProj___].GetI() == 2) {
-    Pres= Field::AllocField3D(nX, nY, nZ, 0.0f);
+    Pres= AllocRunField(0.0f);
     ApplyBC(FieldID::IDPres, Pres);
   }
   // Solve for pressure in the pressure Poisson equation
@@ -922,6 +2306,16 @@ void CompuFluidDyna::ProjectField(const int iIter, const float iTimeStep,
   else if (D.UI[SolvType____].GetI() == 1) {
     GradientDescentSolve(FieldID::IDPres, iIter, iTimeStep, false, 0.0f, Dive, Pres);
   }
+  else if (D.UI[SolvType____].GetI() == 3 && SpectralPoissonSolve(Dive, Pres)) {
+    // Report the residual of the direct solve like the iterative solvers do
+    if (D.UI[VerboseSolv_].GetB()) {
+      std::vector<std::vector<std::vector<float>>> t0Field= AllocRunField(0.0f);
+      ImplicitFieldLaplacianMatMult(FieldID::IDPres, iTimeStep, false, 0.0f, false, Pres, t0Field);
+      ApplyBC(FieldID::IDPres, t0Field);
+      ImplicitFieldSub(Dive, t0Field, t0Field);
+      printf("\nDCT Proj  P  [%.2e] %.2e ", ImplicitFieldDotProd(Dive, Dive), ImplicitFieldDotProd(t0Field, t0Field));
+    }
+  }
   else {
     ConjugateGradientSolve(FieldID::IDPres, iIter, iTimeStep, false, 0.0f, Dive, Pres);
   }
@@ -929,21 +2323,94 @@ void CompuFluidDyna::ProjectField(const int iIter, const float iTimeStep,
   // Update velocities based on local pressure gradient
   for (int x= 0; x < nX; x++) {
     for (int y= 0; y < nY; y++) {
-      for (int z= 0; z < nZ; z++) {
-        if (Solid[x][y][z] || VelBC[x][y][z]) continue;
-        // Subtract pressure gradient to remove divergence
-        if (x - 1 >= 0 && !Solid[x - 1][y][z]) ioVelX[x][y][z]-= iTimeStep / fluidDensity * (Pres[x][y][z] - Pres[x - 1][y][z]) / (2.0f * voxSize);
-        if (y - 1 >= 0 && !Solid[x][y - 1][z]) ioVelY[x][y][z]-= iTimeStep / fluidDensity * (Pres[x][y][z] - Pres[x][y - 1][z]) / (2.0f * voxSize);
-        if (z - 1 >= 0 && !Solid[x][y][z - 1]) ioVelZ[x][y][z]-= iTimeStep / fluidDensity * (Pres[x][y][z] - Pres[x][y][z - 1]) / (2.0f * voxSize);
-        if (x + 1 < nX && !Solid[x + 1][y][z]) ioVelX[x][y][z]-= iTimeStep / fluidDensity * (Pres[x + 1][y][z] - Pres[x][y][z]) / (2.0f * voxSize);
-        if (y + 1 < nY && !Solid[x][y + 1][z]) ioVelY[x][y][z]-= iTimeStep / fluidDensity * (Pres[x][y + 1][z] - Pres[x][y][z]) / (2.0f * voxSize);
-        if (z + 1 < nZ && !Solid[x][y][z + 1]) ioVelZ[x][y][z]-= iTimeStep / fluidDensity * (Pres[x][y][z + 1] - Pres[x][y][z]) / (2.0f * voxSize);
+      for (std::array<int, 2> span : FreeSpans[FieldID::IDVelX][x][y]) {
+        for (int z= span[0]; z < span[1]; z++) {
+          // Subtract pressure gradient to remove divergence
+          if (x - 1 >= 0 && !Solid[x - 1][y][z]) ioVelX[x][y][z]-= iTimeStep / fluidDensity * (Pres[x][y][z] - Pres[x - 1][y][z]) / (2.0f * voxSize);
+          if (y - 1 >= 0 && !Solid[x][y - 1][z]) ioVelY[x][y][z]-= iTimeStep / fluidDensity * (Pres[x][y][z] - Pres[x][y - 1][z]) / (2.0f * voxSize);
+          if (z - 1 >= 0 && !Solid[x][y][z - 1]) ioVelZ[x][y][z]-= iTimeStep / fluidDensity * (Pres[x][y][z] - Pres[x][y][z - 1]) / (2.0f * voxSize);
+          if (x + 1 < nX && !Solid[x + 1][y][z]) ioVelX[x][y][z]-= iTimeStep / fluidDensity * (Pres[x + 1][y][z] - Pres[x][y][z]) / (2.0f * voxSize);
+          if (y + 1 < nY && !Solid[x][y + 1][z]) ioVelY[x][y][z]-= iTimeStep / fluidDensity * (Pres[x][y + 1][z] - Pres[x][y][z]) / (2.0f * voxSize);
+          if (z + 1 < nZ && !Solid[x][y][z + 1]) ioVelZ[x][y][z]-= iTimeStep / fluidDensity * (Pres[x][y][z + 1] - Pres[x][y][z]) / (2.0f * voxSize);
+        }
       }
     }
   }
 }
 
 
+// Copy the fluid voxels of the current iterate in the persistent buffers of the steady state mode
+void CompuFluidDyna::SteadyStateStore() {
+  if (OldStepVelX.empty()) {
+    OldStepVelX= AllocRunField(0.0f);
+    OldStepVelY= AllocRunField(0.0f);
+    OldStepVelZ= AllocRunField(0.0f);
+    OldStepPres= AllocRunField(0.0f);
+  }
+  SweepTiles(FluidSpans, [&](const int x, const int y, const int zBeg, const int zEnd) {
+    std::copy(VelX[x][y].begin() + zBeg, VelX[x][y].begin() + zEnd, OldStepVelX[x][y].begin() + zBeg);
+    std::copy(VelY[x][y].begin() + zBeg, VelY[x][y].begin() + zEnd, OldStepVelY[x][y].begin() + zBeg);
+    std::copy(VelZ[x][y].begin() + zBeg, VelZ[x][y].begin() + zEnd, OldStepVelZ[x][y].begin() + zBeg);
+    std::copy(Pres[x][y].begin() + zBeg, Pres[x][y].begin() + zEnd, OldStepPres[x][y].begin() + zBeg);
+  });
+}
+
+
+// Under-relax the pseudo time step of the steady state mode and measure its residuals
+// vel ⇐ vel_old + α (vel - vel_old)
+// pres ⇐ pres_old + α (pres - pres_old)
+// The relaxed velocity stays divergence free as a blend of two projected fields
+// The residuals are the RMS velocity change rate over the step and the RMS divergence of the relaxed field
+void CompuFluidDyna::SteadyStateRelaxation(const float iTimeStep) {
+  const float relax= std::min(D.UI[SteadyRelax_].GetF(), 1.0f);
+  // Accumulate per column within the subdomains before the ordered global sums
+  SweepSubDomains([&](const int xBeg, const int xEnd, const int yBeg, const int yEnd) {
+    for (int x= xBeg; x < xEnd; x++) {
+      for (int y= yBeg; y < yEnd; y++) {
+        float val= 0.0f;
+        for (std::array<int, 2> span : FluidSpans[x][y]) {
+          for (int z= span[0]; z < span[1]; z++) {
+            const float dVelX= VelX[x][y][z] - OldStepVelX[x][y][z];
+            const float dVelY= VelY[x][y][z] - OldStepVelY[x][y][z];
+            const float dVelZ= VelZ[x][y][z] - OldStepVelZ[x][y][z];
+            VelX[x][y][z]= OldStepVelX[x][y][z] + relax * dVelX;
+            VelY[x][y][z]= OldStepVelY[x][y][z] + relax * dVelY;
+            VelZ[x][y][z]= OldStepVelZ[x][y][z] + relax * dVelZ;
+            Pres[x][y][z]= OldStepPres[x][y][z] + relax * (Pres[x][y][z] - OldStepPres[x][y][z]);
+            val+= dVelX * dVelX + dVelY * dVelY + dVelZ * dVelZ;
+          }
+        }
+        ColPartial[x][y]= val;
+      }
+    }
+  });
+  const float nbVox= (float)std::max(nbFluidVox, 1);
+  const float resVel= std::sqrt(ReduceColPartial() / nbVox) / iTimeStep;
+  // Divergence of the relaxed field, with the same scaling as the pressure Poisson RHS
+  UpdateDiagnostic(DiagID::DiagDive);
+  SweepSubDomains([&](const int xBeg, const int xEnd, const int yBeg, const int yEnd) {
+    for (int x= xBeg; x < xEnd; x++) {
+      for (int y= yBeg; y < yEnd; y++) {
+        float val= 0.0f;
+        for (std::array<int, 2> span : FreeSpans[FieldID::IDPres][x][y])
+          for (int z= span[0]; z < span[1]; z++)
+            val+= Dive[x][y][z] * Dive[x][y][z];
+        ColPartial[x][y]= val;
+      }
+    }
+  });
+  const float resDiv= std::sqrt(ReduceColPartial() / nbVox) * iTimeStep / fluidDensity;
+  // Only the latest samples are kept for the plot
+  if ((int)SteadyResVel.size() >= steadyResMax) {
+    SteadyResVel.erase(SteadyResVel.begin());
+    SteadyResDiv.erase(SteadyResDiv.begin());
+  }
+  SteadyResVel.push_back(resVel);
+  SteadyResDiv.push_back(resDiv);
+  if (D.UI[Verbose_____].GetB()) printf("Steady residuals  vel %.3e  div %.3e\n", resVel, resDiv);
+}
+
+
 // Trilinearly interpolate the field value at the given position
 float CompuFluidDyna::TrilinearInterpolation(const float iPosX, const float iPosY, const float iPosZ,
                                              const std::vector<std::vector<std::vector<float>>>& iFieldRef) {
@@ -962,6 +2429,18 @@ float CompuFluidDyna::TrilinearInterpolation(const float iPosX, const float iPos
   const float yWeight0= 1.0f - yWeight1;
   const float zWeight0= 1.0f - zWeight1;
   // Compute the weighted sum
+  if (sparseStore) {
+    // Corners in columns without storage are deep in the solid and hold zero
+    auto Val= [&](const int x, const int y, const int z) { return iFieldRef[x][y].empty() ? 0.0f : iFieldRef[x][y][z]; };
+    return Val(x0, y0, z0) * (xWeight0 * yWeight0 * zWeight0) +
+           Val(x0, y0, z1) * (xWeight0 * yWeight0 * zWeight1) +
+           Val(x0, y1, z0) * (xWeight0 * yWeight1 * zWeight0) +
+           Val(x0, y1, z1) * (xWeight0 * yWeight1 * zWeight1) +
+           Val(x1, y0, z0) * (xWeight1 * yWeight0 * zWeight0) +
+           Val(x1, y0, z1) * (xWeight1 * yWeight0 * zWeight1) +
+           Val(x1, y1, z0) * (xWeight1 * yWeight1 * zWeight0) +
+           Val(x1, y1, z1) * (xWeight1 * yWeight1 * zWeight1);
+  }
   return iFieldRef[x0][y0][z0] * (xWeight0 * yWeight0 * zWeight0) +
          iFieldRef[x0][y0][z1] * (xWeight0 * yWeight0 * zWeight1) +
          iFieldRef[x0][y1][z0] * (xWeight0 * yWeight1 * zWeight0) +
@@ -973,6 +2452,64 @@ float CompuFluidDyna::TrilinearInterpolation(const float iPosX, const float iPos
 }
 
 
+// Trilinearly interpolate fields at a batch of positions
+// The interpolation stencil is computed once per position and shared by all the sampled fields
+void CompuFluidDyna::TrilinearInterpolationBatch(const int iNbPos, const float* iPosX, const float* iPosY, const float* iPosZ,
+                                                 const int iNbField, const std::vector<std::vector<std::vector<float>>>* const* iFieldRef,
+                                                 float* const* oVal) {
+  // Get floor and ceil voxel indices and weights
+  int x0[nbBatchVox], y0[nbBatchVox], z0[nbBatchVox], x1[nbBatchVox], y1[nbBatchVox], z1[nbBatchVox];
+  float xWeight1[nbBatchVox], yWeight1[nbBatchVox], zWeight1[nbBatchVox];
+#pragma omp simd
+  for (int k= 0; k < iNbPos; k++) {
+    x0[k]= std::min(std::max((int)std::floor(iPosX[k]), 0), nX - 1);
+    y0[k]= std::min(std::max((int)std::floor(iPosY[k]), 0), nY - 1);
+    z0[k]= std::min(std::max((int)std::floor(iPosZ[k]), 0), nZ - 1);
+    x1[k]= std::min(std::max((int)std::ceil(iPosX[k]), 0), nX - 1);
+    y1[k]= std::min(std::max((int)std::ceil(iPosY[k]), 0), nY - 1);
+    z1[k]= std::min(std::max((int)std::ceil(iPosZ[k]), 0), nZ - 1);
+    xWeight1[k]= iPosX[k] - (float)x0[k];
+    yWeight1[k]= iPosY[k] - (float)y0[k];
+    zWeight1[k]= iPosZ[k] - (float)z0[k];
+  }
+  // Compute the weighted sums for each field, 2D cases in the YZ plane sample a single X plane bilinearly
+  auto WeightedSums= [&](auto iActiveX) {
+    constexpr bool activeX= decltype(iActiveX)::value;
+    for (int f= 0; f < iNbField; f++) {
+      const std::vector<std::vector<std::vector<float>>>& field= *iFieldRef[f];
+      for (int k= 0; k < iNbPos; k++) {
+        // Columns without storage read as zero
+        const float* c00= field[x0[k]][y0[k]].empty() ? ZeroCol.data() : field[x0[k]][y0[k]].data();
+        const float* c01= field[x0[k]][y1[k]].empty() ? ZeroCol.data() : field[x0[k]][y1[k]].data();
+        const float yWeight0= 1.0f - yWeight1[k];
+        const float zWeight0= 1.0f - zWeight1[k];
+        if constexpr (activeX) {
+          const float* c10= field[x1[k]][y0[k]].empty() ? ZeroCol.data() : field[x1[k]][y0[k]].data();
+          const float* c11= field[x1[k]][y1[k]].empty() ? ZeroCol.data() : field[x1[k]][y1[k]].data();
+          const float xWeight0= 1.0f - xWeight1[k];
+          oVal[f][k]= c00[z0[k]] * (xWeight0 * yWeight0 * zWeight0) +
+                      c00[z1[k]] * (xWeight0 * yWeight0 * zWeight1[k]) +
+                      c01[z0[k]] * (xWeight0 * yWeight1[k] * zWeight0) +
+                      c01[z1[k]] * (xWeight0 * yWeight1[k] * zWeight1[k]) +
+                      c10[z0[k]] * (xWeight1[k] * yWeight0 * zWeight0) +
+                      c10[z1[k]] * (xWeight1[k] * yWeight0 * zWeight1[k]) +
+                      c11[z0[k]] * (xWeight1[k] * yWeight1[k] * zWeight0) +
+                      c11[z1[k]] * (xWeight1[k] * yWeight1[k] * zWeight1[k]);
+        }
+        else {
+          oVal[f][k]= c00[z0[k]] * (yWeight0 * zWeight0) +
+                      c00[z1[k]] * (yWeight0 * zWeight1[k]) +
+                      c01[z0[k]] * (yWeight1[k] * zWeight0) +
+                      c01[z1[k]] * (yWeight1[k] * zWeight1[k]);
+        }
+      }
+    }
+  };
+  if (nX > 1) WeightedSums(std::true_type());
+  else WeightedSums(std::false_type());
+}
+
+
 // Apply semi-Lagrangian advection along the velocity field
 // vel ⇐ vel - Δt (vel · ∇) vel
 // smo ⇐ smo - Δt (vel · ∇) smo
@@ -980,67 +2517,260 @@ float CompuFluidDyna::TrilinearInterpolation(const float iPosX, const float iPos
 // https://commons.wikimedia.org/wiki/File:Backtracking_maccormack.png
 // https://physbam.stanford.edu/~fedkiw/papers/stanford2006-09.pdf
 // https://github.com/NiallHornFX/StableFluids3D-GL/blob/master/src/fluidsolver3d.cpp
-void CompuFluidDyna::AdvectField(const int iFieldID, const float iTimeStep,
-                                 const std::vector<std::vector<std::vector<float>>>& iVelX,
-                                 const std::vector<std::vector<std::vector<float>>>& iVelY,
-                                 const std::vector<std::vector<std::vector<float>>>& iVelZ,
-                                 std::vector<std::vector<std::vector<float>>>& ioField) {
-  // Adjust the source field to make solid voxels have a value dependant on their non-solid neighbors
-  std::vector<std::vector<std::vector<float>>> sourceField= ioField;
+void CompuFluidDyna::AdvectFields(const std::vector<int>& iFieldIDs, const float iTimeStep) {
+  const int nbField= (int)iFieldIDs.size();
+  if (nbField == 0) return;
+  std::vector<std::vector<std::vector<float>>>* fields[4]= {&Smok, &VelX, &VelY, &VelZ};
+  // Keep the velocity field before advection for the backtracking when it is advected in place
+  bool advecVel= false;
+  for (int iFieldID : iFieldIDs)
+    if (iFieldID != FieldID::IDSmok) advecVel= true;
+  std::vector<std::vector<std::vector<float>>> oldVelX, oldVelY, oldVelZ;
+  if (advecVel) {
+    oldVelX= VelX;
+    oldVelY= VelY;
+    oldVelZ= VelZ;
+  }
+  const std::vector<std::vector<std::vector<float>>>& iVelX= advecVel ? oldVelX : VelX;
+  const std::vector<std::vector<std::vector<float>>>& iVelY= advecVel ? oldVelY : VelY;
+  const std::vector<std::vector<std::vector<float>>>& iVelZ= advecVel ? oldVelZ : VelZ;
+  // Adjust the source fields to make solid voxels have a value dependant on their non-solid neighbors
+  // Only solid voxels at the interface need it, the others are zero and have no non-solid neighbor
+  std::vector<std::vector<std::vector<std::vector<float>>>> sourceFields(nbField);
+  std::vector<const std::vector<std::vector<std::vector<float>>>*> srcFields(nbField);
+  for (int f= 0; f < nbField; f++) {
+    sourceFields[f]= *fields[iFieldIDs[f]];
+    srcFields[f]= &sourceFields[f];
+  }
+  // Velocity components are mirrored with opposite sign, smoke keeps its sign
+  float mirrorSign[4];
+  for (int f= 0; f < nbField; f++)
+    mirrorSign[f]= (iFieldIDs[f] == FieldID::IDSmok) ? 1.0f : -1.0f;
+#pragma omp parallel for collapse(2)
   for (int x= 0; x < nX; x++) {
     for (int y= 0; y < nY; y++) {
-      for (int z= 0; z < nZ; z++) {
-        if (!Solid[x][y][z]) continue;
-        int count= 0;
-        float sum= 0.0f;
-        if (x - 1 >= 0 && !Solid[x - 1][y][z] && ++count) sum+= ioField[x - 1][y][z];
-        if (y - 1 >= 0 && !Solid[x][y - 1][z] && ++count) sum+= ioField[x][y - 1][z];
-        if (z - 1 >= 0 && !Solid[x][y][z - 1] && ++count) sum+= ioField[x][y][z - 1];
-        if (x + 1 < nX && !Solid[x + 1][y][z] && ++count) sum+= ioField[x + 1][y][z];
-        if (y + 1 < nY && !Solid[x][y + 1][z] && ++count) sum+= ioField[x][y + 1][z];
-        if (z + 1 < nZ && !Solid[x][y][z + 1] && ++count) sum+= ioField[x][y][z + 1];
-        if (iFieldID == FieldID::IDSmok) sourceField[x][y][z]= (count > 0) ? sum / (float)count : 0.0f;
-        if (iFieldID == FieldID::IDVelX) sourceField[x][y][z]= (count > 0) ? -sum / (float)count : 0.0f;
-        if (iFieldID == FieldID::IDVelY) sourceField[x][y][z]= (count > 0) ? -sum / (float)count : 0.0f;
-        if (iFieldID == FieldID::IDVelZ) sourceField[x][y][z]= (count > 0) ? -sum / (float)count : 0.0f;
-      }
-    }
-  }
-  // Sweep through the field
+      for (std::array<int, 2> span : IfacSpans[x][y]) {
+        for (int z= span[0]; z < span[1]; z++) {
+          const bool nbrXN= (x - 1 >= 0 && !IsSolid(x - 1, y, z));
+          const bool nbrYN= (y - 1 >= 0 && !IsSolid(x, y - 1, z));
+          const bool nbrZN= (z - 1 >= 0 && !Solid[x][y][z - 1]);
+          const bool nbrXP= (x + 1 < nX && !IsSolid(x + 1, y, z));
+          const bool nbrYP= (y + 1 < nY && !IsSolid(x, y + 1, z));
+          const bool nbrZP= (z + 1 < nZ && !Solid[x][y][z + 1]);
+          const int count= nbrXN + nbrYN + nbrZN + nbrXP + nbrYP + nbrZP;
+          for (int f= 0; f < nbField; f++) {
+            const std::vector<std::vector<std::vector<float>>>& ioField= *fields[iFieldIDs[f]];
+            float sum= 0.0f;
+            if (nbrXN) sum+= ioField[x - 1][y][z];
+            if (nbrYN) sum+= ioField[x][y - 1][z];
+            if (nbrZN) sum+= ioField[x][y][z - 1];
+            if (nbrXP) sum+= ioField[x + 1][y][z];
+            if (nbrYP) sum+= ioField[x][y + 1][z];
+            if (nbrZP) sum+= ioField[x][y][z + 1];
+            sourceFields[f][x][y][z]= (count > 0) ? mirrorSign[f] * sum / (float)count : 0.0f;
+          }
+        }
+      }
+    }
+  }
+  // Sweep through the non-solid voxels with a single thread team over the whole domain
+  // Voxels are processed in batches along the column spans so the backtracking and sampling loops vectorize
+  // The source position is found once per voxel and all the advected fields are sampled with the same stencil
+  const int correcMaxIter= std::max(D.UI[CoeffAdvec__].GetI() - 1, 0);
+  const std::vector<std::vector<std::vector<float>>>* velFields[3]= {&iVelX, &iVelY, &iVelZ};
+#pragma omp parallel for collapse(2) schedule(dynamic)
   for (int x= 0; x < nX; x++) {
-#pragma omp parallel for
     for (int y= 0; y < nY; y++) {
-      for (int z= 0; z < nZ; z++) {
-        AdvX[x][y][z]= AdvY[x][y][z]= AdvZ[x][y][z]= 0.0f;
-        // Skip solid or fixed values
-        if (Solid[x][y][z]) continue;
-        if (SmoBC[x][y][z] && iFieldID == FieldID::IDSmok) continue;
-        if (VelBC[x][y][z] && iFieldID == FieldID::IDVelX) continue;
-        if (VelBC[x][y][z] && iFieldID == FieldID::IDVelY) continue;
-        if (VelBC[x][y][z] && iFieldID == FieldID::IDVelZ) continue;
-        // Find source position for active voxel using naive linear backtracking scheme
-        const Vec::Vec3<float> posEnd((float)x, (float)y, (float)z);
-        const Vec::Vec3<float> velEnd(iVelX[x][y][z], iVelY[x][y][z], iVelZ[x][y][z]);
-        Vec::Vec3<float> posBeg= posEnd - iTimeStep * velEnd / voxSize;
-        // Iterative source position correction with 2nd order MacCormack scheme
-        int correcMaxIter= std::max(D.UI[CoeffAdvec__].GetI() - 1, 0);
-        for (int iter= 0; iter < correcMaxIter; iter++) {
-          const float velBegX= TrilinearInterpolation(posBeg[0], posBeg[1], posBeg[2], iVelX);
-          const float velBegY= TrilinearInterpolation(posBeg[0], posBeg[1], posBeg[2], iVelY);
-          const float velBegZ= TrilinearInterpolation(posBeg[0], posBeg[1], posBeg[2], iVelZ);
-          const Vec::Vec3<float> velBeg(velBegX, velBegY, velBegZ);
-          const Vec::Vec3<float> vecErr= posEnd - (posBeg + iTimeStep * velBeg / voxSize);
-          posBeg= posBeg + vecErr / 2.0f;
+      for (std::array<int, 2> span : FluidSpans[x][y]) {
+        for (int zBeg= span[0]; zBeg < span[1]; zBeg+= nbBatchVox) {
+          const int nbVox= std::min(nbBatchVox, span[1] - zBeg);
+          float posBegX[nbBatchVox], posBegY[nbBatchVox], posBegZ[nbBatchVox];
+          float velBegX[nbBatchVox], velBegY[nbBatchVox], velBegZ[nbBatchVox];
+          float* velBeg[3]= {velBegX, velBegY, velBegZ};
+          // Find source position for active voxels using naive linear backtracking scheme
+          const float* velEndX= &iVelX[x][y][zBeg];
+          const float* velEndY= &iVelY[x][y][zBeg];
+          const float* velEndZ= &iVelZ[x][y][zBeg];
+#pragma omp simd
+          for (int k= 0; k < nbVox; k++) {
+            posBegX[k]= (float)x - iTimeStep * velEndX[k] / voxSize;
+            posBegY[k]= (float)y - iTimeStep * velEndY[k] / voxSize;
+            posBegZ[k]= (float)(zBeg + k) - iTimeStep * velEndZ[k] / voxSize;
+          }
+          // Iterative source position correction with 2nd order MacCormack scheme
+          for (int iter= 0; iter < correcMaxIter; iter++) {
+            TrilinearInterpolationBatch(nbVox, posBegX, posBegY, posBegZ, 3, velFields, velBeg);
+#pragma omp simd
+            for (int k= 0; k < nbVox; k++) {
+              posBegX[k]= posBegX[k] + ((float)x - (posBegX[k] + iTimeStep * velBegX[k] / voxSize)) / 2.0f;
+              posBegY[k]= posBegY[k] + ((float)y - (posBegY[k] + iTimeStep * velBegY[k] / voxSize)) / 2.0f;
+              posBegZ[k]= posBegZ[k] + ((float)(zBeg + k) - (posBegZ[k] + iTimeStep * velBegZ[k] / voxSize)) / 2.0f;
+            }
+          }
+          // Save source vector for display
+          if (!AdvX.empty()) {
+            for (int k= 0; k < nbVox; k++) {
+              AdvX[x][y][zBeg + k]= posBegX[k] - (float)x;
+              AdvY[x][y][zBeg + k]= posBegY[k] - (float)y;
+              AdvZ[x][y][zBeg + k]= posBegZ[k] - (float)(zBeg + k);
+            }
+          }
+          // Trilinear interpolation of all the source fields at source positions
+          float sampled[4][nbBatchVox];
+          float* sampledPtr[4]= {sampled[0], sampled[1], sampled[2], sampled[3]};
+          TrilinearInterpolationBatch(nbVox, posBegX, posBegY, posBegZ, nbField, srcFields.data(), sampledPtr);
+          // Update the voxels without fixed value, columns without flag have none
+          for (int f= 0; f < nbField; f++) {
+            std::vector<float>& col= (*fields[iFieldIDs[f]])[x][y];
+            const std::vector<bool>& fixed= (iFieldIDs[f] == FieldID::IDSmok) ? Scen->SmoBC[x][y] : Scen->VelBC[x][y];
+            for (int k= 0; k < nbVox; k++)
+              if (fixed.empty() || !fixed[zBeg + k]) col[zBeg + k]= sampled[f][k];
+          }
+        }
+      }
+    }
+  }
+}
+
+
+// Collect the voxels releasing the tracers and release all of them
+// Tracers come from the velocity inlets, else from the pressure inlets, else from the whole fluid
+void CompuFluidDyna::InitTracers() {
+  const int nbTracer= std::max(D.UI[TracerCount_].GetI(), 0);
+  TracerSeeds.clear();
+  for (int pass= 0; pass < 3 && TracerSeeds.empty(); pass++) {
+    for (int x= 0; x < nX; x++) {
+      for (int y= 0; y < nY; y++) {
+        for (int z= 0; z < nZ; z++) {
+          if (IsSolid(x, y, z)) continue;
+          const bool isInlet= Scen->IsVelBC(x, y, z) && (Scen->VelXForced[x][y][z] != 0.0f || Scen->VelYForced[x][y][z] != 0.0f || Scen->VelZForced[x][y][z] != 0.0f);
+          if ((pass == 0 && isInlet) || (pass == 1 && Scen->IsPreBC(x, y, z)) || pass == 2)
+            TracerSeeds.push_back(std::array<int, 3>({x, y, z}));
         }
-        // Save source vector for display
-        AdvX[x][y][z]= posBeg[0] - posEnd[0];
-        AdvY[x][y][z]= posBeg[1] - posEnd[1];
-        AdvZ[x][y][z]= posBeg[2] - posEnd[2];
-        // Trilinear interpolation at source position
-        ioField[x][y][z]= TrilinearInterpolation(posBeg[0], posBeg[1], posBeg[2], sourceField);
       }
     }
   }
+  TracerPosX.assign(TracerSeeds.empty() ? 0 : nbTracer, 0.0f);
+  TracerPosY.assign(TracerPosX.size(), 0.0f);
+  TracerPosZ.assign(TracerPosX.size(), 0.0f);
+  TracerSpeed.assign(TracerPosX.size(), 0.0f);
+  TracerAge.assign(TracerPosX.size(), 0.0f);
+  const float life= D.UI[TracerLife__].GetF();
+  for (int k= 0; k < (int)TracerPosX.size(); k++) {
+    SeedTracer(k);
+    // Stagger the ages so the tracers are not all released again at once
+    if (life > 0.0f) TracerAge[k]= life * (float)(Random::Hash((uint32_t)k) & 0xFFFF) / 65536.0f;
+  }
+}
+
+
+// Release a tracer at a random position in a random seed voxel
+// The random source is indexed by tracer and step so tracers can be released concurrently
+void CompuFluidDyna::SeedTracer(const int k) {
+  uint32_t hash= Random::Hash((uint32_t)k * 0x9E3779B9u ^ Random::Hash((uint32_t)simStep));
+  const std::array<int, 3>& vox= TracerSeeds[hash % (uint32_t)TracerSeeds.size()];
+  hash= Random::Hash(hash);
+  TracerPosX[k]= (float)vox[0] + ((nX > 1) ? (float)(hash & 0x3FF) / 1024.0f - 0.5f : 0.0f);
+  TracerPosY[k]= (float)vox[1] + ((nY > 1) ? (float)((hash >> 10) & 0x3FF) / 1024.0f - 0.5f : 0.0f);
+  TracerPosZ[k]= (float)vox[2] + ((nZ > 1) ? (float)((hash >> 20) & 0x3FF) / 1024.0f - 0.5f : 0.0f);
+  TracerSpeed[k]= 0.0f;
+  TracerAge[k]= 0.0f;
+}
+
+
+// Carry the massless tracers along the velocity field with the midpoint or the classic Runge Kutta scheme
+// - The structure of arrays is swept by batches of nbBatchVox tracers using the batched trilinear sampling
+// - Batches are independent and spread over the threads
+// - Tracers leaving the domain, entering a solid voxel or exceeding their lifetime are released again
+void CompuFluidDyna::AdvectTracers(const float iTimeStep) {
+  if (TracerSeeds.empty()) return;
+  const int nbTracer= (int)TracerPosX.size();
+  const int nbBatch= (nbTracer + nbBatchVox - 1) / nbBatchVox;
+  const bool classicRK= (D.UI[TracerOrder_].GetI() >= 4);
+  const float life= D.UI[TracerLife__].GetF();
+  const float dt= iTimeStep / voxSize;  // Positions are in voxel units
+  const float maxX= (float)(nX - 1), maxY= (float)(nY - 1), maxZ= (float)(nZ - 1);
+  const std::vector<std::vector<std::vector<float>>>* velFields[3]= {&VelX, &VelY, &VelZ};
+
+#pragma omp parallel for schedule(static)
+  for (int idxBatch= 0; idxBatch < nbBatch; idxBatch++) {
+    const int beg= idxBatch * nbBatchVox;
+    const int nbPos= std::min(nbBatchVox, nbTracer - beg);
+    float* posX= TracerPosX.data() + beg;
+    float* posY= TracerPosY.data() + beg;
+    float* posZ= TracerPosZ.data() + beg;
+    float stageX[nbBatchVox], stageY[nbBatchVox], stageZ[nbBatchVox];
+    float velX[nbBatchVox], velY[nbBatchVox], velZ[nbBatchVox];
+    float sumX[nbBatchVox], sumY[nbBatchVox], sumZ[nbBatchVox];
+    float* vel[3]= {velX, velY, velZ};
+
+    // Sample the velocity at the positions offset by the given fraction of the step along the last sampled velocity
+    const auto SampleStage= [&](const float iFrac) {
+#pragma omp simd
+      for (int k= 0; k < nbPos; k++) {
+        stageX[k]= std::min(std::max(posX[k] + iFrac * dt * velX[k], 0.0f), maxX);
+        stageY[k]= std::min(std::max(posY[k] + iFrac * dt * velY[k], 0.0f), maxY);
+        stageZ[k]= std::min(std::max(posZ[k] + iFrac * dt * velZ[k], 0.0f), maxZ);
+      }
+      TrilinearInterpolationBatch(nbPos, stageX, stageY, stageZ, 3, velFields, vel);
+    };
+    for (int k= 0; k < nbPos; k++)
+      velX[k]= velY[k]= velZ[k]= 0.0f;
+    SampleStage(0.0f);
+    if (classicRK) {
+      // k1 + 2 k2 + 2 k3 + k4
+      for (int k= 0; k < nbPos; k++) {
+        sumX[k]= velX[k];
+        sumY[k]= velY[k];
+        sumZ[k]= velZ[k];
+      }
+      SampleStage(0.5f);
+#pragma omp simd
+      for (int k= 0; k < nbPos; k++) {
+        sumX[k]+= 2.0f * velX[k];
+        sumY[k]+= 2.0f * velY[k];
+        sumZ[k]+= 2.0f * velZ[k];
+      }
+      SampleStage(0.5f);
+#pragma omp simd
+      for (int k= 0; k < nbPos; k++) {
+        sumX[k]+= 2.0f * velX[k];
+        sumY[k]+= 2.0f * velY[k];
+        sumZ[k]+= 2.0f * velZ[k];
+      }
+      SampleStage(1.0f);
+#pragma omp simd
+      for (int k= 0; k < nbPos; k++) {
+        velX[k]= (sumX[k] + velX[k]) / 6.0f;
+        velY[k]= (sumY[k] + velY[k]) / 6.0f;
+        velZ[k]= (sumZ[k] + velZ[k]) / 6.0f;
+      }
+    }
+    else {
+      // Velocity at the midpoint
+      SampleStage(0.5f);
+    }
+#pragma omp simd
+    for (int k= 0; k < nbPos; k++) {
+      posX[k]+= dt * velX[k];
+      posY[k]+= dt * velY[k];
+      posZ[k]+= dt * velZ[k];
+      TracerSpeed[beg + k]= std::sqrt(velX[k] * velX[k] + velY[k] * velY[k] + velZ[k] * velZ[k]);
+      TracerAge[beg + k]+= iTimeStep;
+    }
+
+    // Recycle the tracers that left the fluid
+    for (int k= 0; k < nbPos; k++) {
+      bool isOut= (life > 0.0f && TracerAge[beg + k] > life);
+      isOut= isOut || posX[k] < -0.5f || posX[k] > maxX + 0.5f || posY[k] < -0.5f || posY[k] > maxY + 0.5f || posZ[k] < -0.5f || posZ[k] > maxZ + 0.5f;
+      // Positions on the domain faces round to the closest voxel inside the domain
+      const int x= std::min(std::max((int)std::floor(posX[k] + 0.5f), 0), nX - 1);
+      const int y= std::min(std::max((int)std::floor(posY[k] + 0.5f), 0), nY - 1);
+      const int z= std::min(std::max((int)std::floor(posZ[k] + 0.5f), 0), nZ - 1);
+      isOut= isOut || IsSolid(x, y, z);
+      if (isOut) SeedTracer(beg + k);
+    }
+  }
 }
 
 
@@ -1053,29 +2783,35 @@ void CompuFluidDyna::VorticityConfinement(const float iTimeStep, const float iVo
                                           std::vector<std::vector<std::vector<float>>>& ioVelY,
                                           std::vector<std::vector<std::vector<float>>>& ioVelZ) {
   // Compute curl and vorticity from the velocity field
-  ComputeVelocityCurlVorticity();
+  // They feed back into the velocity so they use full precision scratch fields rather than the reduced precision diagnostics
+  std::vector<std::vector<std::vector<float>>> curlX= AllocRunField(0.0f);
+  std::vector<std::vector<std::vector<float>>> curlY= AllocRunField(0.0f);
+  std::vector<std::vector<std::vector<float>>> curlZ= AllocRunField(0.0f);
+  std::vector<std::vector<std::vector<float>>> vort= AllocRunField(0.0f);
+  ComputeVelocityCurlVorticity(curlX, curlY, curlZ, vort);
   // Amplify non-zero vorticity
   if (iVortiCoeff > 0.0f) {
     for (int x= 0; x < nX; x++) {
       for (int y= 0; y < nY; y++) {
-        for (int z= 0; z < nZ; z++) {
-          if (Solid[x][y][z] || VelBC[x][y][z]) continue;
-          // Gradient of vorticity with zero derivative at solid interface or domain boundary
-          Vec::Vec3<float> vortGrad(0.0f, 0.0f, 0.0f);
-          if (x - 1 >= 0 && !Solid[x - 1][y][z]) vortGrad[0]+= (Vort[x][y][z] - Vort[x - 1][y][z]) / (2.0f * voxSize);
-          if (y - 1 >= 0 && !Solid[x][y - 1][z]) vortGrad[1]+= (Vort[x][y][z] - Vort[x][y - 1][z]) / (2.0f * voxSize);
-          if (z - 1 >= 0 && !Solid[x][y][z - 1]) vortGrad[2]+= (Vort[x][y][z] - Vort[x][y][z - 1]) / (2.0f * voxSize);
-          if (x + 1 < nX && !Solid[x + 1][y][z]) vortGrad[0]+= (Vort[x + 1][y][z] - Vort[x][y][z]) / (2.0f * voxSize);
-          if (y + 1 < nY && !Solid[x][y + 1][z]) vortGrad[1]+= (Vort[x][y + 1][z] - Vort[x][y][z]) / (2.0f * voxSize);
-          if (z + 1 < nZ && !Solid[x][y][z + 1]) vortGrad[2]+= (Vort[x][y][z + 1] - Vort[x][y][z]) / (2.0f * voxSize);
-          // Amplification of small scale vorticity by following current curl
-          if (vortGrad.norm() > 0.0f) {
-            const float dVort_dx_scaled= iVortiCoeff * vortGrad[0] / vortGrad.norm();
-            const float dVort_dy_scaled= iVortiCoeff * vortGrad[1] / vortGrad.norm();
-            const float dVort_dz_scaled= iVortiCoeff * vortGrad[2] / vortGrad.norm();
-            ioVelX[x][y][z]+= iTimeStep * (dVort_dy_scaled * CurZ[x][y][z] - dVort_dz_scaled * CurY[x][y][z]);
-            ioVelY[x][y][z]+= iTimeStep * (dVort_dz_scaled * CurX[x][y][z] - dVort_dx_scaled * CurZ[x][y][z]);
-            ioVelZ[x][y][z]+= iTimeStep * (dVort_dx_scaled * CurY[x][y][z] - dVort_dy_scaled * CurX[x][y][z]);
+        for (std::array<int, 2> span : FreeSpans[FieldID::IDVelX][x][y]) {
+          for (int z= span[0]; z < span[1]; z++) {
+            // Gradient of vorticity with zero derivative at solid interface or domain boundary
+            Vec::Vec3<float> vortGrad(0.0f, 0.0f, 0.0f);
+            if (x - 1 >= 0 && !Solid[x - 1][y][z]) vortGrad[0]+= (vort[x][y][z] - vort[x - 1][y][z]) / (2.0f * voxSize);
+            if (y - 1 >= 0 && !Solid[x][y - 1][z]) vortGrad[1]+= (vort[x][y][z] - vort[x][y - 1][z]) / (2.0f * voxSize);
+            if (z - 1 >= 0 && !Solid[x][y][z - 1]) vortGrad[2]+= (vort[x][y][z] - vort[x][y][z - 1]) / (2.0f * voxSize);
+            if (x + 1 < nX && !Solid[x + 1][y][z]) vortGrad[0]+= (vort[x + 1][y][z] - vort[x][y][z]) / (2.0f * voxSize);
+            if (y + 1 < nY && !Solid[x][y + 1][z]) vortGrad[1]+= (vort[x][y + 1][z] - vort[x][y][z]) / (2.0f * voxSize);
+            if (z + 1 < nZ && !Solid[x][y][z + 1]) vortGrad[2]+= (vort[x][y][z + 1] - vort[x][y][z]) / (2.0f * voxSize);
+            // Amplification of small scale vorticity by following current curl
+            if (vortGrad.norm() > 0.0f) {
+              const float dVort_dx_scaled= iVortiCoeff * vortGrad[0] / vortGrad.norm();
+              const float dVort_dy_scaled= iVortiCoeff * vortGrad[1] / vortGrad.norm();
+              const float dVort_dz_scaled= iVortiCoeff * vortGrad[2] / vortGrad.norm();
+              ioVelX[x][y][z]+= iTimeStep * (dVort_dy_scaled * curlZ[x][y][z] - dVort_dz_scaled * curlY[x][y][z]);
+              ioVelY[x][y][z]+= iTimeStep * (dVort_dz_scaled * curlX[x][y][z] - dVort_dx_scaled * curlZ[x][y][z]);
+              ioVelZ[x][y][z]+= iTimeStep * (dVort_dx_scaled * curlY[x][y][z] - dVort_dy_scaled * curlX[x][y][z]);
+            }
           }
         }
       }
@@ -1084,6 +2820,263 @@ void CompuFluidDyna::VorticityConfinement(const float iTimeStep, const float iVo
 }
 
 
+// Build the lattice of the Boltzmann engine and size the distributions
+// D3Q19 in 3D, tensor product of D1Q3 otherwise which gives D2Q9 in 2D and D1Q3 in 1D
+// References for lattice Boltzmann method
+// https://en.wikipedia.org/wiki/Lattice_Boltzmann_methods
+// https://link.springer.com/book/10.1007/978-3-319-44649-3 Krüger et al. The Lattice Boltzmann Method
+void CompuFluidDyna::LatticeBoltzmannInit() {
+  const bool is3D= (nX > 1 && nY > 1 && nZ > 1);
+  LbmDir.clear();
+  LbmWeight.clear();
+  for (int i= -1; i <= 1; i++) {
+    for (int j= -1; j <= 1; j++) {
+      for (int k= -1; k <= 1; k++) {
+        if ((nX == 1 && i != 0) || (nY == 1 && j != 0) || (nZ == 1 && k != 0)) continue;
+        const int nbNonZero= std::abs(i) + std::abs(j) + std::abs(k);
+        if (is3D && nbNonZero == 3) continue;  // D3Q19 drops the corner velocities of D3Q27
+        float weight= 1.0f;
+        if (is3D) {
+          weight= (nbNonZero == 0) ? (1.0f / 3.0f) : ((nbNonZero == 1) ? (1.0f / 18.0f) : (1.0f / 36.0f));
+        }
+        else {
+          if (nX > 1) weight*= (i == 0) ? (2.0f / 3.0f) : (1.0f / 6.0f);
+          if (nY > 1) weight*= (j == 0) ? (2.0f / 3.0f) : (1.0f / 6.0f);
+          if (nZ > 1) weight*= (k == 0) ? (2.0f / 3.0f) : (1.0f / 6.0f);
+        }
+        LbmDir.push_back({i, j, k});
+        LbmWeight.push_back(weight);
+      }
+    }
+  }
+  lbmNbDir= (int)LbmDir.size();
+  LbmOpp.resize(lbmNbDir);
+  for (int k0= 0; k0 < lbmNbDir; k0++)
+    for (int k1= 0; k1 < lbmNbDir; k1++)
+      if (LbmDir[k0][0] == -LbmDir[k1][0] && LbmDir[k0][1] == -LbmDir[k1][1] && LbmDir[k0][2] == -LbmDir[k1][2])
+        LbmOpp[k0]= k1;
+
+  // Distributions are set from the macroscopic fields at the first step
+  const size_t nbDist= (size_t)lbmNbDir * nX * nY * nZ;
+  LbmDist.assign(nbDist, 0.0f);
+  LbmDistNew.assign(nbDist, 0.0f);
+  lbmTimeStep= 0.0f;
+
+  // Reference velocity from the initial and enforced velocities and the Bernoulli velocity of the enforced pressure differences
+  float presMin= 0.0f, presMax= 0.0f;
+  lbmVelRef= maxVelMag;
+  for (int x= 0; x < nX; x++) {
+    for (int y= 0; y < nY; y++) {
+      for (int z= 0; z < nZ; z++) {
+        if (Scen->IsVelBC(x, y, z)) {
+          const Vec::Vec3<float> vel(Scen->VelXForced[x][y][z], Scen->VelYForced[x][y][z], Scen->VelZForced[x][y][z]);
+          lbmVelRef= std::max(lbmVelRef, vel.norm());
+        }
+        if (Scen->IsPreBC(x, y, z)) {
+          presMin= std::min(presMin, Scen->PresForced[x][y][z]);
+          presMax= std::max(presMax, Scen->PresForced[x][y][z]);
+        }
+      }
+    }
+  }
+  lbmVelRef= std::max(lbmVelRef, std::sqrt(2.0f * (presMax - presMin) / fluidDensity));
+}
+
+
+// Advance the velocity and pressure fields with the lattice Boltzmann engine
+// - Two relaxation time collision fused with pull streaming, distributions stored per direction so streaming along Z is contiguous
+// - Half-way bounce back on solid voxels and domain boundaries
+// - Enforced velocity voxels act as moving walls with the momentum corrected bounce back of Ladd
+// - Equilibrium pressure boundaries on enforced pressure voxels
+// - Gravity on smoke applied with the velocity shift forcing
+// - Lattice substeps keep the lattice velocity below lbmMaxVelLat to limit compressibility errors
+void CompuFluidDyna::LatticeBoltzmannStep(const float iTimeStep) {
+  if (LbmDist.empty()) LatticeBoltzmannInit();
+
+  // Get the lattice time step and conversion factors
+  // The reference velocity only follows the flow once it clearly exceeds the expected one, e.g. for buoyancy driven flows
+  if (maxVelMag > 2.0f * lbmVelRef) lbmVelRef= maxVelMag;
+  const int nbSub= std::max((int)std::ceil(iTimeStep * lbmVelRef / (voxSize * lbmMaxVelLat)), 1);
+  const float dtLat= iTimeStep / (float)nbSub;
+  const float velScale= dtLat / voxSize;                                      // Physical to lattice velocity
+  const float presScale= 3.0f * velScale * velScale / fluidDensity;           // Physical pressure to lattice density deviation
+  const float accScale= dtLat * dtLat / voxSize;                              // Physical to lattice acceleration
+  const float tau= std::max(3.0f * std::max(D.UI[CoeffDiffuV_].GetF(), 0.0f) * dtLat / (voxSize * voxSize) + 0.5f, 0.5f + lbmMinTauGap);
+  const float gravi= D.UI[CoeffGravi__].GetB() ? D.UI[CoeffGravi__].GetF() * accScale : 0.0f;
+  if (D.UI[VerboseSolv_].GetB()) printf("LBM  substeps %d  tau %.4f  Ma %.4f\n", nbSub, tau, lbmVelRef * velScale * std::sqrt(3.0f));
+
+  // Index in the distributions stored per direction
+  const auto Idx= [&](const int k, const int x, const int y, const int z) {
+    return (((size_t)k * nX + x) * nY + y) * nZ + z;
+  };
+
+  // Equilibrium distribution for the given density and lattice velocity
+  const auto Equilibrium= [&](const int k, const float rho, const float ux, const float uy, const float uz) {
+    const float cu= (float)LbmDir[k][0] * ux + (float)LbmDir[k][1] * uy + (float)LbmDir[k][2] * uz;
+    return LbmWeight[k] * rho * (1.0f + 3.0f * cu + 4.5f * cu * cu - 1.5f * (ux * ux + uy * uy + uz * uz));
+  };
+
+  // Reset the distributions to the equilibrium of the macroscopic fields when the lattice units changed
+  if (dtLat != lbmTimeStep) {
+    SweepTiles(FluidSpans, [&](const int x, const int y, const int zBeg, const int zEnd) {
+      for (int z= zBeg; z < zEnd; z++) {
+        const float rho= 1.0f + presScale * Pres[x][y][z];
+        for (int k= 0; k < lbmNbDir; k++)
+          LbmDist[Idx(k, x, y, z)]= Equilibrium(k, rho, velScale * VelX[x][y][z], velScale * VelY[x][y][z], velScale * VelZ[x][y][z]);
+      }
+    });
+    lbmTimeStep= dtLat;
+  }
+
+  for (int iSub= 0; iSub < nbSub; iSub++) {
+    const bool lastSub= (iSub == nbSub - 1);
+    SweepTiles(FluidSpans, [&](const int x, const int y, const int zBeg, const int zEnd) {
+      float f[19], feq[19];
+      for (int z= zBeg; z < zEnd; z++) {
+        // Enforced velocity voxels act as moving walls and keep their enforced values
+        if (Scen->IsVelBC(x, y, z) && !Scen->IsPreBC(x, y, z)) {
+          if (lastSub) {
+            VelX[x][y][z]= Scen->VelXForced[x][y][z];
+            VelY[x][y][z]= Scen->VelYForced[x][y][z];
+            VelZ[x][y][z]= Scen->VelZForced[x][y][z];
+          }
+          continue;
+        }
+
+        // Pull the post collision distributions from the upwind neighbors
+        // Bounce back from solids and boundaries, with the momentum of the wall from moving walls
+        // Diagonal neighbors may lie in columns without storage, which are all solid
+        float rho= 0.0f, ux= 0.0f, uy= 0.0f, uz= 0.0f;
+        for (int k= 0; k < lbmNbDir; k++) {
+          const int xs= x - LbmDir[k][0], ys= y - LbmDir[k][1], zs= z - LbmDir[k][2];
+          if (xs < 0 || xs >= nX || ys < 0 || ys >= nY || zs < 0 || zs >= nZ || IsSolid(xs, ys, zs)) {
+            f[k]= LbmDist[Idx(LbmOpp[k], x, y, z)];
+          }
+          else if (Scen->IsVelBC(xs, ys, zs) && !Scen->IsPreBC(xs, ys, zs)) {
+            const float cu= (float)LbmDir[k][0] * Scen->VelXForced[xs][ys][zs] + (float)LbmDir[k][1] * Scen->VelYForced[xs][ys][zs] + (float)LbmDir[k][2] * Scen->VelZForced[xs][ys][zs];
+            f[k]= LbmDist[Idx(LbmOpp[k], x, y, z)] + 6.0f * LbmWeight[k] * velScale * cu;
+          }
+          else {
+            f[k]= LbmDist[Idx(k, xs, ys, zs)];
+          }
+          rho+= f[k];
+          ux+= f[k] * (float)LbmDir[k][0];
+          uy+= f[k] * (float)LbmDir[k][1];
+          uz+= f[k] * (float)LbmDir[k][2];
+        }
+        ux/= rho;
+        uy/= rho;
+        uz/= rho;
+
+        if (Scen->IsPreBC(x, y, z)) {
+          // Enforced pressure voxels are reset to the equilibrium of their enforced pressure
+          // Their velocity is extrapolated from the free fluid neighbors so the boundary stays open
+          rho= 1.0f + presScale * Scen->PresForced[x][y][z];
+          float nbrUx= 0.0f, nbrUy= 0.0f, nbrUz= 0.0f;
+          int nbNbr= 0;
+          for (int k= 0; k < lbmNbDir; k++) {
+            if (std::abs(LbmDir[k][0]) + std::abs(LbmDir[k][1]) + std::abs(LbmDir[k][2]) != 1) continue;
+            const int xn= x + LbmDir[k][0], yn= y + LbmDir[k][1], zn= z + LbmDir[k][2];
+            if (xn < 0 || xn >= nX || yn < 0 || yn >= nY || zn < 0 || zn >= nZ) continue;
+            if (Solid[xn][yn][zn] || Scen->IsVelBC(xn, yn, zn) || Scen->IsPreBC(xn, yn, zn)) continue;
+            float rhoN= 0.0f, uxN= 0.0f, uyN= 0.0f, uzN= 0.0f;
+            for (int kN= 0; kN < lbmNbDir; kN++) {
+              const float fN= LbmDist[Idx(kN, xn, yn, zn)];
+              rhoN+= fN;
+              uxN+= fN * (float)LbmDir[kN][0];
+              uyN+= fN * (float)LbmDir[kN][1];
+              uzN+= fN * (float)LbmDir[kN][2];
+            }
+            nbrUx+= uxN / rhoN;
+            nbrUy+= uyN / rhoN;
+            nbrUz+= uzN / rhoN;
+            nbNbr++;
+          }
+          if (nbNbr > 0) {
+            ux= nbrUx / (float)nbNbr;
+            uy= nbrUy / (float)nbNbr;
+            uz= nbrUz / (float)nbNbr;
+          }
+          if (Scen->IsVelBC(x, y, z)) {
+            ux= velScale * Scen->VelXForced[x][y][z];
+            uy= velScale * Scen->VelYForced[x][y][z];
+            uz= velScale * Scen->VelZForced[x][y][z];
+          }
+          for (int k= 0; k < lbmNbDir; k++)
+            LbmDistNew[Idx(k, x, y, z)]= Equilibrium(k, rho, ux, uy, uz);
+        }
+        else {
+          // TRT relaxation of the symmetric and antisymmetric parts towards the equilibrium shifted by the body force
+          // The antisymmetric rate follows from the magic parameter 1/4 that keeps the bounce back walls halfway between voxels
+          // Smagorinsky eddy viscosity from the non equilibrium momentum flux keeps under resolved flows stable
+          const float accZ= gravi * Smok[x][y][z];
+          float flux[3][3]= {{0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f}};
+          for (int k= 0; k < lbmNbDir; k++) {
+            feq[k]= Equilibrium(k, rho, ux, uy, uz + tau * accZ);
+            for (int i= 0; i < 3; i++)
+              for (int j= 0; j < 3; j++)
+                flux[i][j]+= (float)(LbmDir[k][i] * LbmDir[k][j]) * (f[k] - feq[k]);
+          }
+          float fluxNorm= 0.0f;
+          for (int i= 0; i < 3; i++)
+            for (int j= 0; j < 3; j++)
+              fluxNorm+= flux[i][j] * flux[i][j];
+          const float tauEff= 0.5f * (tau + std::sqrt(tau * tau + 18.0f * lbmSmagoCoeff * lbmSmagoCoeff * std::sqrt(fluxNorm) / rho));
+          const float omegaSym= 1.0f / tauEff;
+          const float omegaAsy= 1.0f / (0.25f / (tauEff - 0.5f) + 0.5f);
+          for (int k= 0; k < lbmNbDir; k++) {
+            const int kOpp= LbmOpp[k];
+            const float neqSym= 0.5f * ((f[k] + f[kOpp]) - (feq[k] + feq[kOpp]));
+            const float neqAsy= 0.5f * ((f[k] - f[kOpp]) - (feq[k] - feq[kOpp]));
+            LbmDistNew[Idx(k, x, y, z)]= f[k] - omegaSym * neqSym - omegaAsy * neqAsy;
+          }
+          uz+= 0.5f * accZ;
+        }
+
+        // Convert the macroscopic values back to physical units
+        if (lastSub) {
+          VelX[x][y][z]= ux / velScale;
+          VelY[x][y][z]= uy / velScale;
+          VelZ[x][y][z]= uz / velScale;
+          Pres[x][y][z]= (rho - 1.0f) / presScale;
+        }
+      }
+    });
+    std::swap(LbmDist, LbmDistNew);
+  }
+}
+
+
+// Bring a diagnostic field up to date with the current state
+// The field is allocated on first use and recomputed only after a time step or a geometry change
+void CompuFluidDyna::UpdateDiagnostic(const int iDiagID) {
+  if (diagStep[iDiagID] == simStep) return;
+  if (iDiagID == DiagID::DiagDive) ComputeVelocityDivergence();
+  if (iDiagID == DiagID::DiagVort) ComputeVelocityCurlVorticity();
+  if (iDiagID == DiagID::DiagVmag) ComputeVelocityMagnitude();
+  if (iDiagID == DiagID::DiagStrR) ComputeStrainRate();
+  if (iDiagID == DiagID::DiagAdjS) ComputeAdjointSensitivity();
+  diagStep[iDiagID]= simStep;
+}
+
+
+// Measure the max velocity magnitude for the adaptive time step
+void CompuFluidDyna::ComputeMaxVelocity() {
+  for (int x= 0; x < nX; x++)
+    for (int y= 0; y < nY; y++)
+      ColPartial[x][y]= 0.0f;
+  SweepTiles(FluidSpans, [&](const int x, const int y, const int zBeg, const int zEnd) {
+    for (int z= zBeg; z < zEnd; z++)
+      ColPartial[x][y]= std::max(ColPartial[x][y], VelX[x][y][z] * VelX[x][y][z] + VelY[x][y][z] * VelY[x][y][z] + VelZ[x][y][z] * VelZ[x][y][z]);
+  });
+  float maxVelMagSqr= 0.0f;
+  for (int x= 0; x < nX; x++)
+    for (int y= 0; y < nY; y++)
+      maxVelMagSqr= std::max(maxVelMagSqr, ColPartial[x][y]);
+  maxVelMag= std::sqrt(maxVelMagSqr);
+}
+
+
 // Compute RHS of pressure poisson equation as negative divergence scaled by density and timestep
 // https://en.wikipedia.org/wiki/Projection_method_(fluid_dynamics)
 // RHS = -(ρ / Δt) × ∇ · vel
@@ -1118,78 +3111,101 @@ void CompuFluidDyna::ComputeVelocityDivergence() {
   //   }
   // }
   // Compute divergence of velocity field
-  for (int x= 0; x < nX; x++) {
-    for (int y= 0; y < nY; y++) {
-      for (int z= 0; z < nZ; z++) {
-        if (Solid[x][y][z]) Dive[x][y][z]= 0.0f;
-        if (PreBC[x][y][z]) Dive[x][y][z]= PresForced[x][y][z];
-        if (Solid[x][y][z] || PreBC[x][y][z]) continue;
-        // Classical linear interpolation for face velocities with same velocity at domain boundary and zero velocity at solid interface
-        float velXN= (x - 1 >= 0) ? ((Solid[x - 1][y][z]) ? (0.0f) : ((VelX[x][y][z] + VelX[x - 1][y][z]) / 2.0f)) : (VelX[x][y][z]);
-        float velYN= (y - 1 >= 0) ? ((Solid[x][y - 1][z]) ? (0.0f) : ((VelY[x][y][z] + VelY[x][y - 1][z]) / 2.0f)) : (VelY[x][y][z]);
-        float velZN= (z - 1 >= 0) ? ((Solid[x][y][z - 1]) ? (0.0f) : ((VelZ[x][y][z] + VelZ[x][y][z - 1]) / 2.0f)) : (VelZ[x][y][z]);
-        float velXP= (x + 1 < nX) ? ((Solid[x + 1][y][z]) ? (0.0f) : ((VelX[x + 1][y][z] + VelX[x][y][z]) / 2.0f)) : (VelX[x][y][z]);
-        float velYP= (y + 1 < nY) ? ((Solid[x][y + 1][z]) ? (0.0f) : ((VelY[x][y + 1][z] + VelY[x][y][z]) / 2.0f)) : (VelY[x][y][z]);
-        float velZP= (z + 1 < nZ) ? ((Solid[x][y][z + 1]) ? (0.0f) : ((VelZ[x][y][z + 1] + VelZ[x][y][z]) / 2.0f)) : (VelZ[x][y][z]);
-        // // Rhie and Chow correction terms
-        // if (iUseRhieChow) {
-        //   // Subtract pressure gradients with neighboring cells
-        //   velXN-= D.UI[CoeffProj1__].GetF() * ((x - 1 >= 0 && !Solid[x - 1][y][z]) ? ((Pres[x][y][z] - Pres[x - 1][y][z]) / voxSize) : (0.0f));
-        //   velYN-= D.UI[CoeffProj1__].GetF() * ((y - 1 >= 0 && !Solid[x][y - 1][z]) ? ((Pres[x][y][z] - Pres[x][y - 1][z]) / voxSize) : (0.0f));
-        //   velZN-= D.UI[CoeffProj1__].GetF() * ((z - 1 >= 0 && !Solid[x][y][z - 1]) ? ((Pres[x][y][z] - Pres[x][y][z - 1]) / voxSize) : (0.0f));
-        //   velXP-= D.UI[CoeffProj1__].GetF() * ((x + 1 < nX && !Solid[x + 1][y][z]) ? ((Pres[x + 1][y][z] - Pres[x][y][z]) / voxSize) : (0.0f));
-        //   velYP-= D.UI[CoeffProj1__].GetF() * ((y + 1 < nY && !Solid[x][y + 1][z]) ? ((Pres[x][y + 1][z] - Pres[x][y][z]) / voxSize) : (0.0f));
-        //   velZP-= D.UI[CoeffProj1__].GetF() * ((z + 1 < nZ && !Solid[x][y][z + 1]) ? ((Pres[x][y][z + 1] - Pres[x][y][z]) / voxSize) : (0.0f));
-        //   // Add Linear interpolations of pressure gradients with neighboring cells
-        //   velXN+= D.UI[CoeffProj2__].GetF() * ((x - 1 >= 0) ? ((PresGradX[x][y][z] + PresGradX[x - 1][y][z]) / 2.0f) : (PresGradX[x][y][z]));
-        //   velYN+= D.UI[CoeffProj2__].GetF() * ((y - 1 >= 0) ? ((PresGradY[x][y][z] + PresGradY[x][y - 1][z]) / 2.0f) : (PresGradX[x][y][z]));
-        //   velZN+= D.UI[CoeffProj2__].GetF() * ((z - 1 >= 0) ? ((PresGradZ[x][y][z] + PresGradZ[x][y][z - 1]) / 2.0f) : (PresGradX[x][y][z]));
-        //   velXP+= D.UI[CoeffProj2__].GetF() * ((x + 1 < nX) ? ((PresGradX[x + 1][y][z] + PresGradX[x][y][z]) / 2.0f) : (PresGradX[x][y][z]));
-        //   velYP+= D.UI[CoeffProj2__].GetF() * ((y + 1 < nY) ? ((PresGradY[x][y + 1][z] + PresGradY[x][y][z]) / 2.0f) : (PresGradX[x][y][z]));
-        //   velZP+= D.UI[CoeffProj2__].GetF() * ((z + 1 < nZ) ? ((PresGradZ[x][y][z + 1] + PresGradZ[x][y][z]) / 2.0f) : (PresGradX[x][y][z]));
-        // }
-        // Divergence based on face velocities scaled by density and timestep  (negated RHS and linear system to have positive diag coeffs)
-        Dive[x][y][z]= -fluidDensity / D.UI[TimeStep____].GetF() * ((velXP - velXN) + (velYP - velYN) + (velZP - velZN)) / voxSize;
-      }
-    }
+  // Voxels with enforced pressure take the forced value as divergence
+  SweepTiles(FluidSpans, [&](const int x, const int y, const int zBeg, const int zEnd) {
+    for (int z= zBeg; z < zEnd; z++)
+      if (Scen->IsPreBC(x, y, z)) Dive[x][y][z]= isHomogeneousBC ? 0.0f : Scen->PresForced[x][y][z];
+  });
+  SweepTiles(FreeSpans[FieldID::IDPres], [&](const int x, const int y, const int zBeg, const int zEnd) {
+    const std::array<const float*, 5> colsX= NeighborCols(VelX, x, y);
+    const std::array<const float*, 5> colsY= NeighborCols(VelY, x, y);
+    const float* velZ= VelZ[x][y].data();
+    const uint16_t* flags= FaceFlags[x][y].data();
+    float* dive= Dive[x][y].data();
+    SweepColumn(zBeg, zEnd, [&](const int z, const int zN, const int zP) {
+      auto Fluid= [&](const int iDir) { return (float)((flags[z] >> iDir) & 1u); };
+      auto Outside= [&](const int iDir) { return (float)(((~flags[z] >> iDir) & (~flags[z] >> (iDir + 8))) & 1u); };
+      // Classical linear interpolation for face velocities with same velocity at domain boundary and zero velocity at solid interface
+      float velXN= Fluid(0) * ((colsX[0][z] + colsX[1][z]) / 2.0f) + Outside(0) * colsX[0][z];
+      float velYN= Fluid(2) * ((colsY[0][z] + colsY[3][z]) / 2.0f) + Outside(2) * colsY[0][z];
+      float velZN= Fluid(4) * ((velZ[z] + velZ[zN]) / 2.0f) + Outside(4) * velZ[z];
+      float velXP= Fluid(1) * ((colsX[2][z] + colsX[0][z]) / 2.0f) + Outside(1) * colsX[0][z];
+      float velYP= Fluid(3) * ((colsY[4][z] + colsY[0][z]) / 2.0f) + Outside(3) * colsY[0][z];
+      float velZP= Fluid(5) * ((velZ[zP] + velZ[z]) / 2.0f) + Outside(5) * velZ[z];
+      // // Rhie and Chow correction terms
+      // if (iUseRhieChow) {
+      //   // Subtract pressure gradients with neighboring cells
+      //   velXN-= D.UI[CoeffProj1__].GetF() * ((x - 1 >= 0 && !Solid[x - 1][y][z]) ? ((Pres[x][y][z] - Pres[x - 1][y][z]) / voxSize) : (0.0f));
+      //   velYN-= D.UI[CoeffProj1__].GetF() * ((y - 1 >= 0 && !Solid[x][y - 1][z]) ? ((Pres[x][y][z] - Pres[x][y - 1][z]) / voxSize) : (0.0f));
+      //   velZN-= D.UI[CoeffProj1__].GetF() * ((z - 1 >= 0 && !Solid[x][y][z - 1]) ? ((Pres[x][y][z] - Pres[x][y][z - 1]) / voxSize) : (0.0f));
+      //   velXP-= D.UI[CoeffProj1__].GetF() * ((x + 1 < nX && !Solid[x + 1][y][z]) ? ((Pres[x + 1][y][z] - Pres[x][y][z]) / voxSize) : (0.0f));
+      //   velYP-= D.UI[CoeffProj1__].GetF() * ((y + 1 < nY && !Solid[x][y + 1][z]) ? ((Pres[x][y + 1][z] - Pres[x][y][z]) / voxSize) : (0.0f));
+      //   velZP-= D.UI[CoeffProj1__].GetF() * ((z + 1 < nZ && !Solid[x][y][z + 1]) ? ((Pres[x][y][z + 1] - Pres[x][y][z]) / voxSize) : (0.0f));
+      //   // Add Linear interpolations of pressure gradients with neighboring cells
+      //   velXN+= D.UI[CoeffProj2__].GetF() * ((x - 1 >= 0) ? ((PresGradX[x][y][z] + PresGradX[x - 1][y][z]) / 2.0f) : (PresGradX[x][y][z]));
+      //   velYN+= D.UI[CoeffProj2__].GetF() * ((y - 1 >= 0) ? ((PresGradY[x][y][z] + PresGradY[x][y - 1][z]) / 2.0f) : (PresGradX[x][y][z]));
+      //   velZN+= D.UI[CoeffProj2__].GetF() * ((z - 1 >= 0) ? ((PresGradZ[x][y][z] + PresGradZ[x][y][z - 1]) / 2.0f) : (PresGradX[x][y][z]));
+      //   velXP+= D.UI[CoeffProj2__].GetF() * ((x + 1 < nX) ? ((PresGradX[x + 1][y][z] + PresGradX[x][y][z]) / 2.0f) : (PresGradX[x][y][z]));
+      //   velYP+= D.UI[CoeffProj2__].GetF() * ((y + 1 < nY) ? ((PresGradY[x][y + 1][z] + PresGradY[x][y][z]) / 2.0f) : (PresGradX[x][y][z]));
+      //   velZP+= D.UI[CoeffProj2__].GetF() * ((z + 1 < nZ) ? ((PresGradZ[x][y][z + 1] + PresGradZ[x][y][z]) / 2.0f) : (PresGradX[x][y][z]));
+      // }
+      // Divergence based on face velocities scaled by density and timestep  (negated RHS and linear system to have positive diag coeffs)
+      dive[z]= -fluidDensity / simTimeStep * ((velXP - velXN) + (velYP - velYN) + (velZP - velZN)) / voxSize;
+    });
+  });
+}
+
+
+// Compute curl and vorticity of current velocity field in the reduced precision diagnostic fields
+void CompuFluidDyna::ComputeVelocityCurlVorticity() {
+  if (Vort.empty()) {
+    Vort= AllocDiagField(0.0f);
+    CurX= AllocDiagField(0.0f);
+    CurY= AllocDiagField(0.0f);
+    CurZ= AllocDiagField(0.0f);
   }
+  ComputeVelocityCurlVorticity(CurX, CurY, CurZ, Vort);
 }
 
 
-// Compute curl and vorticity of current velocity field
+// Compute curl and vorticity of current velocity field in fields of the given precision
 // curl= ∇ ⨯ vel
 // vort= ‖curl‖₂
-void CompuFluidDyna::ComputeVelocityCurlVorticity() {
-  for (int x= 0; x < nX; x++) {
-    for (int y= 0; y < nY; y++) {
-      for (int z= 0; z < nZ; z++) {
-        CurX[x][y][z]= CurY[x][y][z]= CurZ[x][y][z]= Vort[x][y][z]= 0.0f;
-        if (Solid[x][y][z]) continue;
-        // Compute velocity cross derivatives considering BC at interface with solid
-        float dVely_dx= 0.0f, dVelz_dx= 0.0f, dVelx_dy= 0.0f, dVelz_dy= 0.0f, dVelx_dz= 0.0f, dVely_dz= 0.0f;
-        if (x - 1 >= 0 && x + 1 < nX) dVely_dx= ((Solid[x + 1][y][z] ? VelY[x][y][z] : VelY[x + 1][y][z]) - (Solid[x - 1][y][z] ? VelY[x][y][z] : VelY[x - 1][y][z])) / 2.0f;
-        if (x - 1 >= 0 && x + 1 < nX) dVelz_dx= ((Solid[x + 1][y][z] ? VelZ[x][y][z] : VelZ[x + 1][y][z]) - (Solid[x - 1][y][z] ? VelZ[x][y][z] : VelZ[x - 1][y][z])) / 2.0f;
-        if (y - 1 >= 0 && y + 1 < nY) dVelx_dy= ((Solid[x][y + 1][z] ? VelX[x][y][z] : VelX[x][y + 1][z]) - (Solid[x][y - 1][z] ? VelX[x][y][z] : VelX[x][y - 1][z])) / 2.0f;
-        if (y - 1 >= 0 && y + 1 < nY) dVelz_dy= ((Solid[x][y + 1][z] ? VelZ[x][y][z] : VelZ[x][y + 1][z]) - (Solid[x][y - 1][z] ? VelZ[x][y][z] : VelZ[x][y - 1][z])) / 2.0f;
-        if (z - 1 >= 0 && z + 1 < nZ) dVelx_dz= ((Solid[x][y][z + 1] ? VelX[x][y][z] : VelX[x][y][z + 1]) - (Solid[x][y][z - 1] ? VelX[x][y][z] : VelX[x][y][z - 1])) / 2.0f;
-        if (z - 1 >= 0 && z + 1 < nZ) dVely_dz= ((Solid[x][y][z + 1] ? VelY[x][y][z] : VelY[x][y][z + 1]) - (Solid[x][y][z - 1] ? VelY[x][y][z] : VelY[x][y][z - 1])) / 2.0f;
-        // Deduce curl and vorticity
-        CurX[x][y][z]= dVelz_dy - dVely_dz;
-        CurY[x][y][z]= dVelx_dz - dVelz_dx;
-        CurZ[x][y][z]= dVely_dx - dVelx_dy;
-        Vort[x][y][z]= std::sqrt(CurX[x][y][z] * CurX[x][y][z] + CurY[x][y][z] * CurY[x][y][z] + CurZ[x][y][z] * CurZ[x][y][z]);
-      }
+template <typename T>
+void CompuFluidDyna::ComputeVelocityCurlVorticity(std::vector<std::vector<std::vector<T>>>& oCurX, std::vector<std::vector<std::vector<T>>>& oCurY,
+                                                  std::vector<std::vector<std::vector<T>>>& oCurZ, std::vector<std::vector<std::vector<T>>>& oVort) {
+  SweepTiles(FluidSpans, [&](const int x, const int y, const int zBeg, const int zEnd) {
+    for (int z= zBeg; z < zEnd; z++) {
+      // Compute velocity cross derivatives considering BC at interface with solid
+      float dVely_dx= 0.0f, dVelz_dx= 0.0f, dVelx_dy= 0.0f, dVelz_dy= 0.0f, dVelx_dz= 0.0f, dVely_dz= 0.0f;
+      if (x - 1 >= 0 && x + 1 < nX) dVely_dx= ((Solid[x + 1][y][z] ? VelY[x][y][z] : VelY[x + 1][y][z]) - (Solid[x - 1][y][z] ? VelY[x][y][z] : VelY[x - 1][y][z])) / 2.0f;
+      if (x - 1 >= 0 && x + 1 < nX) dVelz_dx= ((Solid[x + 1][y][z] ? VelZ[x][y][z] : VelZ[x + 1][y][z]) - (Solid[x - 1][y][z] ? VelZ[x][y][z] : VelZ[x - 1][y][z])) / 2.0f;
+      if (y - 1 >= 0 && y + 1 < nY) dVelx_dy= ((Solid[x][y + 1][z] ? VelX[x][y][z] : VelX[x][y + 1][z]) - (Solid[x][y - 1][z] ? VelX[x][y][z] : VelX[x][y - 1][z])) / 2.0f;
+      if (y - 1 >= 0 && y + 1 < nY) dVelz_dy= ((Solid[x][y + 1][z] ? VelZ[x][y][z] : VelZ[x][y + 1][z]) - (Solid[x][y - 1][z] ? VelZ[x][y][z] : VelZ[x][y - 1][z])) / 2.0f;
+      if (z - 1 >= 0 && z + 1 < nZ) dVelx_dz= ((Solid[x][y][z + 1] ? VelX[x][y][z] : VelX[x][y][z + 1]) - (Solid[x][y][z - 1] ? VelX[x][y][z] : VelX[x][y][z - 1])) / 2.0f;
+      if (z - 1 >= 0 && z + 1 < nZ) dVely_dz= ((Solid[x][y][z + 1] ? VelY[x][y][z] : VelY[x][y][z + 1]) - (Solid[x][y][z - 1] ? VelY[x][y][z] : VelY[x][y][z - 1])) / 2.0f;
+      // Deduce curl and vorticity
+      const float curX= dVelz_dy - dVely_dz;
+      const float curY= dVelx_dz - dVelz_dx;
+      const float curZ= dVely_dx - dVelx_dy;
+      oCurX[x][y][z]= curX;
+      oCurY[x][y][z]= curY;
+      oCurZ[x][y][z]= curZ;
+      oVort[x][y][z]= std::sqrt(curX * curX + curY * curY + curZ * curZ);
     }
-  }
+  });
 }
 
 // Compute the Velocity magnitude
 // Vmag= ‖vel‖₂
 void CompuFluidDyna::ComputeVelocityMagnitude() {
+  if (Vmag.empty()) Vmag= AllocDiagField(0.0f);
   for (int x= 0; x < nX; x++) {
     for (int y= 0; y < nY; y++) {
-      for (int z= 0; z < nZ; z++) {        
-        Vmag[x][y][z]= std::sqrt(VelX[x][y][z] * VelX[x][y][z] + VelY[x][y][z] * VelY[x][y][z] + VelZ[x][y][z] * VelZ[x][y][z]);
+      for (std::array<int, 2> span : FluidSpans[x][y]) {
+        for (int z= span[0]; z < span[1]; z++) {
+          Vmag[x][y][z]= std::sqrt(VelX[x][y][z] * VelX[x][y][z] + VelY[x][y][z] * VelY[x][y][z] + VelZ[x][y][z] * VelZ[x][y][z]);
+        }
       }
     }
   }
@@ -1204,11 +3220,11 @@ float CompuFluidDyna::ComputePressureDrop(const bool iMode) {
   for (int x= 0; x < nX; x++) {
     for (int y= 0; y < nY; y++) {
       for (int z= 0; z < nZ; z++) {
-        if (VelBC[x][y][z]) {
+        if (Scen->IsVelBC(x, y, z)) {
           sumPres += Pres[x][y][z];
           nbPresIn++;
         } 
-        // else if (PreBC[x][y][z]) {
+        // else if (Scen->PreBC[x][y][z]) {
         //   sumVelY += VelY[x][y][z];
         //   sumVelZ += VelZ[x][y][z];
         //   nbPresOut++;
@@ -1224,28 +3240,35 @@ float CompuFluidDyna::ComputePressureDrop(const bool iMode) {
   return PD;
 }
 
+// Get the normal direction (1 is X, 2 is Y, 3 is Z, 0 if undefined) and the position along it of the section the mass flow rate is measured on
+int CompuFluidDyna::GetMFRSection(int& oPos) {
+  const int scenarioType= D.UI[Scenario____].GetI();
+  const int inputFile= D.UI[InputFile___].GetI();
+  oPos= 0;
+  // Depends on the scenario
+  if (scenarioType != 0) return 0;
+  // In all input files, the inlets are on the left and the outlets to the right
+  if (inputFile != 4) {
+    oPos= nY / 2;
+    return 2; // (0,1,0) direction
+  }
+  oPos= 5 * nZ / 6;
+  return 3; // (0,0,1) direction
+}
+
 // Compute the mass flow rates depending on the scenario
 void CompuFluidDyna::ComputeMassFlowRates(bool iComputeAll) {
   MFR.clear();
   float sumVel = 0.0f;
-  int MFRNormalDir;
-  const int scenarioType= D.UI[Scenario____].GetI();
+  int sectionPos;
+  const int MFRNormalDir= GetMFRSection(sectionPos);
   const int inputFile= D.UI[InputFile___].GetI();
-  // In all input files, the inlets are on the left and the outlets to the right
-  if (scenarioType == 0) {
-    if (inputFile != 4)
-      MFRNormalDir = 2; // (0,1,0) direction
-    else 
-      MFRNormalDir = 3; // (0,0,1) direction
-  } else {
-    // Depends on the scenario
-  }
   if (MFRNormalDir == 1) {
     for (int y= 0; y < nY; y++) {
       for (int z= 0; z < nZ; z++) {
-        if (!Solid[nX/2][y][z]) {
+        if (!IsSolid(sectionPos, y, z)) {
           // m * normal velocity
-          sumVel += fluidDensity * VelX[nX/2][y][z];
+          sumVel += fluidDensity * VelX[sectionPos][y][z];
         }
       }
     }
@@ -1253,9 +3276,9 @@ void CompuFluidDyna::ComputeMassFlowRates(bool iComputeAll) {
   if (MFRNormalDir == 2) {
     for (int x= 0; x < nX; x++) {
       for (int z= 0; z < nZ; z++) {
-        if (!Solid[x][nY/2][z]) {
+        if (!IsSolid(x, sectionPos, z)) {
           // m * normal velocity
-          sumVel += fluidDensity * VelY[x][nY/2][z];
+          sumVel += fluidDensity * VelY[x][sectionPos][z];
         }
       }
     }
@@ -1263,16 +3286,9 @@ void CompuFluidDyna::ComputeMassFlowRates(bool iComputeAll) {
   if (MFRNormalDir == 3) {    
     for (int x= 0; x < nX; x++) {
       for (int y= 0; y < nY; y++) {        
-        if (inputFile != 4) {
-          if (!Solid[x][y][nZ/2]) {
-            // m * normal velocity
-            sumVel += fluidDensity * VelZ[x][y][nZ/2];
-          }
-        } else {
-          if (!Solid[x][y][5*nZ/6]) {                   
-            // m * normal velocity
-            sumVel += fluidDensity * VelZ[x][y][5*nZ/6];
-          }
+        if (!IsSolid(x, y, sectionPos)) {
+          // m * normal velocity
+          sumVel += fluidDensity * VelZ[x][y][sectionPos];
         }
       }
     }
@@ -1301,6 +3317,7 @@ void CompuFluidDyna::ComputeMassFlowRates(bool iComputeAll) {
       // ---------------------------
       sumVel = 0;
       for (int i = 0; i < nY && i < nZ; i++) {
+        if (!StoredCols[0][i]) continue;
         sumVel += VelY[0][i][i] - VelZ[0][i][i];
       }
       MFR.push_back(std::abs(sumVel));
@@ -1324,7 +3341,7 @@ void CompuFluidDyna::ComputeMassFlowRates(bool iComputeAll) {
       // ---------------------------
       sumVel = 0;
       for (int z= 0; z < nZ; z++) {
-        if (!Solid[0][5*nY/6][z]) {
+        if (!IsSolid(0, 5*nY/6, z)) {
           sumVel += fluidDensity * VelY[0][5*nY/6][z];
         }
       }
@@ -1339,320 +3356,443 @@ void CompuFluidDyna::ComputeKineticEnergy() {
   float ke = 0.0f;
   for (int x= 0; x < nX; x++) {
     for (int y= 0; y < nY; y++) {
-      for (int z= 0; z < nZ; z++) {
+      for (std::array<int, 2> span : FluidSpans[x][y]) {
+        for (int z= span[0]; z < span[1]; z++) {
           // m * v^2
           ke += fluidDensity * (VelX[x][y][z] * VelX[x][y][z] + VelY[x][y][z] * VelY[x][y][z] + VelZ[x][y][z] * VelZ[x][y][z]);
         }
       }
-    } 
+    }
+  }
   KE = 0.5 * ke;
 }
 
 // Compute the volume out of the solid voxels (for the pipes diameter estimation)
 void CompuFluidDyna::ComputeVolumeOutOfSolid() {
-  int vol = 0;
-  for (int x= 0; x < nX; x++) {
-    for (int y= 0; y < nY; y++) {
-      for (int z= 0; z < nZ; z++) {
-          if (!Solid[x][y][z])
-            vol++;
-        }
-      }
-    }
-  VolOOS = vol;
+  // Number of non-solid voxels, kept up to date by the spans as voxels flip
+  VolOOS= (float)nbFluidVox;
 }
-
-// Compute the boundary area (for the pipes diameter estimation)
 void CompuFluidDyna::ComputeGeometrySurfaceArea() {
-  int area = 0;
-  // bool sSwitch = false;
-  // for (int x= 0; x < nX; x++) {
-  //   for (int y= 0; y < nY; y++) {
-  //     for (int z= 0; z < nZ; z++) {
-  //       if (!sSwitch && !Solid[x][y][z]) {      
-  //         sSwitch = true;
-  //         area++;
-  //       }
-  //       if (sSwitch) {
-  //         if (nX > 0) {
-  //           if (x > 0 && Solid[x - 1][y][z])
-  //             area++;
-  //           if (x < nX - 1 && Solid[x + 1][y][z]) 
-  //             area++;
-  //         }
-  //         if (y > 0 && Solid[x][y - 1][z]) 
-  //           area++;
-  //         if (y < nY - 1 && Solid[x][y + 1][z]) 
-  //           area++;
-  //         if (z < nZ - 1 && Solid[x][y][z+1]) {
-  //           area++;
-  //           sSwitch = false;            
-  //         }
-  //       }
-  //     }
-  //     sSwitch = false;
-  //   }
-  // }
-  for (int x= 0; x < nX; x++) {
-    for (int y= 0; y < nY; y++) {
-      for (int z= 0; z < nZ; z++) {
-        if (Solid[x][y][z]) {      
-          if ( (x > 0 && !Solid[x - 1][y][z])
-            || (x < nX - 1 && !Solid[x + 1][y][z])
-            || (y > 0 && !Solid[x][y - 1][z])
-            || (y < nY - 1 && !Solid[x][y + 1][z])
-            || (z > 0 && !Solid[x][y][z - 1])
-            || (z < nZ - 1 && !Solid[x][y][z + 1])
-            ) {
-            area++;
-          }
-        }
-      }
-    }
-  }
-  SurfArea = area;
+  // Number of solid voxels with a non-solid neighbor, kept up to date by the spans as voxels flip
+  SurfArea= (float)nbIfacVox;
 }
 
 // Compute the strain rate (frobenius norm of the strain rate tensor at each voxel of the grid)
 void CompuFluidDyna::ComputeStrainRate() {  
-  // Jacobian matrix of the velocity field
-  std::vector<std::vector<float>> jac = Field::AllocField2D(3, 3, 0.0f);
-  float velXN, velYN, velZN, velXP, velYP, velZP;
-  for (int x= 0; x < nX; x++) {
-    for (int y= 0; y < nY; y++) {
-      for (int z= 0; z < nZ; z++) {        
-        if (Solid[x][y][z]) continue;
-        // First column of the jacobian matrix
-        // (Classical linear interpolation for face velocities with same velocity at domain boundary and zero velocity at solid interface)
-        if (x - 1 >= 0) {
-          if (Solid[x - 1][y][z]) {
-            velXN = velYN = velZN = 0.0f;
-          } else {
-            velXN = (VelX[x][y][z] + VelX[x - 1][y][z]) / 2.0f;
-            velYN = (VelY[x][y][z] + VelY[x - 1][y][z]) / 2.0f;
-            velZN = (VelZ[x][y][z] + VelZ[x - 1][y][z]) / 2.0f;
-          }
+  if (StrRate.empty()) StrRate= AllocDiagField(0.0f);
+  SweepTiles(FluidSpans, [&](const int x, const int y, const int zBeg, const int zEnd) {
+    // Jacobian matrix of the velocity field, private to the subdomain thread
+    float jac[3][3];
+    float velXN, velYN, velZN, velXP, velYP, velZP;
+    for (int z= zBeg; z < zEnd; z++) {
+      // First column of the jacobian matrix
+      // (Classical linear interpolation for face velocities with same velocity at domain boundary and zero velocity at solid interface)
+      if (x - 1 >= 0) {
+        if (Solid[x - 1][y][z]) {
+          velXN = velYN = velZN = 0.0f;
         } else {
-          velXN = VelX[x][y][z];
-          velYN = VelY[x][y][z];
-          velZN = VelZ[x][y][z];
+          velXN = (VelX[x][y][z] + VelX[x - 1][y][z]) / 2.0f;
+          velYN = (VelY[x][y][z] + VelY[x - 1][y][z]) / 2.0f;
+          velZN = (VelZ[x][y][z] + VelZ[x - 1][y][z]) / 2.0f;
         }
-        if (x + 1 < nX) {
-          if (Solid[x + 1][y][z]) {
-            velXP = velYP = velZP = 0.0f;
-          } else {
-            velXP = (VelX[x][y][z] + VelX[x + 1][y][z]) / 2.0f;
-            velYP = (VelY[x][y][z] + VelY[x + 1][y][z]) / 2.0f;
-            velZP = (VelZ[x][y][z] + VelZ[x + 1][y][z]) / 2.0f;
-          }
+      } else {
+        velXN = VelX[x][y][z];
+        velYN = VelY[x][y][z];
+        velZN = VelZ[x][y][z];
+      }
+      if (x + 1 < nX) {
+        if (Solid[x + 1][y][z]) {
+          velXP = velYP = velZP = 0.0f;
         } else {
-          velXP = VelX[x][y][z];
-          velYP = VelY[x][y][z];
-          velZP = VelZ[x][y][z];
+          velXP = (VelX[x][y][z] + VelX[x + 1][y][z]) / 2.0f;
+          velYP = (VelY[x][y][z] + VelY[x + 1][y][z]) / 2.0f;
+          velZP = (VelZ[x][y][z] + VelZ[x + 1][y][z]) / 2.0f;
         }
-        jac[0][0] = velXP - velXN / voxSize;
-        jac[1][0] = velYP - velYN / voxSize;
-        jac[2][0] = velZP - velZN / voxSize;        
-        // Second column of the jacobian matrix
-        // (Classical linear interpolation for face velocities with same velocity at domain boundary and zero velocity at solid interface)
-        if (y - 1 >= 0) {
-          if (Solid[x][y - 1][z]) {
-            velXN = velYN = velZN = 0.0f;
-          } else {
-            velXN = (VelX[x][y][z] + VelX[x][y - 1][z]) / 2.0f;
-            velYN = (VelY[x][y][z] + VelY[x][y - 1][z]) / 2.0f;
-            velZN = (VelZ[x][y][z] + VelZ[x][y - 1][z]) / 2.0f;
-          }
+      } else {
+        velXP = VelX[x][y][z];
+        velYP = VelY[x][y][z];
+        velZP = VelZ[x][y][z];
+      }
+      jac[0][0] = velXP - velXN / voxSize;
+      jac[1][0] = velYP - velYN / voxSize;
+      jac[2][0] = velZP - velZN / voxSize;        
+      // Second column of the jacobian matrix
+      // (Classical linear interpolation for face velocities with same velocity at domain boundary and zero velocity at solid interface)
+      if (y - 1 >= 0) {
+        if (Solid[x][y - 1][z]) {
+          velXN = velYN = velZN = 0.0f;
         } else {
-          velXN = VelX[x][y][z];
-          velYN = VelY[x][y][z];
-          velZN = VelZ[x][y][z];
+          velXN = (VelX[x][y][z] + VelX[x][y - 1][z]) / 2.0f;
+          velYN = (VelY[x][y][z] + VelY[x][y - 1][z]) / 2.0f;
+          velZN = (VelZ[x][y][z] + VelZ[x][y - 1][z]) / 2.0f;
         }
-        if (y + 1 < nY) {
-          if (Solid[x][y + 1][z]) {
-            velXP = velYP = velZP = 0.0f;
-          } else {
-            velXP = (VelX[x][y][z] + VelX[x][y + 1][z]) / 2.0f;
-            velYP = (VelY[x][y][z] + VelY[x][y + 1][z]) / 2.0f;
-            velZP = (VelZ[x][y][z] + VelZ[x][y + 1][z]) / 2.0f;
-          }
+      } else {
+        velXN = VelX[x][y][z];
+        velYN = VelY[x][y][z];
+        velZN = VelZ[x][y][z];
+      }
+      if (y + 1 < nY) {
+        if (Solid[x][y + 1][z]) {
+          velXP = velYP = velZP = 0.0f;
         } else {
-          velXP = VelX[x][y][z];
-          velYP = VelY[x][y][z];
-          velZP = VelZ[x][y][z];
+          velXP = (VelX[x][y][z] + VelX[x][y + 1][z]) / 2.0f;
+          velYP = (VelY[x][y][z] + VelY[x][y + 1][z]) / 2.0f;
+          velZP = (VelZ[x][y][z] + VelZ[x][y + 1][z]) / 2.0f;
         }
-        jac[0][1] = velXP - velXN / voxSize;
-        jac[1][1] = velYP - velYN / voxSize;
-        jac[2][1] = velZP - velZN / voxSize;        
-        // Third column of the jacobian matrix
-        // (Classical linear interpolation for face velocities with same velocity at domain boundary and zero velocity at solid interface)
-        if (z - 1 >= 0) {
-          if (Solid[x][y][z - 1]) {
-            velXN = velYN = velZN = 0.0f;
-          } else {
-            velXN = (VelX[x][y][z] + VelX[x][y][z - 1]) / 2.0f;
-            velYN = (VelY[x][y][z] + VelY[x][y][z - 1]) / 2.0f;
-            velZN = (VelZ[x][y][z] + VelZ[x][y][z - 1]) / 2.0f;
-          }
+      } else {
+        velXP = VelX[x][y][z];
+        velYP = VelY[x][y][z];
+        velZP = VelZ[x][y][z];
+      }
+      jac[0][1] = velXP - velXN / voxSize;
+      jac[1][1] = velYP - velYN / voxSize;
+      jac[2][1] = velZP - velZN / voxSize;        
+      // Third column of the jacobian matrix
+      // (Classical linear interpolation for face velocities with same velocity at domain boundary and zero velocity at solid interface)
+      if (z - 1 >= 0) {
+        if (Solid[x][y][z - 1]) {
+          velXN = velYN = velZN = 0.0f;
         } else {
-          velXN = VelX[x][y][z];
-          velYN = VelY[x][y][z];
-          velZN = VelZ[x][y][z];
+          velXN = (VelX[x][y][z] + VelX[x][y][z - 1]) / 2.0f;
+          velYN = (VelY[x][y][z] + VelY[x][y][z - 1]) / 2.0f;
+          velZN = (VelZ[x][y][z] + VelZ[x][y][z - 1]) / 2.0f;
         }
-        if (z + 1 < nZ) {
-          if (Solid[x][y][z + 1]) {
-            velXP = velYP = velZP = 0.0f;
-          } else {
-            velXP = (VelX[x][y][z] + VelX[x][y][z + 1]) / 2.0f;
-            velYP = (VelY[x][y][z] + VelY[x][y][z + 1]) / 2.0f;
-            velZP = (VelZ[x][y][z] + VelZ[x][y][z + 1]) / 2.0f;
-          }
+      } else {
+        velXN = VelX[x][y][z];
+        velYN = VelY[x][y][z];
+        velZN = VelZ[x][y][z];
+      }
+      if (z + 1 < nZ) {
+        if (Solid[x][y][z + 1]) {
+          velXP = velYP = velZP = 0.0f;
         } else {
-          velXP = VelX[x][y][z];
-          velYP = VelY[x][y][z];
-          velZP = VelZ[x][y][z];
+          velXP = (VelX[x][y][z] + VelX[x][y][z + 1]) / 2.0f;
+          velYP = (VelY[x][y][z] + VelY[x][y][z + 1]) / 2.0f;
+          velZP = (VelZ[x][y][z] + VelZ[x][y][z + 1]) / 2.0f;
         }
-        jac[0][2] = velXP - velXN / voxSize;
-        jac[1][2] = velYP - velYN / voxSize;
-        jac[2][2] = velZP - velZN / voxSize;        
-        // S = || 1/2 * (J + J^T) ||_2
-        StrRate[x][y][z] = 0.0f;
-        for (int i = 0; i < 3; i++) {
-          for (int j = 0; j < 3; j++) {
-            StrRate[x][y][z] += (jac[i][j] + jac[j][i]) * (jac[i][j] + jac[j][i]);
-          }
+      } else {
+        velXP = VelX[x][y][z];
+        velYP = VelY[x][y][z];
+        velZP = VelZ[x][y][z];
+      }
+      jac[0][2] = velXP - velXN / voxSize;
+      jac[1][2] = velYP - velYN / voxSize;
+      jac[2][2] = velZP - velZN / voxSize;        
+      // S = || 1/2 * (J + J^T) ||_2
+      float strRate = 0.0f;
+      for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+          strRate += (jac[i][j] + jac[j][i]) * (jac[i][j] + jac[j][i]);
         }
-        StrRate[x][y][z] *= 1.0f / 4.0f;
-        StrRate[x][y][z] = std::sqrt(StrRate[x][y][z]);
       }
+      strRate *= 1.0f / 4.0f;
+      StrRate[x][y][z] = std::sqrt(strRate);
     }
-  }
+  });
 }
 
+// Ties are broken on the coordinates so full and partial sorts give the same order
 struct less_than
 {
     inline bool operator() (const std::tuple<int,int,int,float>& elt1, const std::tuple<int,int,int,float>& elt2)
     {
-        return (get<3>(elt1) < get<3>(elt2));
+        if (get<3>(elt1) != get<3>(elt2)) return (get<3>(elt1) < get<3>(elt2));
+        return (std::make_tuple(get<0>(elt1), get<1>(elt1), get<2>(elt1)) < std::make_tuple(get<0>(elt2), get<1>(elt2), get<2>(elt2)));
     }
 };
 struct more_than
 {
     inline bool operator() (const std::tuple<int,int,int,float>& elt1, const std::tuple<int,int,int,float>& elt2)
     {
-        return (get<3>(elt1) > get<3>(elt2));
+        if (get<3>(elt1) != get<3>(elt2)) return (get<3>(elt1) > get<3>(elt2));
+        return (std::make_tuple(get<0>(elt1), get<1>(elt1), get<2>(elt1)) < std::make_tuple(get<0>(elt2), get<1>(elt2), get<2>(elt2)));
     }
 };
 
-// sorts the voxels of the solid interface with respect to the scalar field iField values 
-std::vector<std::tuple<int,int,int,float>> CompuFluidDyna::SortVoxels(const std::vector<std::vector<std::vector<float>>>& iField, 
-                                                                      const bool iAvg,
-                                                                      const bool iReverse,
-                                                                      const std::vector<std::tuple<int,int,int,float>> &coordsToAvoid
-                                                                      ) {
-  std::vector<std::tuple<int,int,int,float>> vec;
-  std::vector<std::vector<std::vector<bool>>> passField = Field::AllocField3D(nX,nY,nZ,false);
+
+// Mark the safe zone of voxels within SafeZoneRad_ of a boundary condition voxel or of the domain boundary
+// The box neighborhood is dilated one axis at a time so the cost does not depend on the radius
+// Only the columns reached by the dilation of the boundary condition voxels are stored, the band along the domain boundary is tested by IsSafeZone
+// A copy of the solver state sharing the scenario boundary conditions takes its own before rebuilding the zone
+void CompuFluidDyna::BuildSafeZone() {
+  if (Scen.use_count() > 1) Scen= std::make_shared<ScenarioBC>(*Scen);
+  safeZoneRad= std::max(D.UI[SafeZoneRad_].GetI(), 0);
+  Scen->SafeZone= Field::AllocField2D(nX, nY, std::vector<bool>());
   for (int x= 0; x < nX; x++) {
-    for (int y= 0; y < nY; y++ ) {
+    for (int y= 0; y < nY; y++) {
+      if (Scen->VelBC[x][y].empty() && Scen->PreBC[x][y].empty() && Scen->SmoBC[x][y].empty()) continue;
+      std::vector<bool> col(nZ, false);
+      bool isMarked= false;
       for (int z= 0; z < nZ; z++) {
-        if ( SmoBC[x][y][z] || PreBC[x][y][z] || VelBC[x][y][z]
-            || (nX > 1 && (x == 0 || x == nX - 1))
-            || (nY > 1 && (y == 0 || y == nY - 1))
-            || (nZ > 1 && (z == 0 || z == nZ - 1))
-          ) {
-          for (int i= -std::min(D.UI[SafeZoneRad_].GetI(),x); i <= std::min(D.UI[SafeZoneRad_].GetI(), nX - 1 - x); i++) {
-            for (int j= -std::min(D.UI[SafeZoneRad_].GetI(),y); j <= std::min(D.UI[SafeZoneRad_].GetI(), nY - 1 - y); j++) {
-              for (int k= -std::min(D.UI[SafeZoneRad_].GetI(),z); k <= std::min(D.UI[SafeZoneRad_].GetI(), nZ - 1 - z); k++) {
-          // for (int i= -D.UI[SafeZoneRad_].GetI(); i <= D.UI[SafeZoneRad_].GetI(); i++) {
-          //   for (int j= -D.UI[SafeZoneRad_].GetI(); j <= D.UI[SafeZoneRad_].GetI(); j++) {
-          //     for (int k= -D.UI[SafeZoneRad_].GetI(); k <= D.UI[SafeZoneRad_].GetI(); k++) {
-          //       if (x + i >= 0 && y + j >= 0 && z + k >= 0 && x + i < nX && y + j < nY && z + k < nZ)
-                passField[x + i][y + j][z + k] = true;
-              }
+        col[z]= Scen->IsSmoBC(x, y, z) || Scen->IsPreBC(x, y, z) || Scen->IsVelBC(x, y, z);
+        isMarked= isMarked || col[z];
+      }
+      if (isMarked) Scen->SafeZone[x][y].swap(col);
+    }
+  }
+  // Dilate along each axis from the distance to the nearest marked voxel in both directions
+  const std::array<int, 3> dims= {nX, nY, nZ};
+  for (int axis= 0; axis < 3; axis++) {
+    const int n= dims[axis];
+    std::vector<int> dist(n);
+    for (int i0= 0; i0 < dims[(axis + 1) % 3]; i0++) {
+      for (int i1= 0; i1 < dims[(axis + 2) % 3]; i1++) {
+        auto Column= [&](const int k, int& oZ) -> std::vector<bool>& {
+          std::array<int, 3> idx;
+          idx[axis]= k;
+          idx[(axis + 1) % 3]= i0;
+          idx[(axis + 2) % 3]= i1;
+          oZ= idx[2];
+          return Scen->SafeZone[idx[0]][idx[1]];
+        };
+        auto Voxel= [&](const int k) {
+          int z;
+          const std::vector<bool>& col= Column(k, z);
+          return !col.empty() && col[z];
+        };
+        int last= -safeZoneRad - 1;
+        for (int k= 0; k < n; k++) {
+          if (Voxel(k)) last= k;
+          dist[k]= k - last;
+        }
+        if (last < 0) continue;
+        last= n + safeZoneRad;
+        for (int k= n - 1; k >= 0; k--) {
+          if (Voxel(k)) last= k;
+          dist[k]= std::min(dist[k], last - k);
+        }
+        for (int k= 0; k < n; k++) {
+          if (dist[k] > safeZoneRad) continue;
+          int z;
+          std::vector<bool>& col= Column(k, z);
+          if (col.empty()) col.assign(nZ, false);
+          col[z]= true;
+        }
+      }
+    }
+  }
+}
+
+
+// Get the safe zone flag of a voxel, the band within SafeZoneRad_ of the domain boundary along the non flat axes is always in it
+bool CompuFluidDyna::IsSafeZone(const int x, const int y, const int z) const {
+  if (nX > 1 && std::min(x, nX - 1 - x) <= safeZoneRad) return true;
+  if (nY > 1 && std::min(y, nY - 1 - y) <= safeZoneRad) return true;
+  if (nZ > 1 && std::min(z, nZ - 1 - z) <= safeZoneRad) return true;
+  return !Scen->SafeZone[x][y].empty() && Scen->SafeZone[x][y][z];
+}
+
+// Compute the sensitivity of the mass flow rate to the solid state of the voxels with a continuous adjoint of the flow
+// The adjoint velocity λ and pressure q solve the momentum equation linearized around the current flow, transposed
+//   - (vel · ∇) λ - visco ∇²λ + ∇q = ∂MFR/∂vel
+//   ∇ · λ = 0
+// with λ= 0 on solid and enforced velocity voxels and q= 0 on enforced pressure voxels
+// The (∇vel)ᵀ λ term of the full Navier Stokes adjoint is neglected so the problem has the operators of the forward solver
+// It is marched to steady state in pseudo time in place of the flow fields, advecting λ along -vel frozen at the current flow
+// Turning a solid voxel into fluid then changes the mass flow rate in proportion to vel · λ around it, as for a Brinkman penalization
+// https://doi.org/10.1002/fld.426
+void CompuFluidDyna::ComputeAdjointSensitivity() {
+  if (AdjSens.empty()) AdjSens= AllocDiagField(0.0f);
+  const int nbIter= std::max(D.UI[AdjointIter_].GetI(), 0);
+  const int maxIter= std::max(D.UI[SolvMaxIter_].GetI(), 0);
+  const float coeffVisco= std::max(D.UI[CoeffDiffuV_].GetF(), 0.0f);
+  const float timestep= simTimeStep;
+
+  // The objective is the absolute flow through the section, its gradient has the sign of the flow
+  int sectionPos;
+  const int sectionDir= GetMFRSection(sectionPos);
+  if (sectionDir == 0) {
+    AdjSens= AllocDiagField(0.0f);
+    return;
+  }
+  auto OnSection= [&](const int x, const int y, const int z) {
+    return (sectionDir == 1 && x == sectionPos) || (sectionDir == 2 && y == sectionPos) || (sectionDir == 3 && z == sectionPos);
+  };
+  float sumVel= 0.0f;
+  for (int x= 0; x < nX; x++)
+    for (int y= 0; y < nY; y++)
+      for (std::array<int, 2> span : FluidSpans[x][y])
+        for (int z= span[0]; z < span[1]; z++)
+          if (OnSection(x, y, z))
+            sumVel+= fluidDensity * ((sectionDir == 1) ? VelX[x][y][z] : ((sectionDir == 2) ? VelY[x][y][z] : VelZ[x][y][z]));
+  const float source= timestep * fluidDensity * ((sumVel < 0.0f) ? -1.0f : 1.0f);
+
+  // Solve with homogeneous boundary conditions and the adjoint fields in place of the flow fields
+  // The flags, spans and solvers of the flow are reused as is, the flow fields are set aside and restored at the end
+  // The previous adjoint solution is reused as initial guess, with storage for the columns activated since
+  std::vector<std::vector<std::vector<float>>> flowVelX, flowVelY, flowVelZ, flowPres;
+  flowVelX.swap(VelX);
+  flowVelY.swap(VelY);
+  flowVelZ.swap(VelZ);
+  flowPres.swap(Pres);
+  VelX= AdjVelX.empty() ? AllocRunField(0.0f) : std::move(AdjVelX);
+  VelY= AdjVelY.empty() ? AllocRunField(0.0f) : std::move(AdjVelY);
+  VelZ= AdjVelZ.empty() ? AllocRunField(0.0f) : std::move(AdjVelZ);
+  Pres= AllocRunField(0.0f);
+  for (std::vector<std::vector<std::vector<float>>>* field : {&VelX, &VelY, &VelZ}) {
+    for (int x= 0; x < nX; x++)
+      for (int y= 0; y < nY; y++)
+        if (StoredCols[x][y] && (*field)[x][y].empty()) (*field)[x][y].assign(nZ, 0.0f);
+  }
+  isHomogeneousBC= true;
+  ApplyBC(FieldID::IDVelX, VelX);
+  ApplyBC(FieldID::IDVelY, VelY);
+  ApplyBC(FieldID::IDVelZ, VelZ);
+  std::vector<std::vector<std::vector<float>>>& adjN= (sectionDir == 1) ? VelX : ((sectionDir == 2) ? VelY : VelZ);
+  // Work copies are assigned in place at each iteration to reuse their storage
+  std::vector<std::vector<std::vector<float>>> oldField, oldX, oldY, oldZ;
+  auto Diffuse= [&](const int iFieldID, std::vector<std::vector<std::vector<float>>>& ioField) {
+    oldField= ioField;
+    if (D.UI[SolvType____].GetI() == 0) GaussSeidelSolve(iFieldID, maxIter, timestep, true, coeffVisco, oldField, ioField);
+    else if (D.UI[SolvType____].GetI() == 1) GradientDescentSolve(iFieldID, maxIter, timestep, true, coeffVisco, oldField, ioField);
+    else ConjugateGradientSolve(iFieldID, maxIter, timestep, true, coeffVisco, oldField, ioField);
+  };
+  for (int idxIter= 0; idxIter < nbIter; idxIter++) {
+    // Objective gradient on the fluid voxels of the section
+    for (int x= 0; x < nX; x++) {
+      for (int y= 0; y < nY; y++) {
+        for (std::array<int, 2> span : FreeSpans[FieldID::IDVelX][x][y]) {
+          for (int z= span[0]; z < span[1]; z++) {
+            if (OnSection(x, y, z)) adjN[x][y][z]+= source;
+          }
+        }
+      }
+    }
+    // Semi-Lagrangian transport of λ along -vel
+    oldX= VelX;
+    oldY= VelY;
+    oldZ= VelZ;
+    const std::vector<std::vector<std::vector<float>>>* lamFields[3]= {&oldX, &oldY, &oldZ};
+#pragma omp parallel for collapse(2) schedule(dynamic)
+    for (int x= 0; x < nX; x++) {
+      for (int y= 0; y < nY; y++) {
+        for (std::array<int, 2> span : FreeSpans[FieldID::IDVelX][x][y]) {
+          for (int zBeg= span[0]; zBeg < span[1]; zBeg+= nbBatchVox) {
+            const int nbVox= std::min(nbBatchVox, span[1] - zBeg);
+            float posX[nbBatchVox], posY[nbBatchVox], posZ[nbBatchVox];
+            float sampled[3][nbBatchVox];
+            float* sampledPtr[3]= {sampled[0], sampled[1], sampled[2]};
+            for (int k= 0; k < nbVox; k++) {
+              posX[k]= (float)x + timestep * flowVelX[x][y][zBeg + k] / voxSize;
+              posY[k]= (float)y + timestep * flowVelY[x][y][zBeg + k] / voxSize;
+              posZ[k]= (float)(zBeg + k) + timestep * flowVelZ[x][y][zBeg + k] / voxSize;
+            }
+            TrilinearInterpolationBatch(nbVox, posX, posY, posZ, 3, lamFields, sampledPtr);
+            for (int k= 0; k < nbVox; k++) {
+              VelX[x][y][zBeg + k]= sampled[0][k];
+              VelY[x][y][zBeg + k]= sampled[1][k];
+              VelZ[x][y][zBeg + k]= sampled[2][k];
             }
           }
         }
       }
     }
+    // Viscous diffusion and projection on divergence free adjoint fields
+    if (D.UI[CoeffDiffuV_].GetB()) {
+      if (nX > 1) Diffuse(FieldID::IDVelX, VelX);
+      if (nY > 1) Diffuse(FieldID::IDVelY, VelY);
+      if (nZ > 1) Diffuse(FieldID::IDVelZ, VelZ);
+    }
+    ProjectField(maxIter, timestep, VelX, VelY, VelZ);
   }
-  // int l = 0;
-  // for (int x= 0; x < nX; x++) {
-  //   for (int y= 0; y < nY; y++ ) {
-  //     for (int z= 0; z < nZ; z++) {
-  //       if (passField[x][y][z])
-  //         l++;
-  //     }
-  //   }
-  // }
-  // printf("nb ignored voxels : %d\n", l);
-  int x,y,z;
-  for (auto it = coordsToAvoid.begin(); it != coordsToAvoid.end(); ++it) { 
-    int i = std::distance(coordsToAvoid.begin(), it);
-    x = get<0>(coordsToAvoid[i]);
-    y = get<1>(coordsToAvoid[i]);
-    z = get<2>(coordsToAvoid[i]);
-    passField[x][y][z] = true;    
-  }
+
+  // Sensitivity on the fluid voxels, read by SortVoxels as the average around each interface voxel
+  SweepTiles(FluidSpans, [&](const int x, const int y, const int zBeg, const int zEnd) {
+    for (int z= zBeg; z < zEnd; z++)
+      AdjSens[x][y][z]= flowVelX[x][y][z] * VelX[x][y][z] + flowVelY[x][y][z] * VelY[x][y][z] + flowVelZ[x][y][z] * VelZ[x][y][z];
+  });
+  if (D.UI[Verbose_____].GetB()) printf("Adjoint sensitivity  iter %d  MFR %f\n", nbIter, std::abs(sumVel));
+
+  // Keep the adjoint solution and restore the flow, the divergence now holds the one of the adjoint
+  isHomogeneousBC= false;
+  AdjVelX= std::move(VelX);
+  AdjVelY= std::move(VelY);
+  AdjVelZ= std::move(VelZ);
+  VelX.swap(flowVelX);
+  VelY.swap(flowVelY);
+  VelZ.swap(flowVelZ);
+  Pres.swap(flowPres);
+  diagStep[DiagID::DiagDive]= -1;
+}
+
+// sorts the voxels of the solid interface with respect to the scalar field iField values 
+// Only the interface spans are swept and only the leading fraction iFracSorted of the candidates is sorted, the tail is left unordered
+std::vector<std::tuple<int,int,int,float>> CompuFluidDyna::SortVoxels(const std::vector<std::vector<std::vector<diag_float>>>& iField, 
+                                                                      const bool iAvg,
+                                                                      const bool iReverse,
+                                                                      const float iFracSorted) {
+  std::vector<std::tuple<int,int,int,float>> vec;
+  vec.reserve(nbIfacVox);
+  if (safeZoneRad != std::max(D.UI[SafeZoneRad_].GetI(), 0))
+    BuildSafeZone();
   for (int x= 0; x < nX; x++) {
     for (int y= 0; y < nY; y++) {
-      for (int z= 0; z < nZ; z++) {
-        if (!Solid[x][y][z] || passField[x][y][z])
-          continue;
-        int count = 0;
-        float sum = 0.0f;
-        if (x - 1 >= 0 && !Solid[x - 1][y][z] && ++count) sum+= iField[x - 1][y][z];
-        if (y - 1 >= 0 && !Solid[x][y - 1][z] && ++count) sum+= iField[x][y - 1][z];
-        if (z - 1 >= 0 && !Solid[x][y][z - 1] && ++count) sum+= iField[x][y][z - 1];
-        if (x + 1 < nX && !Solid[x + 1][y][z] && ++count) sum+= iField[x + 1][y][z];
-        if (y + 1 < nY && !Solid[x][y + 1][z] && ++count) sum+= iField[x][y + 1][z];
-        if (z + 1 < nZ && !Solid[x][y][z + 1] && ++count) sum+= iField[x][y][z + 1];
-        if (count > 0) {
-          if (iAvg) {
-            std::tuple<int,int,int,float> tup(x,y,z,sum/(float)count);
-            vec.push_back(tup);
-          } else {
-            std::tuple<int,int,int,float> tup(x,y,z,iField[x][y][z]);
-            vec.push_back(tup);
-          }   
+      for (std::array<int, 2> span : IfacSpans[x][y]) {
+        for (int z= span[0]; z < span[1]; z++) {
+          if (IsSafeZone(x, y, z) || OptimAvoid[x][y][z])
+            continue;
+          int count = 0;
+          float sum = 0.0f;
+          if (x - 1 >= 0 && !IsSolid(x - 1, y, z) && ++count) sum+= iField[x - 1][y][z];
+          if (y - 1 >= 0 && !IsSolid(x, y - 1, z) && ++count) sum+= iField[x][y - 1][z];
+          if (z - 1 >= 0 && !Solid[x][y][z - 1] && ++count) sum+= iField[x][y][z - 1];
+          if (x + 1 < nX && !IsSolid(x + 1, y, z) && ++count) sum+= iField[x + 1][y][z];
+          if (y + 1 < nY && !IsSolid(x, y + 1, z) && ++count) sum+= iField[x][y + 1][z];
+          if (z + 1 < nZ && !Solid[x][y][z + 1] && ++count) sum+= iField[x][y][z + 1];
+          if (count > 0) {
+            if (iAvg) {
+              std::tuple<int,int,int,float> tup(x,y,z,sum/(float)count);
+              vec.push_back(tup);
+            } else {
+              std::tuple<int,int,int,float> tup(x,y,z,iField[x][y][z]);
+              vec.push_back(tup);
+            }   
+          }
         }
       }
     }
   }
+  // Partial selection of the leading candidates
+  const int nbSorted= std::min(std::max((int)std::ceil(iFracSorted * (float)vec.size()), 0), (int)vec.size());
   if (iReverse)
-    std::sort(vec.begin(), vec.end(), more_than());
+    std::partial_sort(vec.begin(), vec.begin() + nbSorted, vec.end(), more_than());
   else
-    std::sort(vec.begin(), vec.end(), less_than());
+    std::partial_sort(vec.begin(), vec.begin() + nbSorted, vec.end(), less_than());
   return vec;
 }
 
 // Step of the heuristic optimization criterion method
 // https://open-research-europe.ec.europa.eu/articles/3-156
-void CompuFluidDyna::HeuristicOptimizationStep() {
-  std::vector<std::tuple<int,int,int,float>> sortedCoordsToErode, sortedCoordsToSediment, sortedCoordsToAvoid;
-  if (D.UI[FieldOptimE_].GetI() == 1) {     
-    ComputeStrainRate();    
+void CompuFluidDyna::HeuristicOptimizationStep(const int iFieldE, const float iFracErosion) {
+  std::vector<std::tuple<int,int,int,float>> sortedCoordsToErode, sortedCoordsToSediment;
+  if (iFieldE == 1) {     
+    UpdateDiagnostic(DiagID::DiagStrR);    
     // Sort the fluid-solid interface voxels from highest to lowest strain rate 
-    sortedCoordsToErode = SortVoxels(StrRate, true, true);
-  } else if (D.UI[FieldOptimE_].GetI() == 2) {
-    ComputeVelocityMagnitude();
+    sortedCoordsToErode = SortVoxels(StrRate, true, true, iFracErosion);
+  } else if (iFieldE == 2) {
+    UpdateDiagnostic(DiagID::DiagVmag);
     // Sort the fluid-solid interface voxels from highest to lowest velocity magnitude 
-    sortedCoordsToErode = SortVoxels(Vmag, true, true);
-  } else if (D.UI[FieldOptimE_].GetI() == 3) {
-    ComputeVelocityCurlVorticity();
+    sortedCoordsToErode = SortVoxels(Vmag, true, true, iFracErosion);
+  } else if (iFieldE == 3) {
+    UpdateDiagnostic(DiagID::DiagVort);
     // Sort the fluid-solid interface voxels from highest to lowest vorticity 
-    sortedCoordsToErode = SortVoxels(Vort, true, true);
-  } else if (D.UI[FieldOptimE_].GetI() == 4) { 
-    ComputeStrainRate();
+    sortedCoordsToErode = SortVoxels(Vort, true, true, iFracErosion);
+  } else if (iFieldE == 4) { 
+    UpdateDiagnostic(DiagID::DiagStrR);
     // Sort the fluid-solid interface voxels from lowest to highest strain rate 
-    sortedCoordsToErode = SortVoxels(StrRate, true, false);
-  } else if (D.UI[FieldOptimE_].GetI() == 5) {
-    ComputeVelocityMagnitude();
+    sortedCoordsToErode = SortVoxels(StrRate, true, false, iFracErosion);
+  } else if (iFieldE == 5) {
+    UpdateDiagnostic(DiagID::DiagVmag);
     // Sort the fluid-solid interface voxels from lowest to highest velocity magnitude 
-    sortedCoordsToErode = SortVoxels(Vmag, true, false);
-  } else if (D.UI[FieldOptimE_].GetI() == 6) {
-    ComputeVelocityCurlVorticity();
+    sortedCoordsToErode = SortVoxels(Vmag, true, false, iFracErosion);
+  } else if (iFieldE == 6) {
+    UpdateDiagnostic(DiagID::DiagVort);
     // Sort the fluid-solid interface voxels from lowest to highest vorticity 
-    sortedCoordsToErode = SortVoxels(Vort, true, false);
+    sortedCoordsToErode = SortVoxels(Vort, true, false, iFracErosion);
+  } else if (iFieldE == 7) {
+    UpdateDiagnostic(DiagID::DiagAdjS);
+    // Sort the fluid-solid interface voxels from highest to lowest gain of mass flow rate when eroded
+    sortedCoordsToErode = SortVoxels(AdjSens, true, true, iFracErosion);
   }
   // ComputeVolumeOutOfSolid();
   // ComputeGeometrySurfaceArea();
@@ -1661,7 +3801,7 @@ void CompuFluidDyna::HeuristicOptimizationStep() {
   // printf("SurfArea before erosion = %f\n",SurfArea);
   // printf("d before erosion = %f\n",d);
   // printf("nbVoxelsBoundary : %ld\n", sortedCoordsToErode.size());   
-  int nbVoxelsToErode = D.UI[FracErosion_].GetF() * sortedCoordsToErode.size(), x,y,z, nbVoxelsToSediment;
+  int nbVoxelsToErode = iFracErosion * sortedCoordsToErode.size(), x,y,z, nbVoxelsToSediment;
   // Erosion step
   for (auto it = sortedCoordsToErode.begin(); it != sortedCoordsToErode.end(); ++it) { 
     int i = std::distance(sortedCoordsToErode.begin(), it);
@@ -1672,7 +3812,7 @@ void CompuFluidDyna::HeuristicOptimizationStep() {
     z = get<2>(sortedCoordsToErode[i]);
     // printf("i = %d\n",i);
     // printf("erode voxel : [x][y][z]=[%d][%d][%d]\n",x,y,z);
-    Solid[x][y][z] = false;
+    SetSolidVoxel(x, y, z, false);
     int count = 0;
     float sumVelX = 0.0f, sumVelY = 0.0f, sumVelZ = 0.0f;
     if (x - 1 >= 0 && !Solid[x - 1][y][z] && ++count) {sumVelX+= VelX[x - 1][y][z];sumVelY+= VelY[x - 1][y][z];sumVelZ+= VelZ[x - 1][y][z];}
@@ -1686,8 +3826,7 @@ void CompuFluidDyna::HeuristicOptimizationStep() {
     VelZ[x][y][z] = sumVelZ / (float)count; // the eroded voxel has the average VelZ value of its neighbours (temporary, to avoid sedimentation of eroded voxels)
     // printf("after erode : [x][y][z]=[%d][%d][%d]; VelX[x][y][z]=%f; VelY[x][y][z]=%f; VelZ[x][y][z]=%f\n",x,y,z,VelX[x][y][z],VelY[x][y][z],VelZ[x][y][z]);
     // Avoid resedimentation of eroded voxel
-    std::tuple<int,int,int,float> tupToAvoid(x,y,z,0.0f);
-    sortedCoordsToAvoid.push_back(tupToAvoid);
+    OptimAvoid[x][y][z] = true;
   }
   // printf("nbVoxelsEroded : %d\n", nbVoxelsToErode);
   ComputeVolumeOutOfSolid();
@@ -1704,29 +3843,29 @@ void CompuFluidDyna::HeuristicOptimizationStep() {
     else
       fracSedimentation = (d / d0) * (d / d0) - 1; // 2D fs adjustment    
     if (D.UI[FieldOptimS_].GetI() == 1) { 
-      ComputeStrainRate();
+      UpdateDiagnostic(DiagID::DiagStrR);
       // Sort the fluid-solid interface voxels from highest to lowest strain rate 
-      sortedCoordsToSediment = SortVoxels(StrRate, true, true, sortedCoordsToAvoid);
+      sortedCoordsToSediment = SortVoxels(StrRate, true, true, fracSedimentation);
     } else if (D.UI[FieldOptimS_].GetI() == 2) {
-      ComputeVelocityMagnitude();
+      UpdateDiagnostic(DiagID::DiagVmag);
       // Sort the fluid-solid interface voxels from highest to lowest velocity magnitude 
-      sortedCoordsToSediment = SortVoxels(Vmag, true, true, sortedCoordsToAvoid);
+      sortedCoordsToSediment = SortVoxels(Vmag, true, true, fracSedimentation);
     } else if (D.UI[FieldOptimS_].GetI() == 3) {
-      ComputeVelocityCurlVorticity();
+      UpdateDiagnostic(DiagID::DiagVort);
       // Sort the fluid-solid interface voxels from highest to lowest vorticity 
-      sortedCoordsToSediment = SortVoxels(Vort, true, true, sortedCoordsToAvoid);
+      sortedCoordsToSediment = SortVoxels(Vort, true, true, fracSedimentation);
     } else if (D.UI[FieldOptimS_].GetI() == 4) { 
-      ComputeStrainRate();
+      UpdateDiagnostic(DiagID::DiagStrR);
       // Sort the fluid-solid interface voxels from lowest to highest strain rate 
-      sortedCoordsToSediment = SortVoxels(StrRate, true, false, sortedCoordsToAvoid);
+      sortedCoordsToSediment = SortVoxels(StrRate, true, false, fracSedimentation);
     } else if (D.UI[FieldOptimS_].GetI() == 5) {
-      ComputeVelocityMagnitude();
+      UpdateDiagnostic(DiagID::DiagVmag);
       // Sort the fluid-solid interface voxels from lowest to highest velocity magnitude 
-      sortedCoordsToSediment = SortVoxels(Vmag, true, false, sortedCoordsToAvoid);
+      sortedCoordsToSediment = SortVoxels(Vmag, true, false, fracSedimentation);
     } else if (D.UI[FieldOptimS_].GetI() == 6) {
-      ComputeVelocityCurlVorticity();
+      UpdateDiagnostic(DiagID::DiagVort);
       // Sort the fluid-solid interface voxels from lowest to highest vorticity 
-      sortedCoordsToSediment = SortVoxels(Vort, true, false, sortedCoordsToAvoid);
+      sortedCoordsToSediment = SortVoxels(Vort, true, false, fracSedimentation);
     }
     nbVoxelsToSediment = fracSedimentation * sortedCoordsToSediment.size();
     // printf("nbCandidates for sedimentation : %ld\n", sortedCoordsToSediment.size());
@@ -1743,13 +3882,20 @@ void CompuFluidDyna::HeuristicOptimizationStep() {
       int i = std::distance(sortedCoordsToSediment.begin(), it);
       if (cpt >= nbVoxelsToSediment)
         break;
+      // Order the unsorted tail only when the selected candidates could not all be sedimented
+      if (i == nbVoxelsToSediment) {
+        if (D.UI[FieldOptimS_].GetI() >= 1 && D.UI[FieldOptimS_].GetI() <= 3)
+          std::sort(it, sortedCoordsToSediment.end(), more_than());
+        else
+          std::sort(it, sortedCoordsToSediment.end(), less_than());
+      }
       x = get<0>(sortedCoordsToSediment[i]);
       y = get<1>(sortedCoordsToSediment[i]);
       z = get<2>(sortedCoordsToSediment[i]);
       // printf("i = %d\n",i);
       // printf("before sediment : [x][y][z]=[%d][%d][%d]; VelX[x][y][z]=%f; VelY[x][y][z]=%f; VelZ[x][y][z]=%f\n",x,y,z,VelX[x][y][z],VelY[x][y][z],VelZ[x][y][z]);
-      if (x - 1 >= 0 && !Solid[x - 1][y][z]) {
-        Solid[x - 1][y][z] = true;
+      if (x - 1 >= 0 && !IsSolid(x - 1, y, z)) {
+        SetSolidVoxel(x - 1, y, z, true);
         Smok[x - 1][y][z] = 0.0f;
         Pres[x - 1][y][z] = 0.0f;
         VelX[x - 1][y][z] = 0.0f;
@@ -1759,8 +3905,8 @@ void CompuFluidDyna::HeuristicOptimizationStep() {
         // printf("after sediment : [x][y][z]=[%d][%d][%d]; VelX[x][y][z]=%f; VelY[x][y][z]=%f; VelZ[x][y][z]=%f\n",x,y,z,VelX[x][y][z],VelY[x][y][z],VelZ[x][y][z]);
         continue;
       }
-      if (x + 1 < nX && !Solid[x + 1][y][z]) {
-        Solid[x + 1][y][z] = true;
+      if (x + 1 < nX && !IsSolid(x + 1, y, z)) {
+        SetSolidVoxel(x + 1, y, z, true);
         Smok[x + 1][y][z] = 0.0f;
         Pres[x + 1][y][z] = 0.0f;
         VelX[x + 1][y][z] = 0.0f;
@@ -1770,8 +3916,8 @@ void CompuFluidDyna::HeuristicOptimizationStep() {
         // printf("after sediment : [x][y][z]=[%d][%d][%d]; VelX[x][y][z]=%f; VelY[x][y][z]=%f; VelZ[x][y][z]=%f\n",x,y,z,VelX[x][y][z],VelY[x][y][z],VelZ[x][y][z]);
         continue;
       }
-      if (y - 1 >= 0 && !Solid[x][y - 1][z]) {
-        Solid[x][y - 1][z] = true;
+      if (y - 1 >= 0 && !IsSolid(x, y - 1, z)) {
+        SetSolidVoxel(x, y - 1, z, true);
         Smok[x][y - 1][z] = 0.0f;
         Pres[x][y - 1][z] = 0.0f;
         VelX[x][y - 1][z] = 0.0f;
@@ -1781,8 +3927,8 @@ void CompuFluidDyna::HeuristicOptimizationStep() {
         // printf("after sediment : [x][y-1][z]=[%d][%d][%d]; VelX[x][y-1][z]=%f; VelY[x][y-1][z]=%f; VelZ[x][y-1][z]=%f\n",x,y-1,z,VelX[x][y-1][z],VelY[x][y-1][z],VelZ[x][y-1][z]);
         continue;
       }
-      if (y + 1 < nY && !Solid[x][y + 1][z]) {
-        Solid[x][y + 1][z] = true;
+      if (y + 1 < nY && !IsSolid(x, y + 1, z)) {
+        SetSolidVoxel(x, y + 1, z, true);
         Smok[x][y + 1][z] = 0.0f;
         Pres[x][y + 1][z] = 0.0f;
         VelX[x][y + 1][z] = 0.0f;
@@ -1793,7 +3939,7 @@ void CompuFluidDyna::HeuristicOptimizationStep() {
         continue;
       }
       if (z - 1 >= 0 && !Solid[x][y][z - 1]) {      
-        Solid[x][y][z - 1] = true;
+        SetSolidVoxel(x, y, z - 1, true);
         Smok[x][y][z - 1] = 0.0f;
         Pres[x][y][z - 1] = 0.0f;
         VelX[x][y][z - 1] = 0.0f;
@@ -1804,7 +3950,7 @@ void CompuFluidDyna::HeuristicOptimizationStep() {
         continue;
       }
       if (z + 1 < nZ && !Solid[x][y][z + 1]) {
-        Solid[x][y][z + 1] = true;
+        SetSolidVoxel(x, y, z + 1, true);
         Smok[x][y][z + 1] = 0.0f;
         Pres[x][y][z + 1] = 0.0f;
         VelX[x][y][z + 1] = 0.0f;
@@ -1850,5 +3996,76 @@ void CompuFluidDyna::HeuristicOptimizationStep() {
     VelX[x][y][z] = 0.0f;
     VelY[x][y][z] = 0.0f;
     VelZ[x][y][z] = 0.0f;
+    OptimAvoid[x][y][z] = false;
   }
-}
\ No newline at end of file
+}
+
+// Ensemble step of the heuristic optimization
+// Erosion variants are applied to copies of the current state and simulated concurrently over the stabilization window
+// The copies share the scenario boundary conditions and leave out the display caches and the adjoint warm start
+// The state of the variant reaching the highest mass flow rate replaces the current one
+void CompuFluidDyna::EnsembleOptimizationStep() {
+  const int nbCand= std::max(D.UI[OptimEnsemb_].GetI(), 1);
+  const int fieldE= std::min(std::max(D.UI[FieldOptimE_].GetI(), 1), 7);
+  const float fracE= D.UI[FracErosion_].GetF();
+  const float window= FTime * D.UI[CoeffFluTime].GetF();
+  // Verbose solvers and timers write to shared plots and stacks so the candidates are then run one after another
+  const bool serial= D.UI[VerboseSolv_].GetB() || D.UI[VerboseTime_].GetB();
+
+  // Variant k keeps the sort direction of the erosion criterion, cycles through its three fields
+  // and scales the eroded fraction by 1, 1/2, 2, 1/4, 4... every three variants
+  // Variants of the adjoint criterion only differ by the eroded fraction and share the sensitivity computed beforehand
+  if (fieldE == 7) UpdateDiagnostic(DiagID::DiagAdjS);
+  std::vector<int> CandFieldE(nbCand);
+  std::vector<float> CandFracE(nbCand);
+  for (int k= 0; k < nbCand; k++) {
+    const int dirBase= (fieldE >= 4) ? 4 : 1;
+    const int m= (fieldE == 7) ? k : k / 3;
+    CandFieldE[k]= (fieldE == 7) ? fieldE : dirBase + (fieldE - dirBase + k) % 3;
+    CandFracE[k]= std::min(fracE * std::pow(2.0f, (m % 2 == 1) ? -(float)((m + 1) / 2) : (float)(m / 2)), 1.0f);
+  }
+
+  // Set aside the data the variants do not step
+  Draw::VertexBatch wireBatch= std::move(WireBatch), cubeBatch= std::move(CubeBatch), tracerBatch= std::move(TracerBatch);
+  std::vector<std::vector<std::vector<bool>>> cubeShown= std::move(CubeShown);
+  std::vector<std::vector<std::vector<float>>> cubeColor= std::move(CubeColor);
+  std::vector<std::vector<std::vector<float>>> adjVelX= std::move(AdjVelX), adjVelY= std::move(AdjVelY), adjVelZ= std::move(AdjVelZ);
+
+  // Simulate the variants from their own copy of the base state
+  std::vector<CompuFluidDyna> Cand(nbCand);
+  std::vector<float> CandMFR(nbCand, 0.0f);
+#pragma omp parallel for schedule(dynamic, 1) if (!serial)
+  for (int k= 0; k < nbCand; k++) {
+    Cand[k]= *this;
+    Cand[k].HeuristicOptimizationStep(CandFieldE[k], CandFracE[k]);
+    Cand[k].TimeSinceLastIter= 0.0f;
+    while (Cand[k].TimeSinceLastIter < window) {
+      Cand[k].StepSimulation();
+      Cand[k].TimeSinceLastIter+= Cand[k].simTimeStep;
+    }
+    Cand[k].ComputeMassFlowRates(false);
+    CandMFR[k]= Cand[k].MFR[0];
+  }
+
+  // Keep the best variant, ties go to the lowest index so the result does not depend on the thread schedule
+  int best= 0;
+  for (int k= 1; k < nbCand; k++)
+    if (CandMFR[k] > CandMFR[best]) best= k;
+  if (D.UI[Verbose_____].GetB()) {
+    for (int k= 0; k < nbCand; k++)
+      printf("Ensemble candidate %d  FieldE %d  FracE %.4f  MFR %f%s\n", k, CandFieldE[k], CandFracE[k], CandMFR[k], (k == best) ? "  kept" : "");
+  }
+  *this= std::move(Cand[best]);
+
+  // Restore the data set aside, the display caches are rebuilt for the kept state
+  WireBatch= std::move(wireBatch);
+  CubeBatch= std::move(cubeBatch);
+  TracerBatch= std::move(tracerBatch);
+  CubeShown= std::move(cubeShown);
+  CubeColor= std::move(cubeColor);
+  AdjVelX= std::move(adjVelX);
+  AdjVelY= std::move(adjVelY);
+  AdjVelZ= std::move(adjVelZ);
+  isWireBatchValid= false;
+  isCubeBatchValid= false;
+}
@@ -15,22 +15,36 @@ enum ParamType
   ResolutionY_,
   ResolutionZ_,
   VoxelSize___,
+  SparseStore_,
+  NbSubDomain_,
   TimeStep____,
+  TimeStepCFL_,
+  AdvecSubMax_,
+  SolvEngine__,
+  SteadyRelax_,
   SolvMaxIter_,
   SolvType____,
   SolvSOR_____,
   SolvTolRhs__,
   SolvTolRel__,
   SolvTolAbs__,
+  TileSizeX___,
+  TileSizeY___,
+  TileSizeZ___,
+  TileSweeps__,
   FlagOptim___,
   FieldOptimE_,
   FieldOptimS_,
   OptimMFRTol_,
   FlushTol____,
   KEDTol______,
+  CoarseGrid__,
+  CoarseSteps_,
   OptiIterWin_,
   SafeZoneRad_,
   FracErosion_,
+  OptimEnsemb_,
+  AdjointIter_,
   CoeffFluTime,
   CoeffGravi__,
   CoeffAdvec__,
@@ -57,6 +71,17 @@ enum ParamType
   SlicePlotX__,
   SlicePlotY__,
   SlicePlotZ__,
+  TracerCount_,
+  TracerOrder_,
+  TracerLife__,
+  ExportVTI___,
+  ExportField_,
+  TimelineRec_,
+  TimelineMem_,
+  TimelineSeek,
+  BenchSteps__,
+  BenchCheck__,
+  BenchErrTol_,
   VerboseSolv_,
   VerboseTime_,
   Verbose_____,
@@ -4,6 +4,7 @@
 // Standard lib
 #include <cmath>
 #include <cstring>
+#include <filesystem>
 #include <vector>
 
 // GLUT lib
@@ -14,6 +15,8 @@
 #include "../../Util/Colormap.hpp"
 #include "../../Util/Field.hpp"
 #include "../../Util/Random.hpp"
+#include "../../Util/Timeline.hpp"
+#include "../../Util/Timer.hpp"
 #include "../../Util/Vec.hpp"
 
 
@@ -33,6 +36,9 @@ enum ParamType
   ErosionCoeff,
   SmoothResist,
   CliffThresh_,
+  TimelineRec_,
+  TimelineMem_,
+  TimelineSeek,
   Verbose_____,
 };
 
@@ -42,6 +48,7 @@ TerrainErosion::TerrainErosion() {
   isActivProj= false;
   isAllocated= false;
   isRefreshed= false;
+  historyFrame= -1;
 }
 
 
@@ -59,6 +66,9 @@ void TerrainErosion::SetActiveProject() {
     D.UI.push_back(ParamUI("ErosionCoeff", 0.05));
     D.UI.push_back(ParamUI("SmoothResist", 0.99));
     D.UI.push_back(ParamUI("CliffThresh_", 0.80));
+    D.UI.push_back(ParamUI("TimelineRec_", 0));    // Number of time steps between frames recorded in the compressed history, 0= no recording
+    D.UI.push_back(ParamUI("TimelineMem_", 64));   // Memory budget of the history in MB, older frames are spilled to FileOutput/TerrainErosion_timeline.bin
+    D.UI.push_back(ParamUI("TimelineSeek", -1));   // Position of the displayed frame in the recorded history from 0 to 1, negative= live simulation
     D.UI.push_back(ParamUI("Verbose_____", 0.0));
   }
 
@@ -126,12 +136,21 @@ void TerrainErosion::Allocate() {
 void TerrainErosion::Refresh() {
   if (!isActivProj) return;
   if (!CheckAlloc()) Allocate();
-  if (CheckRefresh()) return;
+  if (CheckRefresh()) {
+    ScrubTimeline();
+    return;
+  }
   isRefreshed= true;
 
   // Get UI parameters
   terrainNbC= std::max(0, D.UI[TerrainNbCut].GetI());
 
+  // Restart the history
+  simStep= 0;
+  History.reset();
+  historyFrame= -1;
+  LiveFrame.clear();
+
   // Reset random seed to always generate same terrain
   srand(0);
 
@@ -196,20 +215,7 @@ void TerrainErosion::Refresh() {
       terrainPos[x][y][2]= terrainMinTarg + (terrainMaxTarg - terrainMinTarg) * (terrainPos[x][y][2] - terrainMinVal) / (terrainMaxVal - terrainMinVal);
 
   // Compute terrain mesh vertex normals
-  for (int x= 0; x < terrainNbX; x++) {
-    for (int y= 0; y < terrainNbY; y++) {
-      terrainNor[x][y].set(0.0f, 0.0f, 0.0f);
-      if (x > 0 && y > 0)
-        terrainNor[x][y]+= ((terrainPos[x - 1][y] - terrainPos[x][y]).cross(terrainPos[x][y - 1] - terrainPos[x][y])).normalized();
-      if (x < terrainNbX - 1 && y > 0)
-        terrainNor[x][y]+= ((terrainPos[x][y - 1] - terrainPos[x][y]).cross(terrainPos[x + 1][y] - terrainPos[x][y])).normalized();
-      if (x < terrainNbX - 1 && y < terrainNbY - 1)
-        terrainNor[x][y]+= ((terrainPos[x + 1][y] - terrainPos[x][y]).cross(terrainPos[x][y + 1] - terrainPos[x][y])).normalized();
-      if (x > 0 && y < terrainNbY - 1)
-        terrainNor[x][y]+= ((terrainPos[x][y + 1] - terrainPos[x][y]).cross(terrainPos[x - 1][y] - terrainPos[x][y])).normalized();
-      terrainNor[x][y].normalize();
-    }
-  }
+  ComputeTerrainNormals();
 }
 
 
@@ -227,6 +233,10 @@ void TerrainErosion::Animate() {
   if (!CheckAlloc()) Allocate();
   if (!CheckRefresh()) Refresh();
 
+  // The simulation is paused while a recorded frame is shown
+  ScrubTimeline();
+  if (historyFrame >= 0) return;
+
   float dt= D.UI[SimuTimestep].GetF();
   float velocityDecay= std::min(std::max(D.UI[VelDecay____].GetF(), 0.0f), 1.0f);
   Vec::Vec3<float> gravity(0.0f, 0.0f, -0.5f);
@@ -369,6 +379,18 @@ void TerrainErosion::Animate() {
   }
 
   // Recompute terrain normals
+  ComputeTerrainNormals();
+
+  // Record the state in the history
+  simStep++;
+  if (D.UI[TimelineRec_].GetI() > 0 && simStep % D.UI[TimelineRec_].GetI() == 0) {
+    RecordTimeline();
+  }
+}
+
+
+// Compute the terrain mesh vertex normals from the elevation
+void TerrainErosion::ComputeTerrainNormals() {
   for (int x= 0; x < terrainNbX; x++) {
     for (int y= 0; y < terrainNbY; y++) {
       terrainNor[x][y].set(0.0f, 0.0f, 0.0f);
@@ -386,6 +408,78 @@ void TerrainErosion::Animate() {
 }
 
 
+// Flatten the terrain elevation and the droplet positions recorded in the history
+std::vector<std::vector<float>> TerrainErosion::PackState() {
+  std::vector<std::vector<float>> frame(2);
+  frame[0].resize(terrainNbX * terrainNbY);
+  for (int x= 0; x < terrainNbX; x++)
+    for (int y= 0; y < terrainNbY; y++)
+      frame[0][x * terrainNbY + y]= terrainPos[x][y][2];
+  frame[1].resize(dropletNbK * 3);
+  for (int k= 0; k < dropletNbK; k++)
+    for (int dim= 0; dim < 3; dim++)
+      frame[1][k * 3 + dim]= dropletPosCur[k][dim];
+  return frame;
+}
+
+
+// Write back a flattened state and update the normals accordingly
+void TerrainErosion::UnpackState(const std::vector<std::vector<float>>& iFrame) {
+  if (iFrame.size() != 2) return;
+  if ((int)iFrame[0].size() != terrainNbX * terrainNbY || (int)iFrame[1].size() != dropletNbK * 3) return;
+  for (int x= 0; x < terrainNbX; x++)
+    for (int y= 0; y < terrainNbY; y++)
+      terrainPos[x][y][2]= iFrame[0][x * terrainNbY + y];
+  for (int k= 0; k < dropletNbK; k++)
+    for (int dim= 0; dim < 3; dim++)
+      dropletPosCur[k][dim]= iFrame[1][k * 3 + dim];
+  ComputeTerrainNormals();
+}
+
+
+// Append the state to the compressed history, created on the first record
+void TerrainErosion::RecordTimeline() {
+  if (!History) {
+    std::error_code errCode;
+    std::filesystem::create_directories("FileOutput", errCode);
+    const size_t memBudget= (size_t)(std::max(D.UI[TimelineMem_].GetD(), 0.0) * 1024.0 * 1024.0);
+    History= std::make_shared<Timeline>(16, 16, memBudget, "FileOutput/TerrainErosion_timeline.bin");  // Keyframe every 16 frames, 16 bit quantization
+  }
+  History->Record(PackState());
+  if (D.UI[Verbose_____].GetB())
+    printf("Timeline frame %d  step %d  memory %zu B  file %zu B\n", History->NbFrames() - 1, simStep, History->MemBytes(), History->FileBytes());
+}
+
+
+// Show the recorded frame selected in the UI in place of the live state
+// The live state is saved when scrubbing starts and restored exactly when going back to the live simulation
+void TerrainErosion::ScrubTimeline() {
+  const float seekPos= D.UI[TimelineSeek].GetF();
+  int frame= -1;
+  if (seekPos >= 0.0f && History && History->NbFrames() > 0)
+    frame= (int)std::round(std::min(seekPos, 1.0f) * (float)(History->NbFrames() - 1));
+  if (frame == historyFrame) return;
+
+  if (frame < 0) {
+    UnpackState(LiveFrame);
+    LiveFrame.clear();
+  }
+  else {
+    if (historyFrame < 0) LiveFrame= PackState();
+    if (D.UI[Verbose_____].GetB()) Timer::PushTimer();
+    std::vector<std::vector<float>> recFrame;
+    if (!History->Seek(frame, recFrame)) {
+      printf("[ERROR] Unable to decode frame %d of the timeline\n\n", frame);
+      if (historyFrame < 0) LiveFrame.clear();
+      return;
+    }
+    UnpackState(recFrame);
+    if (D.UI[Verbose_____].GetB()) printf("Timeline seek frame %d/%d in %f s\n", frame, History->NbFrames(), Timer::PopTimer());
+  }
+  historyFrame= frame;
+}
+
+
 // Draw the project
 void TerrainErosion::Draw() {
   if (!isActivProj) return;
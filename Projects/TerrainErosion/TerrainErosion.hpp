@@ -1,17 +1,21 @@
 #pragma once
 
 // Standard lib
+#include <memory>
 #include <vector>
 
 // Sandbox lib
 #include "../../Util/Vec.hpp"
 
+class Timeline;
+
 
 // Terrain generation and erosion simulation
 // - Representation as height map
 // - Initial terrain created with iterative random cut planes
 // - Particles dropped and collide with the terrain using Position Based Dynamics scheme
 // - Erosion and sedimentation handled by heuristic rules
+// - Compressed history of the terrain and droplets for scrubbing
 //
 // Reference
 // https://www.youtube.com/watch?v=eaXk97ujbPQ
@@ -38,6 +42,17 @@ class TerrainErosion
   std::vector<float> dropletSatCur;
   std::vector<bool> dropletIsDead;
 
+  int simStep;
+  std::shared_ptr<Timeline> History;          // Recorded frames of the terrain elevation and droplet positions
+  int historyFrame;                           // Recorded frame shown in place of the live state, -1= live simulation
+  std::vector<std::vector<float>> LiveFrame;  // Live state saved while scrubbing the history
+
+  void ComputeTerrainNormals();
+  std::vector<std::vector<float>> PackState();
+  void UnpackState(const std::vector<std::vector<float>>& iFrame);
+  void RecordTimeline();
+  void ScrubTimeline();
+
   public:
   bool isActivProj;
   bool isAllocated;
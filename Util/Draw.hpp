@@ -1,5 +1,8 @@
 #pragma once
 
+// Standard lib
+#include <vector>
+
 // GLUT lib
 #include "../Libs/freeglut/include/GL/freeglut.h"
 
@@ -27,4 +30,55 @@ namespace Draw {
     else glutWireCube(1.0);
     glPopMatrix();
   }
+
+  // Client side vertex arrays accumulated on the CPU and sent to GL in a single draw call
+  class VertexBatch
+  {
+    public:
+    std::vector<float> Vert;
+    std::vector<float> Norm;
+    std::vector<float> Colr;
+
+    void Clear() {
+      Vert.clear();
+      Norm.clear();
+      Colr.clear();
+    }
+
+    // Append face iFace (-X, +X, -Y, +Y, -Z, +Z) of the unit cube centered on (x,y,z)
+    // The face is added as a counter clockwise quad or as its 4 edges in line mode
+    void AddCubeFace(const float x, const float y, const float z, const int iFace, const bool iEdges,
+                     const float r, const float g, const float b) {
+      // Outward normal followed by the corners of each face
+      static const float faces[6][5][3]= {
+          {{-1.0f, 0.0f, 0.0f}, {-0.5f, -0.5f, -0.5f}, {-0.5f, -0.5f, 0.5f}, {-0.5f, 0.5f, 0.5f}, {-0.5f, 0.5f, -0.5f}},
+          {{1.0f, 0.0f, 0.0f}, {0.5f, -0.5f, -0.5f}, {0.5f, 0.5f, -0.5f}, {0.5f, 0.5f, 0.5f}, {0.5f, -0.5f, 0.5f}},
+          {{0.0f, -1.0f, 0.0f}, {-0.5f, -0.5f, -0.5f}, {0.5f, -0.5f, -0.5f}, {0.5f, -0.5f, 0.5f}, {-0.5f, -0.5f, 0.5f}},
+          {{0.0f, 1.0f, 0.0f}, {-0.5f, 0.5f, -0.5f}, {-0.5f, 0.5f, 0.5f}, {0.5f, 0.5f, 0.5f}, {0.5f, 0.5f, -0.5f}},
+          {{0.0f, 0.0f, -1.0f}, {-0.5f, -0.5f, -0.5f}, {-0.5f, 0.5f, -0.5f}, {0.5f, 0.5f, -0.5f}, {0.5f, -0.5f, -0.5f}},
+          {{0.0f, 0.0f, 1.0f}, {-0.5f, -0.5f, 0.5f}, {0.5f, -0.5f, 0.5f}, {0.5f, 0.5f, 0.5f}, {-0.5f, 0.5f, 0.5f}}};
+      const int nbVert= iEdges ? 8 : 4;
+      for (int k= 0; k < nbVert; k++) {
+        const int corner= iEdges ? ((k + 1) / 2) % 4 : k;
+        Vert.insert(Vert.end(), {x + faces[iFace][1 + corner][0], y + faces[iFace][1 + corner][1], z + faces[iFace][1 + corner][2]});
+        Norm.insert(Norm.end(), {faces[iFace][0][0], faces[iFace][0][1], faces[iFace][0][2]});
+        Colr.insert(Colr.end(), {r, g, b});
+      }
+    }
+
+    // Draw the accumulated vertices as primitives of type iMode
+    void DrawBatch(const GLenum iMode) const {
+      if (Vert.empty()) return;
+      glEnableClientState(GL_VERTEX_ARRAY);
+      glEnableClientState(GL_NORMAL_ARRAY);
+      glEnableClientState(GL_COLOR_ARRAY);
+      glVertexPointer(3, GL_FLOAT, 0, Vert.data());
+      glNormalPointer(GL_FLOAT, 0, Norm.data());
+      glColorPointer(3, GL_FLOAT, 0, Colr.data());
+      glDrawArrays(iMode, 0, (GLsizei)(Vert.size() / 3));
+      glDisableClientState(GL_COLOR_ARRAY);
+      glDisableClientState(GL_NORMAL_ARRAY);
+      glDisableClientState(GL_VERTEX_ARRAY);
+    }
+  };
 }  // namespace Draw
@@ -0,0 +1,122 @@
+#include "FFT.hpp"
+
+
+// Standard lib
+#include <cmath>
+#include <complex>
+#include <numbers>
+#include <vector>
+
+
+void FFT::Transform(std::vector<std::complex<double>>& ioData, const bool iInverse) {
+  const int n= (int)ioData.size();
+  if (n <= 1) return;
+  if ((n & (n - 1)) == 0) TransformRadix2(ioData, iInverse);
+  else TransformBluestein(ioData, iInverse);
+  if (iInverse)
+    for (std::complex<double>& val : ioData)
+      val/= (double)n;
+}
+
+
+void FFT::DCT2(std::vector<double>& ioData) {
+  const int n= (int)ioData.size();
+  if (n <= 1) return;
+  // Even samples in order followed by odd samples in reverse order
+  std::vector<std::complex<double>> v(n);
+  for (int k= 0; k < (n + 1) / 2; k++) v[k]= ioData[2 * k];
+  for (int k= 0; k < n / 2; k++) v[n - 1 - k]= ioData[2 * k + 1];
+  Transform(v, false);
+  // Rotate by the quarter sample shift
+  for (int k= 0; k < n; k++)
+    ioData[k]= std::real(v[k] * std::polar(1.0, -std::numbers::pi * (double)k / (2.0 * (double)n)));
+}
+
+
+void FFT::DCT2Inverse(std::vector<double>& ioData) {
+  const int n= (int)ioData.size();
+  if (n <= 1) return;
+  // Rebuild the complex spectrum of the reordered sequence from its real part and mirror
+  std::vector<std::complex<double>> v(n);
+  v[0]= ioData[0];
+  for (int k= 1; k < n; k++)
+    v[k]= std::complex<double>(ioData[k], -ioData[n - k]) * std::polar(1.0, std::numbers::pi * (double)k / (2.0 * (double)n));
+  Transform(v, true);
+  // Undo the even/odd reordering
+  for (int k= 0; k < (n + 1) / 2; k++) ioData[2 * k]= std::real(v[k]);
+  for (int k= 0; k < n / 2; k++) ioData[2 * k + 1]= std::real(v[n - 1 - k]);
+}
+
+
+void FFT::DST1(std::vector<double>& ioData) {
+  const int n= (int)ioData.size();
+  if (n < 1) return;
+  // Odd extension 0, x, 0, -reversed(x) of length 2(N+1)
+  std::vector<std::complex<double>> v(2 * (n + 1), 0.0);
+  for (int k= 0; k < n; k++) {
+    v[k + 1]= ioData[k];
+    v[2 * (n + 1) - (k + 1)]= -ioData[k];
+  }
+  Transform(v, false);
+  // The spectrum of the odd sequence is purely imaginary
+  for (int k= 0; k < n; k++)
+    ioData[k]= -0.5 * std::imag(v[k + 1]);
+}
+
+
+void FFT::DST1Inverse(std::vector<double>& ioData) {
+  const int n= (int)ioData.size();
+  if (n < 1) return;
+  // DST-I is its own inverse up to the factor 2/(N+1)
+  DST1(ioData);
+  for (double& val : ioData)
+    val*= 2.0 / (double)(n + 1);
+}
+
+
+void FFT::TransformRadix2(std::vector<std::complex<double>>& ioData, const bool iInverse) {
+  const int n= (int)ioData.size();
+  // Bit reversal permutation
+  for (int i= 1, j= 0; i < n; i++) {
+    int bit= n >> 1;
+    for (; j & bit; bit>>= 1) j^= bit;
+    j^= bit;
+    if (i < j) std::swap(ioData[i], ioData[j]);
+  }
+  // Butterflies of increasing size
+  for (int len= 2; len <= n; len<<= 1) {
+    const double ang= (iInverse ? 2.0 : -2.0) * std::numbers::pi / (double)len;
+    for (int k= 0; k < len / 2; k++) {
+      const std::complex<double> w= std::polar(1.0, ang * (double)k);
+      for (int i= 0; i < n; i+= len) {
+        const std::complex<double> u= ioData[i + k];
+        const std::complex<double> t= ioData[i + k + len / 2] * w;
+        ioData[i + k]= u + t;
+        ioData[i + k + len / 2]= u - t;
+      }
+    }
+  }
+}
+
+
+void FFT::TransformBluestein(std::vector<std::complex<double>>& ioData, const bool iInverse) {
+  const int n= (int)ioData.size();
+  int m= 1;
+  while (m < 2 * n - 1) m<<= 1;
+  // Chirp exp(∓iπk²/N) with k² reduced modulo 2N to keep the angle accurate
+  std::vector<std::complex<double>> chirp(n);
+  for (int k= 0; k < n; k++) {
+    const long long kk= ((long long)k * (long long)k) % (2LL * (long long)n);
+    chirp[k]= std::polar(1.0, (iInverse ? 1.0 : -1.0) * std::numbers::pi * (double)kk / (double)n);
+  }
+  // Circular convolution of the chirped input with the conjugate chirp
+  std::vector<std::complex<double>> a(m, 0.0), b(m, 0.0);
+  for (int k= 0; k < n; k++) a[k]= ioData[k] * chirp[k];
+  b[0]= std::conj(chirp[0]);
+  for (int k= 1; k < n; k++) b[k]= b[m - k]= std::conj(chirp[k]);
+  TransformRadix2(a, false);
+  TransformRadix2(b, false);
+  for (int k= 0; k < m; k++) a[k]*= b[k];
+  TransformRadix2(a, true);
+  for (int k= 0; k < n; k++) ioData[k]= a[k] * chirp[k] / (double)m;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+// Standard lib
+#include <complex>
+#include <vector>
+
+
+// Self contained fast Fourier transforms in double precision
+// - Power of two lengths use an iterative radix-2 scheme
+// - Other lengths are mapped to a power of two circular convolution with Bluestein's algorithm
+// - Cosine transforms are computed through a complex transform of the same length with Makhoul's reordering
+// - Sine transforms are computed through a complex transform of the odd extension of the sequence
+class FFT
+{
+  public:
+  // Complex transform X[k]= Σ x[n] exp(∓2iπkn/N), the inverse is scaled by 1/N
+  static void Transform(std::vector<std::complex<double>>& ioData, const bool iInverse);
+  // DCT-II X[k]= Σ x[n] cos(πk(2n+1)/(2N))
+  static void DCT2(std::vector<double>& ioData);
+  // Inverse of DCT2
+  static void DCT2Inverse(std::vector<double>& ioData);
+  // DST-I X[k]= Σ x[n] sin(π(k+1)(n+1)/(N+1))
+  static void DST1(std::vector<double>& ioData);
+  // Inverse of DST1
+  static void DST1Inverse(std::vector<double>& ioData);
+
+  private:
+  static void TransformRadix2(std::vector<std::complex<double>>& ioData, const bool iInverse);
+  static void TransformBluestein(std::vector<std::complex<double>>& ioData, const bool iInverse);
+};
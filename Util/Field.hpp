@@ -26,6 +26,17 @@ namespace Field {
     return std::vector<std::vector<std::vector<std::vector<std::vector<element_type>>>>>(iNbA, std::vector<std::vector<std::vector<std::vector<element_type>>>>(iNbB, std::vector<std::vector<std::vector<element_type>>>(iNbC, std::vector<std::vector<element_type>>(iNbD, std::vector<element_type>(iNbE, val)))));
   }
 
+  // Copy of a field into a field of an other element type, sub-vectors left empty in the source stay empty
+  template <typename element_type_in, typename element_type_out>
+  inline void ConvertField3D(std::vector<std::vector<std::vector<element_type_in>>> const& iField, std::vector<std::vector<std::vector<element_type_out>>>& oField) {
+    oField.resize(iField.size());
+    for (unsigned int a= 0; a < iField.size(); a++) {
+      oField[a].resize(iField[a].size());
+      for (unsigned int b= 0; b < iField[a].size(); b++)
+        oField[a][b].assign(iField[a][b].begin(), iField[a][b].end());
+    }
+  }
+
   // Get dimensions of fields
   template <typename element_type>
   inline void GetFieldDimensions(std::vector<std::vector<element_type>> const& iField, int& oNbA, int& oNbB) {
@@ -0,0 +1,216 @@
+#include "FileOutput.hpp"
+
+// Standard lib
+#include <cstdint>
+#include <algorithm>
+#include <cstdio>
+#include <array>
+#include <fstream>
+#include <string>
+#include <vector>
+
+
+void FileOutput::SaveScalarFieldRawVTIFile(
+    std::string const iFullpath,
+    std::array<double, 3> const iBBoxMin,
+    std::array<double, 3> const iBBoxMax,
+    std::vector<std::vector<std::vector<double>>> const& iField,
+    bool const iVerbose) {
+  const int nbX= (int)iField.size();
+  const int nbY= (nbX > 0) ? (int)iField[0].size() : 0;
+  const int nbZ= (nbY > 0) ? (int)iField[0][0].size() : 0;
+  std::vector<std::vector<float>> data(1, std::vector<float>((size_t)nbX * nbY * nbZ));
+  for (int z= 0; z < nbZ; z++)
+    for (int y= 0; y < nbY; y++)
+      for (int x= 0; x < nbX; x++)
+        data[0][((size_t)z * nbY + y) * nbX + x]= float(iField[x][y][z]);
+  SaveFieldsRawVTIFile(iFullpath, nbX, nbY, nbZ, iBBoxMin, iBBoxMax, {"Scalar"}, {1}, data, {}, {}, iVerbose);
+}
+
+
+void FileOutput::SaveVectorFieldRawVTIFile(
+    std::string const iFullpath,
+    std::array<double, 3> const iBBoxMin,
+    std::array<double, 3> const iBBoxMax,
+    std::vector<std::vector<std::vector<std::array<double, 3>>>> const& iField,
+    bool const iVerbose) {
+  const int nbX= (int)iField.size();
+  const int nbY= (nbX > 0) ? (int)iField[0].size() : 0;
+  const int nbZ= (nbY > 0) ? (int)iField[0][0].size() : 0;
+  std::vector<std::vector<float>> data(1, std::vector<float>((size_t)nbX * nbY * nbZ * 3));
+  for (int z= 0; z < nbZ; z++)
+    for (int y= 0; y < nbY; y++)
+      for (int x= 0; x < nbX; x++)
+        for (int k= 0; k < 3; k++)
+          data[0][(((size_t)z * nbY + y) * nbX + x) * 3 + k]= float(iField[x][y][z][k]);
+  SaveFieldsRawVTIFile(iFullpath, nbX, nbY, nbZ, iBBoxMin, iBBoxMax, {"Vector"}, {3}, data, {}, {}, iVerbose);
+}
+
+
+void FileOutput::SaveFieldsRawVTIFile(
+    std::string const iFullpath,
+    int const iNbX,
+    int const iNbY,
+    int const iNbZ,
+    std::array<double, 3> const iBBoxMin,
+    std::array<double, 3> const iBBoxMax,
+    std::vector<std::string> const& iNames,
+    std::vector<int> const& iNbComp,
+    std::vector<std::vector<float>> const& iData,
+    std::vector<int64_t> const& iColIndex,
+    std::vector<float> const& iFillVal,
+    bool const iVerbose) {
+  if (iNbX < 1 || iNbY < 1 || iNbZ < 1) {
+    printf("[ERROR] Invalid field dimensions\n\n");
+    return;
+  }
+  if (iNames.size() != iData.size() || iNbComp.size() != iData.size()) {
+    printf("[ERROR] Invalid field array count\n\n");
+    return;
+  }
+  const bool isColumns= !iColIndex.empty();
+  if (isColumns && (iColIndex.size() != (size_t)iNbX * iNbY || iFillVal.size() != iData.size())) {
+    printf("[ERROR] Invalid column layout\n\n");
+    return;
+  }
+
+  if (iVerbose)
+    printf("Saving VTI field file [%s]\n", iFullpath.c_str());
+
+  std::ofstream outputFile;
+  outputFile.open(iFullpath, std::ios::binary);
+  if (!outputFile.is_open()) {
+    printf("[ERROR] Unable to create the file\n\n");
+    return;
+  }
+
+  // Write the header with the voxel centers as points, as expected by LoadScalarFieldRawVTIFile
+  const double spaX= (iBBoxMax[0] - iBBoxMin[0]) / (double)iNbX;
+  const double spaY= (iBBoxMax[1] - iBBoxMin[1]) / (double)iNbY;
+  const double spaZ= (iBBoxMax[2] - iBBoxMin[2]) / (double)iNbZ;
+  char line[512];
+  outputFile << "<?xml version=\"1.0\"?>\n";
+  outputFile << "<VTKFile type=\"ImageData\" version=\"1.0\" byte_order=\"LittleEndian\" header_type=\"UInt64\">\n";
+  std::snprintf(line, sizeof(line), "  <ImageData WholeExtent=\"%d %d %d %d %d %d\" Origin=\"%.9g %.9g %.9g\" Spacing=\"%.9g %.9g %.9g\">\n",
+                0, iNbX - 1, 0, iNbY - 1, 0, iNbZ - 1,
+                iBBoxMin[0] + 0.5 * spaX, iBBoxMin[1] + 0.5 * spaY, iBBoxMin[2] + 0.5 * spaZ, spaX, spaY, spaZ);
+  outputFile << line;
+  std::snprintf(line, sizeof(line), "    <Piece Extent=\"%d %d %d %d %d %d\">\n", 0, iNbX - 1, 0, iNbY - 1, 0, iNbZ - 1);
+  outputFile << line;
+  outputFile << "      <PointData>\n";
+  uint64_t offset= 0;
+  for (int k= 0; k < (int)iData.size(); k++) {
+    std::snprintf(line, sizeof(line), "        <DataArray type=\"Float32\" Name=\"%s\" NumberOfComponents=\"%d\" format=\"appended\" offset=\"%llu\"/>\n",
+                  iNames[k].c_str(), iNbComp[k], (unsigned long long)offset);
+    outputFile << line;
+    offset+= sizeof(uint64_t) + (uint64_t)iNbX * iNbY * iNbZ * iNbComp[k] * sizeof(float);
+  }
+  outputFile << "      </PointData>\n";
+  outputFile << "    </Piece>\n";
+  outputFile << "  </ImageData>\n";
+  outputFile << "  <AppendedData encoding=\"raw\">\n";
+  outputFile << "   _";
+
+  // Write each array as its byte count followed by the raw data
+  // Column arrays are reordered one X row at a time with X varying fastest
+  int64_t nbCols= 0;
+  for (int64_t col : iColIndex)
+    nbCols= std::max(nbCols, col + 1);
+  std::vector<float> row;
+  for (int k= 0; k < (int)iData.size(); k++) {
+    const uint64_t nbBytes= (uint64_t)iNbX * iNbY * iNbZ * iNbComp[k] * sizeof(float);
+    outputFile.write((const char*)&nbBytes, sizeof(uint64_t));
+    if (isColumns && iData[k].size() >= (size_t)nbCols * iNbZ * iNbComp[k]) {
+      row.resize((size_t)iNbX * iNbComp[k]);
+      for (int z= 0; z < iNbZ; z++) {
+        for (int y= 0; y < iNbY; y++) {
+          for (int x= 0; x < iNbX; x++) {
+            const int64_t col= iColIndex[(size_t)x * iNbY + y];
+            for (int c= 0; c < iNbComp[k]; c++)
+              row[(size_t)x * iNbComp[k] + c]= (col < 0) ? iFillVal[k] : iData[k][((size_t)col * iNbZ + z) * iNbComp[k] + c];
+          }
+          outputFile.write((const char*)row.data(), (std::streamsize)(row.size() * sizeof(float)));
+        }
+      }
+    }
+    else if (!isColumns && iData[k].size() * sizeof(float) >= nbBytes) {
+      outputFile.write((const char*)iData[k].data(), (std::streamsize)nbBytes);
+    }
+    else {
+      printf("[ERROR] Array [%s] is smaller than the field dimensions\n\n", iNames[k].c_str());
+      const std::vector<char> zeros(nbBytes, 0);
+      outputFile.write(zeros.data(), (std::streamsize)nbBytes);
+    }
+  }
+  outputFile << "\n  </AppendedData>\n";
+  outputFile << "</VTKFile>\n";
+
+  outputFile.close();
+}
+
+
+FileOutputQueue::FileOutputQueue(int const iNbBuffers) {
+  Pool= std::vector<Frame>(std::max(iNbBuffers, 1));
+  for (Frame& frame : Pool)
+    FreeFrames.push_back(&frame);
+  isWriting= false;
+  isStopping= false;
+  writerThread= std::thread(&FileOutputQueue::WriterLoop, this);
+}
+
+
+FileOutputQueue::~FileOutputQueue() {
+  {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    isStopping= true;
+  }
+  queueCond.notify_all();
+  writerThread.join();
+}
+
+
+// Get a free buffer to pack a frame in, or nullptr if the writer is behind and all buffers are in use
+FileOutputQueue::Frame* FileOutputQueue::AcquireFrame() {
+  std::lock_guard<std::mutex> lock(queueMutex);
+  if (FreeFrames.empty()) return nullptr;
+  Frame* frame= FreeFrames.back();
+  FreeFrames.pop_back();
+  return frame;
+}
+
+
+// Hand a packed frame over to the writer thread
+void FileOutputQueue::SubmitFrame(Frame* iFrame) {
+  {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    Queue.push_back(iFrame);
+  }
+  queueCond.notify_one();
+}
+
+
+// Wait until all the submitted frames are on disk
+void FileOutputQueue::Flush() {
+  std::unique_lock<std::mutex> lock(queueMutex);
+  idleCond.wait(lock, [this] { return Queue.empty() && !isWriting; });
+}
+
+
+void FileOutputQueue::WriterLoop() {
+  std::unique_lock<std::mutex> lock(queueMutex);
+  while (true) {
+    queueCond.wait(lock, [this] { return isStopping || !Queue.empty(); });
+    // Pending frames are written before stopping
+    if (Queue.empty()) break;
+    Frame* frame= Queue.front();
+    Queue.pop_front();
+    isWriting= true;
+    lock.unlock();
+    FileOutput::SaveFieldsRawVTIFile(frame->fullpath, frame->nbX, frame->nbY, frame->nbZ, frame->bboxMin, frame->bboxMax,
+                                     frame->names, frame->nbComp, frame->data, frame->colIndex, frame->fillVal, false);
+    lock.lock();
+    isWriting= false;
+    FreeFrames.push_back(frame);
+    if (Queue.empty()) idleCond.notify_all();
+  }
+}
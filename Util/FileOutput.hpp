@@ -0,0 +1,91 @@
+#pragma once
+
+// Standard lib
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class FileOutput
+{
+  public:
+  static void SaveScalarFieldRawVTIFile(
+      std::string const iFullpath,
+      std::array<double, 3> const iBBoxMin,
+      std::array<double, 3> const iBBoxMax,
+      std::vector<std::vector<std::vector<double>>> const& iField,
+      bool const iVerbose);
+
+  static void SaveVectorFieldRawVTIFile(
+      std::string const iFullpath,
+      std::array<double, 3> const iBBoxMin,
+      std::array<double, 3> const iBBoxMax,
+      std::vector<std::vector<std::vector<std::array<double, 3>>>> const& iField,
+      bool const iVerbose);
+
+  // Writes several point data arrays in the same file
+  // Each array of iData holds iNbComp[k] interleaved float components per voxel with X varying fastest
+  // When iColIndex is given, the arrays only hold the stored (x,y) columns one after the other with Z varying fastest
+  // iColIndex[x * iNbY + y] is then the rank of the column in the arrays, -1 for the columns written with iFillVal[k]
+  static void SaveFieldsRawVTIFile(
+      std::string const iFullpath,
+      int const iNbX,
+      int const iNbY,
+      int const iNbZ,
+      std::array<double, 3> const iBBoxMin,
+      std::array<double, 3> const iBBoxMax,
+      std::vector<std::string> const& iNames,
+      std::vector<int> const& iNbComp,
+      std::vector<std::vector<float>> const& iData,
+      std::vector<int64_t> const& iColIndex,
+      std::vector<float> const& iFillVal,
+      bool const iVerbose);
+};
+
+
+// Background writer of raw appended VTI files
+// - The caller packs each frame in a buffer taken from a fixed pool and a dedicated thread writes it to disk
+// - Buffers go back to the pool once written and keep their capacity so steady state output does not allocate
+// - Acquiring a frame never waits, it fails when all the buffers are queued or being written
+class FileOutputQueue
+{
+  public:
+  struct Frame
+  {
+    std::string fullpath;
+    int nbX;
+    int nbY;
+    int nbZ;
+    std::array<double, 3> bboxMin;
+    std::array<double, 3> bboxMax;
+    std::vector<std::string> names;
+    std::vector<int> nbComp;
+    std::vector<std::vector<float>> data;
+    std::vector<int64_t> colIndex;  // Rank of each (x,y) column in the arrays, empty for dense arrays
+    std::vector<float> fillVal;     // Value of each array in the columns without storage
+  };
+
+  FileOutputQueue(int const iNbBuffers);
+  ~FileOutputQueue();
+
+  Frame* AcquireFrame();
+  void SubmitFrame(Frame* iFrame);
+  void Flush();
+
+  private:
+  void WriterLoop();
+
+  std::vector<Frame> Pool;
+  std::vector<Frame*> FreeFrames;
+  std::deque<Frame*> Queue;
+  std::mutex queueMutex;
+  std::condition_variable queueCond;
+  std::condition_variable idleCond;
+  bool isWriting;
+  bool isStopping;
+  std::thread writerThread;
+};
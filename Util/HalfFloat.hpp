@@ -0,0 +1,121 @@
+#pragma once
+
+// Standard lib
+#include <cstdint>
+#include <cstring>
+
+
+// Reduced precision storage of floating point values on 16 bits
+// Values are converted to float on read so all computations stay in single precision
+namespace HalfFloat {
+
+  // Brain floating point format
+  // Same exponent range as float with 8 bits of mantissa precision
+  class BFloat16
+  {
+public:
+    // Constructors
+    BFloat16() { bits= 0; }
+    BFloat16(const float iVal) {
+      uint32_t u;
+      std::memcpy(&u, &iVal, sizeof(u));
+      if ((u & 0x7FFFFFFFu) > 0x7F800000u)
+        bits= uint16_t((u >> 16) | 0x0040u);  // Keep NaN quiet
+      else
+        bits= uint16_t((u + 0x7FFFu + ((u >> 16) & 1u)) >> 16);  // Round to nearest even
+    }
+
+    // Operators
+    inline operator float() const {
+      const uint32_t u= uint32_t(bits) << 16;
+      float val;
+      std::memcpy(&val, &u, sizeof(val));
+      return val;
+    }
+
+private:
+    uint16_t bits;
+  };
+
+
+  // IEEE 754 half precision format
+  // 11 bits of precision with values up to 65504 and subnormals down to 6e-8
+  class Float16
+  {
+public:
+    // Constructors
+    Float16() { bits= 0; }
+    Float16(const float iVal) {
+      uint32_t u;
+      std::memcpy(&u, &iVal, sizeof(u));
+      const uint32_t sign= (u >> 16) & 0x8000u;
+      const int32_t exp= int32_t((u >> 23) & 0xFFu) - 127 + 15;
+      uint32_t mant= u & 0x007FFFFFu;
+      // Infinity and NaN
+      if (((u >> 23) & 0xFFu) == 0xFFu) {
+        bits= uint16_t(sign | 0x7C00u | (mant ? 0x0200u : 0u));
+        return;
+      }
+      // Overflow to infinity
+      if (exp >= 31) {
+        bits= uint16_t(sign | 0x7C00u);
+        return;
+      }
+      // Subnormal or zero
+      if (exp <= 0) {
+        if (exp < -10) {
+          bits= uint16_t(sign);
+          return;
+        }
+        mant|= 0x00800000u;
+        const int shift= 14 - exp;
+        uint32_t half= mant >> shift;
+        const uint32_t rem= mant & ((1u << shift) - 1u);
+        const uint32_t mid= 1u << (shift - 1);
+        if (rem > mid || (rem == mid && (half & 1u))) half++;
+        bits= uint16_t(sign | half);
+        return;
+      }
+      // Normal value rounded to nearest even, a carry correctly rolls over into the exponent
+      uint32_t half= (uint32_t(exp) << 10) | (mant >> 13);
+      const uint32_t rem= mant & 0x1FFFu;
+      if (rem > 0x1000u || (rem == 0x1000u && (half & 1u))) half++;
+      bits= uint16_t(sign | half);
+    }
+
+    // Operators
+    inline operator float() const {
+      const uint32_t sign= uint32_t(bits & 0x8000u) << 16;
+      uint32_t exp= (bits >> 10) & 0x1Fu;
+      uint32_t mant= bits & 0x03FFu;
+      uint32_t u;
+      if (exp == 0x1Fu) {
+        u= sign | 0x7F800000u | (mant << 13);
+      }
+      else if (exp == 0) {
+        if (mant == 0) {
+          u= sign;
+        }
+        else {
+          // Normalize the subnormal value
+          exp= 127 - 15 + 1;
+          while (!(mant & 0x0400u)) {
+            mant<<= 1;
+            exp--;
+          }
+          u= sign | (exp << 23) | ((mant & 0x03FFu) << 13);
+        }
+      }
+      else {
+        u= sign | ((exp + 127 - 15) << 23) | (mant << 13);
+      }
+      float val;
+      std::memcpy(&val, &u, sizeof(val));
+      return val;
+    }
+
+private:
+    uint16_t bits;
+  };
+
+}  // namespace HalfFloat
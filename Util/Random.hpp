@@ -1,6 +1,7 @@
 #pragma once
 
 // Standard lib
+#include <cstdint>
 #include <cstdlib>
 
 
@@ -21,4 +22,14 @@ namespace Random {
     return iMin + rand() % (iMax - iMin + 1);
   }
 
+  // Stateless integer hash, a thread safe random source when indexed by item and iteration
+  inline uint32_t Hash(uint32_t iVal) {
+    iVal^= iVal >> 16;
+    iVal*= 0x7FEB352Du;
+    iVal^= iVal >> 15;
+    iVal*= 0x846CA68Bu;
+    iVal^= iVal >> 16;
+    return iVal;
+  }
+
 }  // namespace Random
@@ -0,0 +1,295 @@
+#include "Timeline.hpp"
+
+// Standard lib
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+
+namespace {
+  template <typename T>
+  void AppendPOD(std::vector<uint8_t>& ioBytes, T const iVal) {
+    const size_t pos= ioBytes.size();
+    ioBytes.resize(pos + sizeof(T));
+    std::memcpy(ioBytes.data() + pos, &iVal, sizeof(T));
+  }
+
+  template <typename T>
+  bool ReadPOD(uint8_t const* iBytes, size_t const iNbBytes, size_t& ioPos, T& oVal) {
+    if (ioPos + sizeof(T) > iNbBytes) return false;
+    std::memcpy(&oVal, iBytes + ioPos, sizeof(T));
+    ioPos+= sizeof(T);
+    return true;
+  }
+}  // namespace
+
+
+Timeline::Timeline(int const iKeyPeriod, int const iQuantBits, size_t const iMemBudget, std::string const iSpillPath) {
+  keyPeriod= std::max(iKeyPeriod, 1);
+  quantBits= std::min(std::max(iQuantBits, 2), 24);
+  memBudget= iMemBudget;
+  spillPath= iSpillPath;
+  nbMemFront= 0;
+  memBytes= 0;
+  fileBytes= 0;
+  seekFrame= -1;
+}
+
+
+Timeline::~Timeline() {
+  if (spillFile.is_open()) {
+    spillFile.close();
+    std::error_code errCode;
+    std::filesystem::remove(spillPath, errCode);
+  }
+}
+
+
+// Append a frame made of the given arrays
+// A keyframe is forced when the number or the sizes of the arrays change,
+// or when a value falls outside the quantization range of the current key period
+void Timeline::Record(std::vector<std::vector<float>> const& iArrays) {
+  const int nbArrays= (int)iArrays.size();
+  const int64_t maxQuant= ((int64_t)1 << quantBits) - 1;
+  bool isKey= ((int)Frames.size() % keyPeriod == 0) || ((int)LastQuant.size() != nbArrays);
+  for (int k= 0; k < nbArrays && !isKey; k++)
+    if (LastQuant[k].size() != iArrays[k].size()) isKey= true;
+
+  // Quantize with the step of the key period and check the values fit its range
+  std::vector<std::vector<int32_t>> quant(nbArrays);
+  for (int k= 0; k < nbArrays && !isKey; k++) {
+    quant[k].resize(iArrays[k].size());
+    for (int i= 0; i < (int)iArrays[k].size() && !isKey; i++) {
+      const int64_t val= Quantize(iArrays[k][i], k);
+      if (val < 0) isKey= true;
+      else quant[k][i]= (int32_t)val;
+    }
+  }
+
+  // Choose the quantization of the new key period from the value ranges
+  // The step is rounded up so the whole range maps in [0, maxQuant], constant arrays get a step relative to their magnitude
+  if (isKey) {
+    QuantOffset.assign(nbArrays, 0.0f);
+    QuantStep.assign(nbArrays, 1.0f);
+    LastQuant.resize(nbArrays);
+    PrevQuant.resize(nbArrays);
+    for (int k= 0; k < nbArrays; k++) {
+      float valMin= INFINITY, valMax= -INFINITY;
+      for (const float val : iArrays[k]) {
+        if (!std::isfinite(val)) continue;
+        valMin= std::min(valMin, val);
+        valMax= std::max(valMax, val);
+      }
+      if (valMin > valMax) valMin= valMax= 0.0f;
+      QuantOffset[k]= valMin;
+      if (valMax > valMin) QuantStep[k]= std::nextafter((float)(((double)valMax - (double)valMin) / (double)maxQuant), INFINITY);
+      else QuantStep[k]= std::max(std::abs(valMin) * std::ldexp(1.0f, -quantBits), FLT_MIN);
+      LastQuant[k].assign(iArrays[k].size(), 0);
+      PrevQuant[k].assign(iArrays[k].size(), 0);
+      quant[k].resize(iArrays[k].size());
+      for (int i= 0; i < (int)iArrays[k].size(); i++)
+        quant[k][i]= (int32_t)Quantize(iArrays[k][i], k);
+    }
+  }
+
+  // Encode the values, or their difference with the linear extrapolation of the two previous frames
+  // Quantized values lie in [0, 2^24), so the extrapolation and the residual stay far from the int32 limits
+  std::vector<uint8_t> bytes;
+  std::vector<int32_t> residual;
+  AppendPOD<uint32_t>(bytes, (uint32_t)nbArrays);
+  for (int k= 0; k < nbArrays; k++) {
+    const int nbVals= (int)iArrays[k].size();
+    AppendPOD<uint32_t>(bytes, (uint32_t)nbVals);
+    AppendPOD<float>(bytes, QuantOffset[k]);
+    AppendPOD<float>(bytes, QuantStep[k]);
+    residual.resize(nbVals);
+    for (int i= 0; i < nbVals; i++) {
+      residual[i]= isKey ? quant[k][i] : quant[k][i] - (2 * LastQuant[k][i] - PrevQuant[k][i]);
+      PrevQuant[k][i]= isKey ? quant[k][i] : LastQuant[k][i];
+      LastQuant[k][i]= quant[k][i];
+    }
+    EncodeBlocks(residual, bytes);
+  }
+
+  // Store the frame and spill the oldest ones beyond the memory budget
+  Frames.push_back(FrameRec{isKey, std::move(bytes), 0, 0});
+  memBytes+= Frames.back().bytes.size();
+  while (memBytes > memBudget && nbMemFront < (int)Frames.size() - 1)
+    if (!SpillOldest()) break;
+}
+
+
+// Get the quantized value of an array element with the quantization of the current key period
+// Values out of the range of the key period return -1, non finite values map to the offset
+int64_t Timeline::Quantize(float const iVal, int const iArray) const {
+  if (!std::isfinite(iVal)) return 0;
+  const double quantVal= std::round(((double)iVal - (double)QuantOffset[iArray]) / (double)QuantStep[iArray]);
+  if (quantVal < 0.0 || quantVal > (double)(((int64_t)1 << quantBits) - 1)) return -1;
+  return (int64_t)quantVal;
+}
+
+
+// Reconstruct the arrays of the given frame
+bool Timeline::Seek(int const iFrame, std::vector<std::vector<float>>& oArrays) {
+  if (iFrame < 0 || iFrame >= (int)Frames.size()) return false;
+
+  // Resume from the last decoded frame when it lies between the preceding keyframe and the target
+  int frameKey= iFrame;
+  while (!Frames[frameKey].isKey) frameKey--;
+  const int frameBeg= (seekFrame >= frameKey && seekFrame <= iFrame) ? seekFrame + 1 : frameKey;
+
+  // Accumulate the residuals up to the target frame
+  for (int f= frameBeg; f <= iFrame; f++) {
+    seekFrame= -1;
+    if (!LoadFrame(f, SeekBytes)) return false;
+    const uint8_t* data= (f < nbMemFront) ? SeekBytes.data() : Frames[f].bytes.data();
+    const size_t nbBytes= (f < nbMemFront) ? SeekBytes.size() : Frames[f].bytes.size();
+    size_t pos= 0;
+    uint32_t nbArrays= 0;
+    if (!ReadPOD(data, nbBytes, pos, nbArrays)) return false;
+    if (Frames[f].isKey) {
+      SeekOffset.assign(nbArrays, 0.0f);
+      SeekStep.assign(nbArrays, 1.0f);
+      SeekQuant.resize(nbArrays);
+      SeekPrevQuant.resize(nbArrays);
+    }
+    if (SeekQuant.size() != nbArrays) return false;
+    std::vector<int32_t> residual;
+    for (int k= 0; k < (int)nbArrays; k++) {
+      uint32_t nbVals= 0;
+      if (!ReadPOD(data, nbBytes, pos, nbVals)) return false;
+      if (!ReadPOD(data, nbBytes, pos, SeekOffset[k])) return false;
+      if (!ReadPOD(data, nbBytes, pos, SeekStep[k])) return false;
+      residual.resize(nbVals);
+      if (!DecodeBlocks(data, nbBytes, pos, residual)) return false;
+      if (Frames[f].isKey) {
+        SeekQuant[k]= residual;
+        SeekPrevQuant[k]= residual;
+      }
+      else {
+        if (SeekQuant[k].size() != nbVals) return false;
+        for (int i= 0; i < (int)nbVals; i++) {
+          const int32_t quant= 2 * SeekQuant[k][i] - SeekPrevQuant[k][i] + residual[i];
+          SeekPrevQuant[k][i]= SeekQuant[k][i];
+          SeekQuant[k][i]= quant;
+        }
+      }
+    }
+    seekFrame= f;
+  }
+
+  // Dequantize
+  oArrays.resize(SeekQuant.size());
+  for (int k= 0; k < (int)SeekQuant.size(); k++) {
+    oArrays[k].resize(SeekQuant[k].size());
+    for (int i= 0; i < (int)SeekQuant[k].size(); i++)
+      oArrays[k][i]= (float)((double)SeekOffset[k] + (double)SeekStep[k] * (double)SeekQuant[k][i]);
+  }
+  return true;
+}
+
+
+// Move the oldest frame held in memory to the end of the spill file
+bool Timeline::SpillOldest() {
+  if (!spillFile.is_open()) {
+    spillFile.open(spillPath, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!spillFile.is_open()) {
+      printf("[ERROR] Unable to create the timeline spill file [%s]\n\n", spillPath.c_str());
+      memBudget= SIZE_MAX;
+      return false;
+    }
+  }
+  FrameRec& frame= Frames[nbMemFront];
+  frame.fileOffset= fileBytes;
+  frame.fileSize= frame.bytes.size();
+  spillFile.seekp((std::streamoff)frame.fileOffset);
+  spillFile.write((const char*)frame.bytes.data(), (std::streamsize)frame.fileSize);
+  fileBytes+= frame.fileSize;
+  memBytes-= frame.fileSize;
+  std::vector<uint8_t>().swap(frame.bytes);
+  nbMemFront++;
+  return true;
+}
+
+
+// Read back a spilled frame, frames still in memory are used in place
+bool Timeline::LoadFrame(int const iFrame, std::vector<uint8_t>& oBytes) {
+  if (iFrame >= nbMemFront) return true;
+  const FrameRec& frame= Frames[iFrame];
+  spillFile.flush();
+  oBytes.resize(frame.fileSize);
+  spillFile.seekg((std::streamoff)frame.fileOffset);
+  spillFile.read((char*)oBytes.data(), (std::streamsize)frame.fileSize);
+  if (!spillFile) {
+    spillFile.clear();
+    printf("[ERROR] Unable to read frame %d from the timeline spill file\n\n", iFrame);
+    return false;
+  }
+  return true;
+}
+
+
+// Zigzag map the values and pack them in blocks of 64 preceded by their bit width
+void Timeline::EncodeBlocks(std::vector<int32_t> const& iVals, std::vector<uint8_t>& ioBytes) {
+  const int nbVals= (int)iVals.size();
+  uint32_t zig[64];
+  for (int beg= 0; beg < nbVals; beg+= 64) {
+    const int nbBlock= std::min(64, nbVals - beg);
+    uint32_t bitsOr= 0;
+    for (int i= 0; i < nbBlock; i++) {
+      zig[i]= ((uint32_t)iVals[beg + i] << 1) ^ (uint32_t)(iVals[beg + i] >> 31);
+      bitsOr|= zig[i];
+    }
+    int width= 0;
+    while (width < 32 && (bitsOr >> width) != 0) width++;
+    ioBytes.push_back((uint8_t)width);
+    if (width == 0) continue;
+    uint64_t acc= 0;
+    int nbAccBits= 0;
+    for (int i= 0; i < nbBlock; i++) {
+      acc|= (uint64_t)zig[i] << nbAccBits;
+      nbAccBits+= width;
+      while (nbAccBits >= 8) {
+        ioBytes.push_back((uint8_t)(acc & 0xFF));
+        acc>>= 8;
+        nbAccBits-= 8;
+      }
+    }
+    if (nbAccBits > 0) ioBytes.push_back((uint8_t)(acc & 0xFF));
+  }
+}
+
+
+// Unpack as many values as oVals holds
+bool Timeline::DecodeBlocks(uint8_t const* iBytes, size_t const iNbBytes, size_t& ioPos, std::vector<int32_t>& oVals) {
+  const int nbVals= (int)oVals.size();
+  for (int beg= 0; beg < nbVals; beg+= 64) {
+    const int nbBlock= std::min(64, nbVals - beg);
+    if (ioPos >= iNbBytes) return false;
+    const int width= iBytes[ioPos++];
+    if (width > 32) return false;
+    if (width == 0) {
+      std::fill(oVals.begin() + beg, oVals.begin() + beg + nbBlock, 0);
+      continue;
+    }
+    const size_t nbBlockBytes= ((size_t)nbBlock * width + 7) / 8;
+    if (ioPos + nbBlockBytes > iNbBytes) return false;
+    const uint64_t mask= (width == 32) ? 0xFFFFFFFFull : ((1ull << width) - 1);
+    uint64_t acc= 0;
+    int nbAccBits= 0;
+    for (int i= 0; i < nbBlock; i++) {
+      while (nbAccBits < width) {
+        acc|= (uint64_t)iBytes[ioPos++] << nbAccBits;
+        nbAccBits+= 8;
+      }
+      const uint32_t zig= (uint32_t)(acc & mask);
+      acc>>= width;
+      nbAccBits-= width;
+      oVals[beg + i]= (int32_t)(zig >> 1) ^ -(int32_t)(zig & 1);
+    }
+  }
+  return true;
+}
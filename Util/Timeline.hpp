@@ -0,0 +1,69 @@
+#pragma once
+
+// Standard lib
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+
+// Compressed history of a set of float arrays for random access scrubbing
+// - Values are quantized with a step per array chosen at each keyframe from the value range and the number of quantization bits,
+//   a value leaving the range of its key period starts a new keyframe
+// - Keyframes store the quantized values and the other frames their difference with the linear extrapolation of the two previous frames,
+//   so decoding is exact in the quantized domain and smooth transients leave small residuals
+// - Integers are zigzag mapped and bit-packed in blocks of 64 with the bit width of the block, so static regions cost one byte per block
+// - Encoded frames are kept in memory up to a budget, the oldest ones are then spilled to a file and read back when seeking
+// - Seeking decodes from the closest preceding keyframe, or from the last decoded frame when scrubbing forward in the same key period
+class Timeline
+{
+  public:
+  Timeline(int const iKeyPeriod, int const iQuantBits, size_t const iMemBudget, std::string const iSpillPath);
+  ~Timeline();
+
+  void Record(std::vector<std::vector<float>> const& iArrays);
+  bool Seek(int const iFrame, std::vector<std::vector<float>>& oArrays);
+
+  int NbFrames() const { return (int)Frames.size(); }
+  size_t MemBytes() const { return memBytes; }
+  size_t FileBytes() const { return fileBytes; }
+
+  private:
+  struct FrameRec
+  {
+    bool isKey;
+    std::vector<uint8_t> bytes;  // Encoded frame, empty once spilled
+    uint64_t fileOffset;
+    uint64_t fileSize;
+  };
+
+  int64_t Quantize(float const iVal, int const iArray) const;
+  bool SpillOldest();
+  bool LoadFrame(int const iFrame, std::vector<uint8_t>& oBytes);
+  static void EncodeBlocks(std::vector<int32_t> const& iVals, std::vector<uint8_t>& ioBytes);
+  static bool DecodeBlocks(uint8_t const* iBytes, size_t const iNbBytes, size_t& ioPos, std::vector<int32_t>& oVals);
+
+  int keyPeriod;
+  int quantBits;
+  size_t memBudget;
+  std::string spillPath;
+  std::vector<FrameRec> Frames;
+  int nbMemFront;  // Index of the oldest frame still held in memory
+  size_t memBytes;
+  size_t fileBytes;
+  std::fstream spillFile;
+
+  // Quantization of the current key period and quantized values of the two last recorded frames
+  std::vector<float> QuantOffset;
+  std::vector<float> QuantStep;
+  std::vector<std::vector<int32_t>> LastQuant;
+  std::vector<std::vector<int32_t>> PrevQuant;
+
+  // Quantized values of the two last decoded frames to resume forward scrubbing
+  int seekFrame;
+  std::vector<float> SeekOffset;
+  std::vector<float> SeekStep;
+  std::vector<std::vector<int32_t>> SeekQuant;
+  std::vector<std::vector<int32_t>> SeekPrevQuant;
+  std::vector<uint8_t> SeekBytes;
+};